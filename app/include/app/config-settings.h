@@ -1,6 +1,7 @@
 #ifndef APP_CONFIG_SETTINGS_H
 #define APP_CONFIG_SETTINGS_H
 
+#include <stdint.h>
 #include "app/error.h"
 #include "app/constants.h"
 
@@ -13,9 +14,23 @@ struct config_settings_t
     char wifi_password[WIFI_PASSWORD_MAX_LENGTH + 1];
 };
 
+/*
+ * The AP of the last successful station connect. Reconnecting to exactly this AP
+ * skips the scan over every channel. Only valid while wifi_ssid matches the logins.
+ */
+struct wifi_fast_connect_t
+{
+    char wifi_ssid[WIFI_SSID_MAX_LENGTH + 1];
+    uint8_t bssid[WIFI_BSSID_LENGTH];
+    uint8_t channel;  /* 0 if nothing is cached */
+    uint8_t security; /* enum wifi_security_type */
+};
+
 enum error_e init_config_settings(void);
 void reset_config_settings(struct config_settings_t *c);
 void load_config_settings(struct config_settings_t *c);
 enum error_e store_config_settings(struct config_settings_t *c);
+enum error_e load_wifi_fast_connect(struct wifi_fast_connect_t *f);
+enum error_e store_wifi_fast_connect(const struct wifi_fast_connect_t *f);
 
 #endif
\ No newline at end of file
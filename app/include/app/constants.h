@@ -5,5 +5,6 @@
 #define WIFI_SSID_MAX_LENGTH 32
 #define WIFI_PASSWORD_MIN_LENGTH 8
 #define WIFI_PASSWORD_MAX_LENGTH 63
+#define WIFI_BSSID_LENGTH 6
 
 #endif
\ No newline at end of file
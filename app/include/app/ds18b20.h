@@ -0,0 +1,20 @@
+#ifndef APP_DS18B20_H
+#define APP_DS18B20_H
+
+#include <stddef.h>
+#include <zephyr/kernel.h>
+#include "app/error.h"
+#include "app/temperature-logger.h"
+
+#ifndef CONFIG_TEMPERATURE_LOGGER_DS18B20_RESOLUTION
+// this is never used. im putting it there so that intellisense doesnt get confused
+#define CONFIG_TEMPERATURE_LOGGER_DS18B20_RESOLUTION 12
+#endif
+
+enum error_e init_ds18b20(void);
+size_t get_ds18b20_count(void);
+enum error_e start_ds18b20_conversion(void);
+k_timeout_t get_ds18b20_conversion_time(void);
+enum error_e read_ds18b20_temperature(size_t channel, temperature_t *temperature);
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef APP_ERROR_H
 #define APP_ERROR_H
 
+#define GENERIC_NULL_PTR_ERROR_MESSAGE "Received a NULL pointer argument."
+
 enum error_e
 {
     E_SUCCESS,
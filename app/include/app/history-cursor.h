@@ -0,0 +1,34 @@
+#ifndef APP_HISTORY_CURSOR_H
+#define APP_HISTORY_CURSOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "app/error.h"
+#include "app/temperature-logger.h"
+#include "app/temperature-history.h"
+
+/*
+ * Reads the raw samples of one channel in time order, across the history segments and
+ * then the RAM list, one batch at a time. Nothing is locked between batches.
+ * The position is the next sample to read: 'offset' samples into segment 'segment'.
+ * The RAM list counts as the segment it will be flushed to, so a position stays valid
+ * across a flush. A batch never spans two segments, so without a start time, the first
+ * sample of a batch is at 'offset - count' of 'segment' after the read.
+ * The caller owns the cursor. It holds a segment reader, so keep it off small thread stacks.
+ */
+struct history_cursor_t
+{
+    size_t channel;
+    sys_minutes_t start_time; /* samples before this time are skipped */
+    bool final_only;          /* leave out the newest sample while ingest compression may still replace it */
+    uint32_t segment;
+    uint32_t offset;
+    bool reader_open; /* 'reader' is open on 'segment' and has returned 'offset' samples */
+    struct temperature_segment_reader_t reader;
+};
+
+enum error_e open_history_cursor(struct history_cursor_t *cursor, size_t channel, sys_minutes_t start_time, bool final_only);
+enum error_e open_history_cursor_at(struct history_cursor_t *cursor, size_t channel, uint32_t segment, uint32_t offset, bool final_only);
+enum error_e read_history_cursor(struct history_cursor_t *cursor, struct temperature_sample_t *samples, size_t capacity, size_t *count);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef APP_HTTP_EXPORT_H
+#define APP_HTTP_EXPORT_H
+
+#include "app/error.h"
+
+#ifndef CONFIG_TEMPERATURE_LOGGER_HTTP_PORT
+// this is never used. im putting it there so that intellisense doesnt get confused
+#define CONFIG_TEMPERATURE_LOGGER_HTTP_PORT 80
+#endif
+
+enum error_e init_http_export(void);
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef APP_METRICS_H
+#define APP_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+/*
+ * Bucket b counts durations below 4^b microseconds that did not fit bucket b - 1.
+ * The last bucket counts everything from 4^(METRICS_HISTOGRAM_BUCKETS - 2) us (about 1 s) up.
+ */
+#define METRICS_HISTOGRAM_BUCKETS 12
+
+enum metrics_phase_e
+{
+    METRICS_PHASE_SAMPLE,        /* reading one DS18B20 conversion */
+    METRICS_PHASE_COMPACTION,    /* rolling up or merging the oldest history segments after a flush */
+    METRICS_PHASE_SEGMENT_STORE, /* encoding and writing one history segment */
+    METRICS_PHASE_BLOCK_LOAD,    /* reading one history block from NVS */
+    METRICS_PHASE_CONFIG_STORE,  /* writing one config field to NVS */
+    METRICS_PHASE_WIFI_CONNECT,  /* station connect request until the AP accepted it */
+    METRICS_PHASE_WIFI_DHCP,     /* AP accepted the station until it has an address */
+    METRICS_PHASE_COUNT,
+};
+
+/*
+ * Milestones of the boot. Each one is recorded once, the first time it is reached,
+ * in milliseconds since boot.
+ */
+enum metrics_milestone_e
+{
+    METRICS_MILESTONE_FIRST_SAMPLE,   /* the first sample is in a sample queue */
+    METRICS_MILESTONE_NVS_MOUNTED,
+    METRICS_MILESTONE_HISTORY_LOADED, /* history, tiers and journal are loaded. samples are stored from here on */
+    METRICS_MILESTONE_INIT_DONE,      /* every module has been started */
+    METRICS_MILESTONE_WIFI_CONNECTED, /* the station has an address for the first time */
+    METRICS_MILESTONE_FIRST_UPLINK,   /* the first uplink datagram has been sent */
+    METRICS_MILESTONE_COUNT,
+};
+
+struct metrics_phase_t
+{
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t histogram[METRICS_HISTOGRAM_BUCKETS];
+};
+
+void add_metrics_sample(enum metrics_phase_e phase, uint32_t duration_us);
+void get_metrics_phase(enum metrics_phase_e phase, struct metrics_phase_t *m);
+void reset_metrics(void);
+const char *get_metrics_phase_name(enum metrics_phase_e phase);
+int format_metrics_phase(enum metrics_phase_e phase, char *buffer, size_t size);
+void add_metrics_milestone(enum metrics_milestone_e milestone);
+int64_t get_metrics_milestone(enum metrics_milestone_e milestone);
+int format_metrics_milestone(enum metrics_milestone_e milestone, char *buffer, size_t size);
+
+/*
+ * Timing a phase costs two reads of the cycle counter and one short spinlock.
+ * Without CONFIG_TEMPERATURE_LOGGER_METRICS, these compile to nothing.
+ */
+
+static inline uint32_t begin_metrics_phase(void)
+{
+    return IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_METRICS) ? k_cycle_get_32() : 0;
+}
+
+/**
+ * @brief Records the time since begin_metrics_phase() returned 'start'.
+ * Phases longer than one wrap of the cycle counter (several seconds) must use record_metrics_phase() instead.
+ */
+static inline void end_metrics_phase(enum metrics_phase_e phase, uint32_t start)
+{
+    if (IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_METRICS))
+    {
+        add_metrics_sample(phase, k_cyc_to_us_floor32(k_cycle_get_32() - start));
+    }
+}
+
+static inline void record_metrics_phase(enum metrics_phase_e phase, uint32_t duration_us)
+{
+    if (IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_METRICS))
+    {
+        add_metrics_sample(phase, duration_us);
+    }
+}
+
+/**
+ * @brief Records that a milestone has been reached now. Only the first call per milestone counts.
+ */
+static inline void record_metrics_milestone(enum metrics_milestone_e milestone)
+{
+    if (IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_METRICS))
+    {
+        add_metrics_milestone(milestone);
+    }
+}
+
+#endif
@@ -1,15 +1,50 @@
 #ifndef APP_NVS_H
 #define APP_NVS_H
 
+#include <stdint.h>
+#include <sys/types.h>
 #include "app/error.h"
 
 enum nvs_key_e {
-    NVS_KEY_CONFIG_SETTINGS = 1,
-    NVS_KEY_TEMPERATURE_DATA,
+    NVS_KEY_CONFIG_SETTINGS = 1,        /* legacy single-blob config settings. migrated at boot */
+    NVS_KEY_TEMPERATURE_DATA,           /* legacy single-blob history. no longer written */
+    NVS_KEY_TEMPERATURE_HISTORY_INDEX,  /* index of channel 0. channel c uses NVS_KEY_TEMPERATURE_HISTORY_INDEX + c */
+    NVS_KEY_TEMPERATURE_HISTORY_INDEX_LAST = NVS_KEY_TEMPERATURE_HISTORY_INDEX + 7, /* room for 8 channels */
+    NVS_KEY_TEMPERATURE_TIER_INDEX,     /* tier indexes of channel 0. channel c uses NVS_KEY_TEMPERATURE_TIER_INDEX + c */
+    NVS_KEY_TEMPERATURE_TIER_INDEX_LAST = NVS_KEY_TEMPERATURE_TIER_INDEX + 7,
+    NVS_KEY_UPLINK_CURSORS,             /* struct uplink_cursor_t of every channel */
+    NVS_KEY_WIFI_FAST_CONNECT,          /* struct wifi_fast_connect_t */
+    NVS_KEY_CONFIG_SCHEMA_VERSION,      /* uint16_t layout version of the config settings records */
+    NVS_KEY_TEMPERATURE_HISTORY_INDEX_B, /* second slot of the index of channel 0. see temperature-history.c */
+    NVS_KEY_TEMPERATURE_HISTORY_INDEX_B_LAST = NVS_KEY_TEMPERATURE_HISTORY_INDEX_B + 7,
+    // config fields occupy [BASE, BASE + CONFIG_FIELD_COUNT). see config-settings.c
+    NVS_KEY_CONFIG_FIELD_BASE = 0x80,
+    NVS_KEY_CONFIG_FIELD_LAST = 0xFF,
+    // history blocks occupy [BASE, BASE + CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT * (CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT + TEMPERATURE_HISTORY_SPARE_SLOTS) * TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT)
+    NVS_KEY_TEMPERATURE_SEGMENT_BASE = 0x100,
+    // journal blocks occupy [BASE, BASE + CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT * TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT)
+    NVS_KEY_TEMPERATURE_JOURNAL_BASE = 0xF00,
+    // tier blocks occupy [BASE, BASE + CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT * TEMPERATURE_TIER_COUNT * CONFIG_TEMPERATURE_LOGGER_TIER_BLOCK_COUNT)
+    NVS_KEY_TEMPERATURE_TIER_BASE = 0x1000,
+};
+
+/* What write_nvs() and delete_nvs() have seen since boot. */
+struct nvs_stats_t
+{
+    uint32_t write_count;
+    uint32_t write_bytes;
+    uint32_t gc_count;     /* sectors garbage collected. NVS collects one every time it moves on to the next sector */
+    ssize_t free_space;    /* bytes left for new records. negative on error */
+    uint32_t sector_size;
+    uint32_t sector_count;
+    uint32_t write_sector; /* sector new records go to */
 };
 
 enum error_e init_nvs(void);
 struct nvs_fs* get_nvs_fs(void);
+ssize_t write_nvs(uint16_t id, const void *data, size_t len);
+int delete_nvs(uint16_t id);
+void get_nvs_stats(struct nvs_stats_t *stats);
 
 
 #endif
\ No newline at end of file
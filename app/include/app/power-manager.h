@@ -0,0 +1,11 @@
+#ifndef APP_POWER_MANAGER_H
+#define APP_POWER_MANAGER_H
+
+#include <zephyr/kernel.h>
+#include "app/error.h"
+
+enum error_e init_power_manager(void);
+enum error_e acquire_wifi_station(k_timeout_t timeout);
+void release_wifi_station(void);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef APP_SAMPLE_CODEC_H
+#define APP_SAMPLE_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "app/error.h"
+#include "app/temperature-logger.h"
+
+/*
+ * Compact on-flash encoding for temperature samples.
+ *
+ * Samples are grouped in blocks of at most SAMPLE_CODEC_BLOCK_SIZE samples.
+ * Every block can be decoded on its own:
+ *
+ *   block  := count(u8) base_uptime(varint) base_temperature(zigzag varint) sample*
+ *   sample := 0b0UUTTTTT                                  (short form, 1 byte)
+ *           | 0x80 uptime_dod(zigzag varint) temperature_delta(zigzag varint)
+ *
+ * uptime_dod is the change in the uptime delta (delta of delta) and
+ * temperature_delta is the change in temperature since the previous sample.
+ * The short form holds uptime_dod in [-2, 1] (UU, zigzag) and
+ * temperature_delta in [-16, 15] (TTTTT, zigzag), which covers nearly every
+ * sample taken at a fixed period.
+ */
+
+#define SAMPLE_CODEC_BLOCK_SIZE 64
+#define SAMPLE_CODEC_BLOCK_HEADER_MAX_SIZE (1 + 5 + 3)
+#define SAMPLE_CODEC_SAMPLE_MAX_SIZE (1 + 5 + 3)
+#define SAMPLE_CODEC_MAX_ENCODED_SIZE(samples)                                                         \
+    ((((samples) + SAMPLE_CODEC_BLOCK_SIZE - 1) / SAMPLE_CODEC_BLOCK_SIZE) * SAMPLE_CODEC_BLOCK_HEADER_MAX_SIZE + \
+     (samples) * SAMPLE_CODEC_SAMPLE_MAX_SIZE)
+
+struct sample_encoder_t
+{
+    uint8_t *buffer;
+    size_t capacity;
+    size_t size;              /* number of bytes written so far */
+    size_t block_start;       /* offset of the count byte of the open block */
+    uint8_t block_count;      /* number of samples in the open block. 0 means no open block */
+    struct temperature_sample_t previous;
+    int64_t previous_delta;
+};
+
+struct sample_decoder_t
+{
+    const uint8_t *buffer;
+    size_t size;
+    size_t position;
+    uint8_t block_remaining; /* number of samples left in the current block */
+    struct temperature_sample_t previous;
+    int64_t previous_delta;
+};
+
+void init_sample_encoder(struct sample_encoder_t *e, uint8_t *buffer, size_t capacity);
+enum error_e encode_sample(struct sample_encoder_t *e, struct temperature_sample_t sample);
+void init_sample_decoder(struct sample_decoder_t *d, const uint8_t *buffer, size_t size);
+enum error_e decode_sample(struct sample_decoder_t *d, struct temperature_sample_t *sample);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef APP_SAMPLE_COMPRESSOR_H
+#define APP_SAMPLE_COMPRESSOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "app/temperature-logger.h"
+
+/* What to do with a sample after it went through the compressor. */
+enum sample_compressor_action_e
+{
+    SAMPLE_COMPRESSOR_APPEND,  /* append the sample. the samples before it are final */
+    SAMPLE_COMPRESSOR_REPLACE, /* the sample replaces the last one, which the line to the sample reconstructs */
+};
+
+/* A slope of sample values over time, kept as a fraction so it is exact. 'time' is always positive. */
+struct sample_slope_t
+{
+    int32_t temperature;
+    uint32_t time;
+};
+
+/*
+ * Swinging door compression of a stream of samples. The anchor is the last final sample.
+ * The candidate is the newest sample, which is kept until a later sample shows
+ * whether the line from the anchor to that sample reconstructs it.
+ * 'upper' and 'lower' bound the slopes from the anchor that pass within the tolerance
+ * of every sample after the anchor. Start with reset_sample_compressor().
+ */
+struct sample_compressor_t
+{
+    struct temperature_sample_t anchor;
+    struct temperature_sample_t candidate; /* only valid while has_candidate */
+    struct sample_slope_t upper;
+    struct sample_slope_t lower;
+    uint16_t tolerance; /* in 1/16 degrees */
+    bool has_anchor;
+    bool has_candidate;
+};
+
+void reset_sample_compressor(struct sample_compressor_t *c, uint16_t tolerance);
+enum sample_compressor_action_e compress_sample(struct sample_compressor_t *c, struct temperature_sample_t sample);
+
+/* Whether the last sample that went through the compressor may still be replaced. */
+static inline bool sample_compressor_has_candidate(const struct sample_compressor_t *c)
+{
+    return c->has_candidate;
+}
+
+#endif
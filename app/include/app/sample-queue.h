@@ -0,0 +1,31 @@
+#ifndef APP_SAMPLE_QUEUE_H
+#define APP_SAMPLE_QUEUE_H
+
+#include <stdbool.h>
+#include <zephyr/sys/atomic.h>
+#include "app/error.h"
+#include "app/temperature-logger.h"
+
+#ifndef CONFIG_TEMPERATURE_LOGGER_SAMPLE_QUEUE_SIZE
+// this is never used. im putting it there so that intellisense doesnt get confused
+#define CONFIG_TEMPERATURE_LOGGER_SAMPLE_QUEUE_SIZE 16
+#endif
+
+/*
+ * Lock-free single-producer/single-consumer queue of temperature samples.
+ * Exactly one thread may push and exactly one thread may pop.
+ * head and tail only ever increase (wrapping). The slot of a position is position % size.
+ */
+struct sample_queue_t
+{
+    struct temperature_sample_t samples[CONFIG_TEMPERATURE_LOGGER_SAMPLE_QUEUE_SIZE];
+    atomic_t head; /* next position to pop. only written by the consumer */
+    atomic_t tail; /* next position to push. only written by the producer */
+};
+
+enum error_e push_sample_queue(struct sample_queue_t *q, struct temperature_sample_t sample);
+enum error_e pop_sample_queue(struct sample_queue_t *q, struct temperature_sample_t *sample);
+bool sample_queue_is_empty(struct sample_queue_t *q);
+size_t get_sample_queue_length(struct sample_queue_t *q);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef APP_TEMPERATURE_HISTORY_H
+#define APP_TEMPERATURE_HISTORY_H
+
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+#include "app/error.h"
+#include "app/temperature-logger.h"
+#include "app/sample-codec.h"
+
+#ifndef CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT
+// this is never used. im putting it there so that intellisense doesnt get confused
+#define CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT 3
+#endif
+
+#ifndef CONFIG_TEMPERATURE_LOGGER_JOURNAL_INTERVAL
+// this is never used. im putting it there so that intellisense doesnt get confused
+#define CONFIG_TEMPERATURE_LOGGER_JOURNAL_INTERVAL 8
+#endif
+
+/*
+ * The history is a ring of segments. Each segment is split into blocks of up to
+ * SAMPLE_CODEC_BLOCK_SIZE samples and every block is its own NVS record, so a segment
+ * can be read and written one block at a time. Every channel has its own ring and index.
+ * The blocks of ring slot s of channel c live under
+ * NVS_KEY_TEMPERATURE_SEGMENT_BASE + (c * CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT + s) * TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT + block.
+ * Segments are addressed by a sequence number that only ever increases.
+ * The index record tells us which sequence numbers are currently live.
+ * The spare slots of all channels follow the rings. Slot
+ * CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT * CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT + c * TEMPERATURE_HISTORY_SPARE_SLOTS + k
+ * is spare k of channel c. Only the oldest segment ever lives in a spare slot.
+ */
+#define TEMPERATURE_HISTORY_SPARE_SLOTS 2 /* per channel. compaction writes the merged segment to one of them */
+#define TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT DIV_ROUND_UP(CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE, SAMPLE_CODEC_BLOCK_SIZE)
+#define TEMPERATURE_HISTORY_BLOCK_HEADER_SIZE 12
+#define TEMPERATURE_HISTORY_BLOCK_SUMMARY_SIZE 16
+#define TEMPERATURE_HISTORY_BLOCK_RECORD_MAX_SIZE (TEMPERATURE_HISTORY_BLOCK_HEADER_SIZE + TEMPERATURE_HISTORY_BLOCK_SUMMARY_SIZE + \
+                                                   SAMPLE_CODEC_MAX_ENCODED_SIZE(SAMPLE_CODEC_BLOCK_SIZE))
+
+struct temperature_history_index_t
+{
+    uint32_t oldest_segment; /* sequence number of the oldest live segment */
+    uint32_t segment_count;  /* number of live segments */
+    uint32_t generation;     /* bumped on every segment write. used to detect torn rewrites */
+    uint32_t oldest_spare;   /* 1 + the spare slot the oldest segment lives in. 0 if it lives in its ring slot */
+};
+
+/*
+ * Streams the samples of one segment out of NVS. Only one block is in memory at a time.
+ * The caller owns the reader, so keep it off small thread stacks.
+ */
+struct temperature_segment_reader_t
+{
+    size_t channel;
+    uint32_t segment;
+    uint8_t generation;
+    uint8_t block;              /* index of the block currently in buffer */
+    uint8_t block_count;
+    size_t length;              /* number of samples in the segment */
+    size_t consumed;            /* number of samples already returned */
+    sys_minutes_t last_uptime;  /* uptime of the last sample in the segment */
+    struct temperature_sample_t next;
+    struct sample_decoder_t decoder;
+    uint8_t buffer[TEMPERATURE_HISTORY_BLOCK_RECORD_MAX_SIZE];
+};
+
+enum error_e init_temperature_history(void);
+void get_temperature_history_index(size_t channel, struct temperature_history_index_t *index);
+enum error_e open_temperature_segment(struct temperature_segment_reader_t *reader, size_t channel, uint32_t segment);
+enum error_e peek_temperature_segment(struct temperature_segment_reader_t *reader, struct temperature_sample_t *sample);
+enum error_e read_temperature_segment(struct temperature_segment_reader_t *reader, struct temperature_sample_t *sample);
+enum error_e read_temperature_segment_block(struct temperature_segment_reader_t *reader, uint8_t block, const uint8_t **data, size_t *size);
+enum error_e store_temperature_segment(size_t channel, uint32_t segment, struct temperature_list_t *t);
+enum error_e append_temperature_segment(size_t channel, struct temperature_list_t *t);
+enum error_e drop_oldest_temperature_segment(size_t channel);
+enum error_e compact_oldest_temperature_segments(size_t channel, struct temperature_list_t *t);
+enum error_e query_temperature_segment(size_t channel, uint32_t segment, sys_minutes_t start, sys_minutes_t end, struct temperature_stats_t *stats);
+enum error_e store_temperature_journal(size_t channel, struct temperature_list_t *t, size_t first);
+enum error_e load_temperature_journal(size_t channel, struct temperature_list_t *t);
+
+#endif
@@ -2,7 +2,9 @@
 #define APP_TEMPERATURE_LOGGER_H
 
 #include <stdint.h>
-#include <zephyr/drivers/sensor.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
 #include "app/time.h"
 #include "app/error.h"
 
@@ -11,46 +13,143 @@
 #define CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE 100
 #endif
 
+#ifndef CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT
+// this is never used. im putting it there so that intellisense doesnt get confused
+#define CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT 1
+#endif
+
+#ifndef CONFIG_TEMPERATURE_LOGGER_MIN_SAMPLING_PERIOD
+// this is never used. im putting it there so that intellisense doesnt get confused
+#define CONFIG_TEMPERATURE_LOGGER_MIN_SAMPLING_PERIOD 30
+#define CONFIG_TEMPERATURE_LOGGER_MAX_SAMPLING_PERIOD 300
+#define CONFIG_TEMPERATURE_LOGGER_SAMPLING_THRESHOLD 4
+#endif
+
 typedef int16_t temperature_t;  // 1 sign bit; 11 whole bits; 4 fractional bits
 
 struct temperature_sample_t {
     temperature_t temperature;
-    sys_minutes_t uptime;
+    sys_minutes_t uptime; // minutes since TIME_EPOCH_UNIX_SECONDS. see app/time.h. named uptime for historical reasons
 };
 
+/* Summary of a set of samples. An empty set has count 0. Start with init_temperature_stats(). */
+struct temperature_stats_t
+{
+    temperature_t min;
+    temperature_t max;
+    int64_t sum;
+    uint32_t count;
+};
+
+/*
+ * Every TEMPERATURE_LIST_SUMMARY_BLOCK_SIZE samples of a list are summarized, so range
+ * queries only scan the samples of the blocks at the edges of the range.
+ */
+#define TEMPERATURE_LIST_SUMMARY_BLOCK_SIZE 64
+#define TEMPERATURE_LIST_SUMMARY_COUNT DIV_ROUND_UP(CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE, TEMPERATURE_LIST_SUMMARY_BLOCK_SIZE)
+
+/*
+ * The list is stored as a struct of arrays. An array of temperature_sample_t wastes 2 of
+ * every 8 bytes on padding, and scans that only compare uptimes touch half the cache lines.
+ * Use get_temperature_list_sample() and set_temperature_list_sample() to work with whole samples.
+ * set_temperature_list_sample() does not update the summary. append_temperature_sample() and the
+ * merge functions do.
+ */
 struct temperature_list_t
 {
-    struct temperature_sample_t data[CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE];
+    sys_minutes_t uptime[CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE];
+    temperature_t temperature[CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE];
+    struct temperature_stats_t summary[TEMPERATURE_LIST_SUMMARY_COUNT];
     size_t length;
     struct k_mutex lock;
 };
 
+struct temperature_segment_reader_t;
+
+/*
+ * A source of samples for a merge. Exactly one of the two pointers is set.
+ * Segment readers stream from NVS and can only be iterated front to back.
+ */
+struct temperature_source_t
+{
+    struct temperature_list_t *list;
+    struct temperature_segment_reader_t *reader;
+};
+
 struct merge_iterator_t
 {
-    struct temperature_list_t *src1;
-    struct temperature_list_t *src2;
-    struct temperature_list_t *current_list;
-    size_t current_index;
-    size_t next_src1_index;
-    size_t next_src2_index;
+    struct temperature_source_t src1;
+    struct temperature_source_t src2;
+    size_t src1_consumed; /* number of samples already returned from src1 */
+    size_t src2_consumed; /* number of samples already returned from src2 */
+    bool reverse;         /* iterate from the latest sample to the earliest */
 };
 
 
+static inline struct temperature_sample_t get_temperature_list_sample(const struct temperature_list_t *t, size_t index)
+{
+    return (struct temperature_sample_t){.temperature = t->temperature[index], .uptime = t->uptime[index]};
+}
+
+static inline void set_temperature_list_sample(struct temperature_list_t *t, size_t index, struct temperature_sample_t sample)
+{
+    t->uptime[index] = sample.uptime;
+    t->temperature[index] = sample.temperature;
+}
+
+static inline void init_temperature_stats(struct temperature_stats_t *stats)
+{
+    *stats = (struct temperature_stats_t){.min = INT16_MAX, .max = INT16_MIN};
+}
+
+static inline void add_temperature_stats_sample(struct temperature_stats_t *stats, temperature_t temperature)
+{
+    stats->min = MIN(stats->min, temperature);
+    stats->max = MAX(stats->max, temperature);
+    stats->sum += temperature;
+    stats->count++;
+}
+
+static inline void add_temperature_stats(struct temperature_stats_t *stats, const struct temperature_stats_t *other)
+{
+    if (other->count == 0)
+    {
+        return;
+    }
+    stats->min = MIN(stats->min, other->min);
+    stats->max = MAX(stats->max, other->max);
+    stats->sum += other->sum;
+    stats->count += other->count;
+}
 
 enum error_e init_temperature_logger(void);
+enum error_e load_temperature_logger_history(void);
+size_t get_recovered_temperature_journal(size_t channel, uint32_t *segment);
+int64_t divide_and_round(int64_t numerator, int64_t denominator);
+temperature_t get_temperature_stats_mean(const struct temperature_stats_t *stats);
+enum error_e query_temperature_range(size_t channel, sys_minutes_t start, sys_minutes_t end, struct temperature_stats_t *stats);
+enum error_e copy_temperature_list_samples(size_t channel, size_t first, bool final_only, struct temperature_sample_t *samples, size_t capacity, size_t *copied);
+void set_sampling_period_override(uint32_t seconds);
+enum error_e inject_temperature_samples(size_t channel, uint32_t count);
 
 
 #if CONFIG_BUILD_TEST_APP
 enum error_e reset_temperature_list(struct temperature_list_t *t);
-enum error_e load_temperature_list(struct temperature_list_t *t);
-enum error_e store_temperature_list(struct temperature_list_t *t);
-temperature_t sensor_value_to_temperature(struct sensor_value v);
-enum error_e get_temperature_sample(struct temperature_sample_t *t);
 enum error_e append_temperature_sample(struct temperature_list_t *list, struct temperature_sample_t sample);
+enum error_e replace_last_temperature_sample(struct temperature_list_t *list, struct temperature_sample_t sample);
+void update_temperature_list_summary(struct temperature_list_t *t);
+enum error_e query_temperature_list(struct temperature_list_t *t, sys_minutes_t start, sys_minutes_t end, struct temperature_stats_t *stats);
 enum error_e interpolate(struct temperature_sample_t *t1, struct temperature_sample_t *t2, struct temperature_sample_t* result);
-void init_merge_iterator(struct merge_iterator_t *m, struct temperature_list_t *src1, struct temperature_list_t *src2);
-enum error_e merge_iterate(struct merge_iterator_t *m, struct temperature_sample_t **sample);
+enum error_e interpolate_uniform(struct temperature_sample_t *t1, struct temperature_sample_t *t2, sys_minutes_t start_uptime, sys_minutes_t period, size_t count, sys_minutes_t *uptimes, temperature_t *temperatures);
+enum error_e init_merge_iterator(struct merge_iterator_t *m, struct temperature_list_t *src1, struct temperature_list_t *src2);
+enum error_e init_reverse_merge_iterator(struct merge_iterator_t *m, struct temperature_list_t *src1, struct temperature_list_t *src2);
+enum error_e merge_iterate(struct merge_iterator_t *m, struct temperature_sample_t *sample);
+enum error_e merge_without_decimation(struct temperature_list_t *src1, struct temperature_list_t *src2, struct temperature_list_t *dest);
+enum error_e merge_with_decimation(struct temperature_list_t *src1, struct temperature_list_t *src2, struct temperature_list_t *dest);
 enum error_e merge_temperature_lists(struct temperature_list_t *src1, struct temperature_list_t *src2, struct temperature_list_t *dest);
+enum error_e init_source_merge_iterator(struct merge_iterator_t *m, struct temperature_source_t *src1, struct temperature_source_t *src2);
+enum error_e merge_temperature_sources(struct temperature_source_t *src1, struct temperature_source_t *src2, struct temperature_list_t *dest);
+enum error_e decimation_sweep(struct temperature_source_t *src1, struct temperature_source_t *src2, struct temperature_list_t *dest, bool reverse, bool dry_run);
 #endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,72 @@
+#ifndef APP_TEMPERATURE_TIERS_H
+#define APP_TEMPERATURE_TIERS_H
+
+#include <stdint.h>
+#include "app/error.h"
+#include "app/temperature-logger.h"
+#include "app/temperature-history.h"
+
+#ifndef CONFIG_TEMPERATURE_LOGGER_TIER_BLOCK_COUNT
+// this is never used. im putting it there so that intellisense doesnt get confused
+#define CONFIG_TEMPERATURE_LOGGER_TIER_BLOCK_COUNT 4
+#endif
+
+/*
+ * Coarse history kept next to the raw segments. Every tier holds aggregates over
+ * fixed buckets of time. When the raw ring is full, its oldest segment is rolled
+ * up into the 5 minute tier. When a tier is full, its oldest block is rolled up into
+ * the next tier. The oldest block of the last tier is dropped.
+ *
+ * Each tier of each channel is a ring of CONFIG_TEMPERATURE_LOGGER_TIER_BLOCK_COUNT
+ * blocks. A block holds up to TEMPERATURE_TIER_BLOCK_SIZE aggregates and is one NVS
+ * record under NVS_KEY_TEMPERATURE_TIER_BASE.
+ */
+#define TEMPERATURE_TIER_BLOCK_SIZE 16
+#define TEMPERATURE_TIER_LENGTH (CONFIG_TEMPERATURE_LOGGER_TIER_BLOCK_COUNT * TEMPERATURE_TIER_BLOCK_SIZE)
+
+enum temperature_tier_e
+{
+    TEMPERATURE_TIER_5_MINUTES,
+    TEMPERATURE_TIER_1_HOUR,
+    TEMPERATURE_TIER_1_DAY,
+    TEMPERATURE_TIER_COUNT,
+};
+
+struct temperature_aggregate_t
+{
+    sys_minutes_t start; /* time at the start of the bucket. a multiple of the tier's period */
+    int32_t sum;         /* sum of all samples in the bucket */
+    uint32_t count;      /* number of samples in the bucket */
+    temperature_t min;
+    temperature_t max;
+};
+
+struct temperature_tier_index_t
+{
+    uint32_t oldest_block; /* sequence number of the oldest live block */
+    uint32_t block_count;  /* number of live blocks */
+};
+
+/*
+ * Streams the aggregates of one tier out of NVS, oldest first. Only one block is in memory at a time.
+ */
+struct temperature_tier_reader_t
+{
+    size_t channel;
+    enum temperature_tier_e tier;
+    struct temperature_tier_index_t index;
+    uint32_t block;   /* sequence number of the block in buffer */
+    size_t length;    /* number of aggregates in buffer */
+    size_t position;  /* index of the next aggregate in buffer */
+    struct temperature_aggregate_t buffer[TEMPERATURE_TIER_BLOCK_SIZE];
+};
+
+enum error_e init_temperature_tiers(void);
+sys_minutes_t get_temperature_tier_period(enum temperature_tier_e tier);
+temperature_t get_temperature_aggregate_mean(const struct temperature_aggregate_t *a);
+enum error_e roll_up_temperature_segment(size_t channel, struct temperature_segment_reader_t *reader);
+enum error_e open_temperature_tier(struct temperature_tier_reader_t *reader, size_t channel, enum temperature_tier_e tier);
+enum error_e read_temperature_tier(struct temperature_tier_reader_t *reader, struct temperature_aggregate_t *aggregate);
+enum error_e clear_temperature_tiers(size_t channel);
+
+#endif
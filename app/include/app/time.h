@@ -2,9 +2,40 @@
 #define APP_TIME_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "app/error.h"
+
+#ifndef CONFIG_TEMPERATURE_LOGGER_SNTP_SERVER
+// this is never used. im putting it there so that intellisense doesnt get confused
+#define CONFIG_TEMPERATURE_LOGGER_SNTP_SERVER "pool.ntp.org"
+#define CONFIG_TEMPERATURE_LOGGER_SNTP_INTERVAL 21600
+#endif
+
+/*
+ * Samples are timestamped in minutes since TIME_EPOCH_UNIX_SECONDS (2024-01-01 00:00 UTC).
+ * A recent epoch keeps the numbers small: the base time of every codec block is a varint
+ * of 3 bytes until 2^21 minutes (2027-12-27), and of 4 bytes after that until 2^28
+ * minutes (about 510 years). Tier buckets of a day start at midnight UTC.
+ *
+ * Until SNTP has set the clock, the time carries on from the newest timestamp in the
+ * history (see advance_time_in_minutes()). Either way, the time never goes backwards,
+ * not even across reboots, so the history and the RAM list always sort in time order.
+ */
+#define TIME_EPOCH_UNIX_SECONDS 1704067200LL
 
 typedef uint32_t sys_minutes_t;
+
 sys_minutes_t get_uptime_in_minutes();
+sys_minutes_t get_time_in_minutes(void);
+sys_minutes_t advance_time_in_minutes(sys_minutes_t minimum);
+enum error_e set_time_in_unix_seconds(int64_t seconds);
+bool time_is_synced(void);
+void init_time(void);
+
+static inline int64_t get_unix_seconds_of(sys_minutes_t time)
+{
+    return TIME_EPOCH_UNIX_SECONDS + (int64_t)time * 60;
+}
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,45 @@
+#ifndef APP_UPLINK_H
+#define APP_UPLINK_H
+
+#include <stdint.h>
+#include "app/error.h"
+
+#ifndef CONFIG_TEMPERATURE_LOGGER_UPLINK_HOST
+// this is never used. im putting it there so that intellisense doesnt get confused
+#define CONFIG_TEMPERATURE_LOGGER_UPLINK_HOST "192.168.1.2"
+#define CONFIG_TEMPERATURE_LOGGER_UPLINK_PORT 4950
+#define CONFIG_TEMPERATURE_LOGGER_UPLINK_INTERVAL 300
+#define CONFIG_TEMPERATURE_LOGGER_UPLINK_BATCH_SIZE 64
+#endif
+
+#define UPLINK_FRAME_VERSION 2
+
+/*
+ * Every datagram is one struct uplink_frame_header_t followed by 'count' samples packed
+ * with the sample codec (see app/sample-codec.h). All fields are little endian.
+ * The samples are the ones at positions [offset, offset + count) of history segment
+ * 'segment' of the channel, so the collector can drop duplicates.
+ * Since version 2, the sample times are minutes since TIME_EPOCH_UNIX_SECONDS (see app/time.h).
+ * Version 1 carried the uptime in minutes.
+ */
+struct uplink_frame_header_t
+{
+    uint8_t version;
+    uint8_t channel;
+    uint16_t count;
+    uint32_t segment;
+    uint16_t offset;
+    uint16_t reserved;
+};
+
+/* Position of the first sample of a channel that has not been sent yet. */
+struct uplink_cursor_t
+{
+    uint32_t segment; /* sequence number of a history segment, or of the segment the RAM list will become */
+    uint32_t offset;  /* number of samples of that segment already sent */
+};
+
+enum error_e init_uplink(void);
+void notify_uplink_sampling_round(void);
+
+#endif
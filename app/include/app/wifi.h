@@ -44,10 +44,15 @@ struct wifi_state_t
 void init_wifi(void);
 enum error_e set_wifi_logins(char *ssid, char *password);
 enum error_e enable_wifi_station(void);
+enum error_e start_wifi_station_from_config_settings(void);
 enum error_e disable_wifi_station(void);
 enum error_e enable_wifi_ap(void);
 enum error_e disable_wifi_ap(void);
 void get_wifi_state(struct wifi_state_t *w);
 enum error_e test_wifi_logins(enum logins_state_e *state);
+enum error_e wait_for_station_steady_state(k_timeout_t timeout);
+enum error_e subscribe_wifi_state(struct k_poll_signal *signal);
+void unsubscribe_wifi_state(struct k_poll_signal *signal);
+enum error_e set_wifi_power_saving(bool enabled);
 
 #endif
\ No newline at end of file
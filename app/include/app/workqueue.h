@@ -1,6 +1,15 @@
 #ifndef WORKQUEUE_H
 #define WORKQUEUE_H
 
+#include <zephyr/kernel.h>
+
+// high priority queue with a small stack for the sampling rounds. nothing on it may block on flash or the network
+extern struct k_work_q sampling_workqueue;
+
+// low priority queue with a large stack for slow work such as flash writes, compaction and the uplink
+extern struct k_work_q app_workqueue;
+
 void init_app_workqueue(void);
+void log_workqueue_stack_usage(void);
 
-#endif
\ No newline at end of file
+#endif
@@ -7,12 +7,21 @@
  *
  * Design Principles:
  * 1. Single Source of Truth: The configuration is stored in one global, 
- *    static structure: 'config_settings'.
- * 2. Thread Safety: Access to 'config_settings' is protected by 'config_settings_mutex' 
- *    to prevent "torn reads" and race conditions.
+ *    static structure: 'config_settings'. It holds two copies of the settings.
+ *    'generation' selects the active one and counts the stores.
+ * 2. Thread Safety: Readers never lock. They copy the active buffer and retry if
+ *    the generation changed while they copied, so a read is never torn and never
+ *    waits for flash. Writers are serialized by 'config_settings_mutex'. A writer
+ *    stages the settings in flash first, fills the inactive buffer and then
+ *    publishes it by incrementing the generation.
  * 3. Minimal Flash Access: Configuration is read from NVS once at boot (config_init) 
  *    and saved only when modified (store_config_settings), minimizing flash wear.
- * 4. Usage Contract: Callers are not given access to config_settings. Threads 
+ *    Every field has its own NVS record (see config_fields), so a store only
+ *    rewrites the fields that changed.
+ * 4. Versioned Schema: NVS_KEY_CONFIG_SCHEMA_VERSION holds the layout version of the
+ *    records. Older layouts are migrated at boot instead of being reset. Fields that
+ *    have no record yet keep their reset value, so adding a field needs no migration.
+ * 5. Usage Contract: Callers are not given access to config_settings. Threads 
  *    must create a local copy and use the following functions:
  *    - load_config_settings() for reading the active configuration (Safe Read).
  *    - store_config_settings() for validating and writing changes to RAM and Flash.
@@ -23,13 +32,74 @@
 
 #include <zephyr/kernel.h>
 #include <zephyr/fs/nvs.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/barrier.h>
+#include <zephyr/logging/log.h>
 #include "app/config-settings.h"
 #include "app/nvs.h"
 #include "app/string.h"
+#include "app/metrics.h"
 
-static struct config_settings_t config_settings = {0};
+LOG_MODULE_REGISTER(config_settings, LOG_LEVEL_WRN);
+
+/*
+ * Layout versions of the records in flash.
+ * 1: the whole struct config_settings_t in NVS_KEY_CONFIG_SETTINGS.
+ * 2: one record per field in NVS_KEY_CONFIG_FIELD_BASE + field.
+ */
+#define CONFIG_SCHEMA_VERSION_BLOB 1
+#define CONFIG_SCHEMA_VERSION 2
+
+/*
+ * Fields are stored as strings including their terminator. A field without a
+ * record has its reset value. The ids are part of the flash layout, so never
+ * reorder them. Append new fields at the end.
+ */
+enum config_field_e
+{
+    CONFIG_FIELD_WIFI_SSID,
+    CONFIG_FIELD_WIFI_PASSWORD,
+    CONFIG_FIELD_COUNT,
+};
+
+struct config_field_t
+{
+    size_t offset;
+    size_t size;
+};
+
+static const struct config_field_t config_fields[CONFIG_FIELD_COUNT] = {
+    [CONFIG_FIELD_WIFI_SSID] = {offsetof(struct config_settings_t, wifi_ssid), sizeof(((struct config_settings_t *)0)->wifi_ssid)},
+    [CONFIG_FIELD_WIFI_PASSWORD] = {offsetof(struct config_settings_t, wifi_password), sizeof(((struct config_settings_t *)0)->wifi_password)},
+};
+
+BUILD_ASSERT(NVS_KEY_CONFIG_FIELD_BASE + CONFIG_FIELD_COUNT <= NVS_KEY_CONFIG_FIELD_LAST + 1,
+             "Not enough NVS keys for the config fields.");
+
+struct config_settings_store_t
+{
+    struct config_settings_t buffers[2];
+    atomic_t generation; // buffers[generation & 1] is the active one
+};
+
+static struct config_settings_store_t config_settings = {0};
 static struct k_mutex config_settings_mutex = {0};
 
+/**
+ * @brief Makes 'c' the active config settings.
+ * The caller MUST hold config_settings_mutex.
+ * 
+ * @param c Pointer to the new config settings.
+ */
+static void publish_config_settings_without_locking(const struct config_settings_t *c)
+{
+    atomic_val_t generation = atomic_get(&config_settings.generation);
+    // readers only copy the active buffer. the inactive one is free until the increment
+    memcpy(&config_settings.buffers[(generation + 1) & 1], c, sizeof(struct config_settings_t));
+    barrier_dmem_fence_full();
+    atomic_inc(&config_settings.generation);
+}
+
 /**
  * @brief Validates the Wi-Fi SSID and Password fields against basic rules.
  * 
@@ -74,34 +144,159 @@ static bool validate_wifi_ssid_and_password(struct config_settings_t *c)
     return true;
 }
 
+static bool config_field_is_reset(const struct config_settings_t *c, enum config_field_e field)
+{
+    // both fields are strings whose reset value starts with 0xFF
+    return ((const uint8_t *)c)[config_fields[field].offset] == 0xFF;
+}
+
+/**
+ * @brief Reads one field from flash. The field keeps its reset value if it has no valid record.
+ * 
+ * @param c Pointer to the config settings that receive the field. Must be reset before.
+ * @param field The field to read.
+ * @return E_SUCCESS if the field was read or has no record. E_ERROR if the record is invalid.
+ */
+static enum error_e read_config_field(struct config_settings_t *c, enum config_field_e field)
+{
+    struct nvs_fs *fs = get_nvs_fs();
+    const struct config_field_t *f = &config_fields[field];
+    struct config_settings_t staged = {0};
+    uint8_t *value = (uint8_t *)&staged + f->offset;
+
+    ssize_t bytes_read = nvs_read(fs, NVS_KEY_CONFIG_FIELD_BASE + field, value, f->size);
+    if (bytes_read == -ENOENT)
+    {
+        return E_SUCCESS;
+    }
+    // a longer record comes from a firmware with a larger field. it would not fit
+    if (bytes_read <= 0 || (size_t)bytes_read > f->size || value[bytes_read - 1] != '\0')
+    {
+        LOG_WRN("Config field %d is invalid. Using its reset value.", field);
+        return E_ERROR;
+    }
+    memcpy((uint8_t *)c + f->offset, value, f->size);
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Writes one field to flash. A field with its reset value is deleted instead.
+ * 
+ * @param c Pointer to the config settings holding the field.
+ * @param field The field to write.
+ * @return E_SUCCESS or E_ERROR
+ */
+static enum error_e write_config_field(const struct config_settings_t *c, enum config_field_e field)
+{
+    const struct config_field_t *f = &config_fields[field];
+    if (config_field_is_reset(c, field))
+    {
+        int ret = delete_nvs(NVS_KEY_CONFIG_FIELD_BASE + field);
+        return ret == 0 || ret == -ENOENT ? E_SUCCESS : E_ERROR;
+    }
+    // the terminator is part of the record. that also keeps an empty password from being a zero length write, which deletes
+    size_t size = strnlen((const char *)c + f->offset, f->size - 1) + 1;
+    uint32_t start = begin_metrics_phase();
+    ssize_t bytes_written = write_nvs(NVS_KEY_CONFIG_FIELD_BASE + field, (const uint8_t *)c + f->offset, size);
+    end_metrics_phase(METRICS_PHASE_CONFIG_STORE, start);
+    return (size_t)bytes_written == size || bytes_written == 0 ? E_SUCCESS : E_ERROR;
+}
+
+/**
+ * @brief Moves the config settings in flash from an older layout to CONFIG_SCHEMA_VERSION.
+ * 
+ * @param version The layout version found in flash. 0 if flash holds no version record.
+ * @return E_SUCCESS or E_ERROR
+ */
+static enum error_e migrate_config_settings(uint16_t version)
+{
+    struct nvs_fs *fs = get_nvs_fs();
+    struct config_settings_t c;
+
+    if (version == 0 || version == CONFIG_SCHEMA_VERSION_BLOB)
+    {
+        // no version record means either a fresh flash or the single blob of the first firmware
+        ssize_t bytes_read = nvs_read(fs, NVS_KEY_CONFIG_SETTINGS, &c, sizeof(struct config_settings_t));
+        if (bytes_read == sizeof(struct config_settings_t))
+        {
+            LOG_INF("Migrating config settings from a single record to one record per field.");
+            for (size_t field = 0; field < CONFIG_FIELD_COUNT; field++)
+            {
+                if (write_config_field(&c, field) != E_SUCCESS)
+                {
+                    // the blob is still there. the migration runs again on the next boot
+                    return E_ERROR;
+                }
+            }
+        }
+        else if (bytes_read != -ENOENT)
+        {
+            LOG_WRN("Legacy config settings are invalid. They are dropped.");
+        }
+    }
+
+    uint16_t current = CONFIG_SCHEMA_VERSION;
+    ssize_t bytes_written = write_nvs(NVS_KEY_CONFIG_SCHEMA_VERSION, &current, sizeof(current));
+    if (bytes_written != sizeof(current) && bytes_written != 0)
+    {
+        return E_ERROR;
+    }
+    delete_nvs(NVS_KEY_CONFIG_SETTINGS);
+    return E_SUCCESS;
+}
+
 /**
  * @brief Loads the config settings from flash into the main config settings.
+ * Migrates them first if flash holds an older layout.
  * 
  * @return E_SUCCESS or E_ERROR
  */
 static enum error_e load_main_config_settings(void)
 {
     struct nvs_fs *fs = get_nvs_fs();
-    enum error_e err;
+    enum error_e err = E_SUCCESS;
+    struct config_settings_t c;
 
     k_mutex_lock(&config_settings_mutex, K_FOREVER);
-    // try to read config settings
-    ssize_t bytes_read = nvs_read(fs, NVS_KEY_CONFIG_SETTINGS, &config_settings, sizeof(struct config_settings_t));
-    if (bytes_read == -ENOENT)
+    uint16_t version = 0;
+    ssize_t bytes_read = nvs_read(fs, NVS_KEY_CONFIG_SCHEMA_VERSION, &version, sizeof(version));
+    if (bytes_read != sizeof(version))
+    {
+        version = 0;
+    }
+    if (version > CONFIG_SCHEMA_VERSION)
     {
-        // key does not exist. create config settings
-        reset_config_settings(&config_settings);
-        nvs_write(fs, NVS_KEY_CONFIG_SETTINGS, &config_settings, sizeof(struct config_settings_t));
-        err = E_SUCCESS;
+        // written by a newer firmware. fields are never reordered, so the known ones can still be read
+        LOG_WRN("Config settings have schema version %u. This firmware knows %u.", version, CONFIG_SCHEMA_VERSION);
     }
-    else if (bytes_read != sizeof(struct config_settings_t))
+    else if (version < CONFIG_SCHEMA_VERSION)
     {
-        // for some reason, the read failed
-        reset_config_settings(&config_settings);
+        err = migrate_config_settings(version);
+    }
+
+    reset_config_settings(&c);
+    if (err != E_SUCCESS)
+    {
+        // the fields may be half migrated. fall back to the legacy record until the next boot retries
+        nvs_read(fs, NVS_KEY_CONFIG_SETTINGS, &c, sizeof(struct config_settings_t));
+    }
+    else
+    {
+        for (size_t field = 0; field < CONFIG_FIELD_COUNT; field++)
+        {
+            if (read_config_field(&c, field) != E_SUCCESS)
+            {
+                err = E_ERROR;
+            }
+        }
+    }
+    if (!validate_wifi_ssid_and_password(&c))
+    {
+        // e.g. only one of the logins was stored
+        reset_config_settings(&c);
         err = E_ERROR;
-    } else {
-        err = E_SUCCESS;
     }
+    publish_config_settings_without_locking(&c);
 
     k_mutex_unlock(&config_settings_mutex);
     return err;
@@ -140,6 +335,7 @@ void reset_config_settings(struct config_settings_t *c)
 
 /**
  * @brief Copies the main config settings to the provided config settings.
+ * Never blocks, not even while a store is writing to flash.
  * 
  * @param c Pointer to the config settings struct.
  */
@@ -149,9 +345,14 @@ void load_config_settings(struct config_settings_t *c)
     {
         return;
     }
-    k_mutex_lock(&config_settings_mutex, K_FOREVER);
-    memcpy(c, &config_settings, sizeof(struct config_settings_t));
-    k_mutex_unlock(&config_settings_mutex);
+    atomic_val_t generation;
+    do
+    {
+        generation = atomic_get(&config_settings.generation);
+        memcpy(c, &config_settings.buffers[generation & 1], sizeof(struct config_settings_t));
+        barrier_dmem_fence_full();
+        // a changed generation means a writer may have refilled the buffer while it was copied
+    } while (atomic_get(&config_settings.generation) != generation);
 }
 
 /**
@@ -175,14 +376,68 @@ enum error_e store_config_settings(struct config_settings_t *c)
     {
         return E_INVAL;
     }
-    struct nvs_fs *fs = get_nvs_fs();
+    // only other writers wait here. readers keep using the active buffer until the publish
     k_mutex_lock(&config_settings_mutex, K_FOREVER);
-    ssize_t bytes_written = nvs_write(fs, NVS_KEY_CONFIG_SETTINGS, c, sizeof(struct config_settings_t));
-    enum error_e err = bytes_written == sizeof(struct config_settings_t) || bytes_written == 0 ? E_SUCCESS : E_ERROR;
+    const struct config_settings_t *active = &config_settings.buffers[atomic_get(&config_settings.generation) & 1];
+    enum error_e err = E_SUCCESS;
+    for (size_t field = 0; field < CONFIG_FIELD_COUNT && err == E_SUCCESS; field++)
+    {
+        const struct config_field_t *f = &config_fields[field];
+        // only changed fields are written
+        if (memcmp((const uint8_t *)c + f->offset, (const uint8_t *)active + f->offset, f->size) != 0)
+        {
+            err = write_config_field(c, field);
+        }
+    }
     if (err == E_SUCCESS)
     {
-        memcpy(&config_settings, c, sizeof(struct config_settings_t));
+        publish_config_settings_without_locking(c);
     }
     k_mutex_unlock(&config_settings_mutex);
     return err;
 }
+
+/**
+ * @brief Loads the cached AP of the last successful station connect from NVS.
+ * It is stored in its own record next to the config settings, so it can be
+ * rewritten whenever the AP changes without touching the logins.
+ * 
+ * @param f Pointer to the struct that receives the cache. Cleared if nothing is cached.
+ * @return E_NULL_PTR if f is NULL.
+ * @return E_NOENT if nothing is cached.
+ * @return E_ERROR if the record is invalid.
+ * @return E_SUCCESS if the cache was loaded.
+ */
+enum error_e load_wifi_fast_connect(struct wifi_fast_connect_t *f)
+{
+    if (f == NULL)
+    {
+        return E_NULL_PTR;
+    }
+    struct nvs_fs *fs = get_nvs_fs();
+    ssize_t bytes_read = nvs_read(fs, NVS_KEY_WIFI_FAST_CONNECT, f, sizeof(struct wifi_fast_connect_t));
+    if (bytes_read == sizeof(struct wifi_fast_connect_t))
+    {
+        return E_SUCCESS;
+    }
+    memset(f, 0, sizeof(struct wifi_fast_connect_t));
+    return bytes_read == -ENOENT ? E_NOENT : E_ERROR;
+}
+
+/**
+ * @brief Stores the cached AP of the last successful station connect in NVS.
+ * 
+ * @param f Pointer to the cache.
+ * @return E_NULL_PTR if f is NULL.
+ * @return E_SUCCESS if store was successful.
+ * @return E_ERROR if an error occured.
+ */
+enum error_e store_wifi_fast_connect(const struct wifi_fast_connect_t *f)
+{
+    if (f == NULL)
+    {
+        return E_NULL_PTR;
+    }
+    ssize_t bytes_written = write_nvs(NVS_KEY_WIFI_FAST_CONNECT, f, sizeof(struct wifi_fast_connect_t));
+    return bytes_written == sizeof(struct wifi_fast_connect_t) || bytes_written == 0 ? E_SUCCESS : E_ERROR;
+}
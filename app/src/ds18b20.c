@@ -0,0 +1,323 @@
+/*
+ * DS18B20 Module
+ * -----------------------------------------------------------------------------
+ * Talks to the DS18B20 directly over the 1-Wire API so that a conversion can
+ * run without blocking a thread.
+ *
+ * The Zephyr sensor driver sleeps inside sensor_sample_fetch() for the whole
+ * conversion (750 ms at 12 bits). Here a reading is split in two:
+ * 1. start_ds18b20_conversion() sends Convert T and returns immediately.
+ * 2. After get_ds18b20_conversion_time(), read_ds18b20_temperature() reads
+ *    the scratchpad.
+ * The caller is expected to schedule step 2 as delayed work.
+ *
+ * Several sensors can share the bus. init_ds18b20() runs a ROM search and
+ * gives every sensor found a channel number, up to
+ * CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT. Channels follow the search order,
+ * which only depends on the ROM IDs, so they stay the same across boots as
+ * long as the same sensors are connected.
+ *
+ * Convert T is sent once with Skip ROM, so all sensors convert in parallel in
+ * the same window. Each scratchpad is then read with Match ROM.
+ * The raw reading is in 1/16 degree steps, which is exactly temperature_t.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/w1.h>
+#include <zephyr/logging/log.h>
+#include "app/ds18b20.h"
+
+LOG_MODULE_REGISTER(ds18b20, LOG_LEVEL_DBG);
+
+#define DS18B20_CMD_CONVERT_T 0x44
+#define DS18B20_CMD_WRITE_SCRATCHPAD 0x4E
+#define DS18B20_CMD_READ_SCRATCHPAD 0xBE
+#define DS18B20_SCRATCHPAD_SIZE 9
+#define DS18B20_SCRATCHPAD_TEMPERATURE_LSB 0
+#define DS18B20_SCRATCHPAD_TEMPERATURE_MSB 1
+#define DS18B20_SCRATCHPAD_TH 2
+#define DS18B20_SCRATCHPAD_TL 3
+#define DS18B20_SCRATCHPAD_CONFIG 4
+#define DS18B20_SCRATCHPAD_CRC 8
+#define DS18B20_MAX_CONVERSION_TIME_MS 750 /* at 12 bits. halves with every bit less */
+
+#define DS18B20_RESOLUTION_SHIFT (12 - CONFIG_TEMPERATURE_LOGGER_DS18B20_RESOLUTION)
+#define DS18B20_CONFIG_VALUE ((uint8_t)(((CONFIG_TEMPERATURE_LOGGER_DS18B20_RESOLUTION - 9) << 5) | 0x1F))
+
+#if DT_HAS_COMPAT_STATUS_OKAY(maxim_ds18b20)
+
+#define DS18B20_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(maxim_ds18b20)
+
+#define DS18B20_FAMILY_CODE DT_PROP_OR(DS18B20_NODE, family_code, 0x28)
+
+static const struct device *const w1_bus = DEVICE_DT_GET(DT_BUS(DS18B20_NODE));
+
+struct ds18b20_data_t
+{
+    struct w1_rom roms[CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT]; /* indexed by channel */
+    size_t count;                                                /* number of sensors found */
+    size_t ignored;                                              /* sensors found after all channels were taken */
+};
+
+static struct ds18b20_data_t d_data;
+
+/**
+ * @brief Resets the bus and addresses one sensor, or all of them if 'rom' is NULL.
+ * The caller MUST hold the bus lock.
+ */
+static enum error_e select_ds18b20(const struct w1_rom *rom)
+{
+    int result = w1_reset_bus(w1_bus);
+    if (result < 0)
+    {
+        LOG_ERR("Failed to reset 1-Wire bus. Error %d.", result);
+        return E_IO;
+    }
+    if (result == 0)
+    {
+        LOG_ERR("No device answered on the 1-Wire bus.");
+        return E_NODEV;
+    }
+    if (rom == NULL)
+    {
+        result = w1_write_byte(w1_bus, W1_CMD_SKIP_ROM);
+    }
+    else
+    {
+        result = w1_write_byte(w1_bus, W1_CMD_MATCH_ROM);
+        if (result == 0)
+        {
+            result = w1_write_block(w1_bus, (const uint8_t *)rom, sizeof(struct w1_rom));
+        }
+    }
+    if (result < 0)
+    {
+        LOG_ERR("Failed to address DS18B20. Error %d.", result);
+        return E_IO;
+    }
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Reads and checks the scratchpad. The caller MUST hold the bus lock.
+ */
+static enum error_e read_scratchpad(const struct w1_rom *rom, uint8_t *scratchpad)
+{
+    enum error_e err = select_ds18b20(rom);
+    if (err != E_SUCCESS)
+    {
+        return err;
+    }
+    int result = w1_write_byte(w1_bus, DS18B20_CMD_READ_SCRATCHPAD);
+    if (result == 0)
+    {
+        result = w1_read_block(w1_bus, scratchpad, DS18B20_SCRATCHPAD_SIZE);
+    }
+    if (result < 0)
+    {
+        LOG_ERR("Failed to read DS18B20 scratchpad. Error %d.", result);
+        return E_IO;
+    }
+    if (w1_crc8(scratchpad, DS18B20_SCRATCHPAD_SIZE - 1) != scratchpad[DS18B20_SCRATCHPAD_CRC])
+    {
+        LOG_ERR("DS18B20 scratchpad failed the CRC check.");
+        return E_IO;
+    }
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Search callback. Gives the next free channel to every DS18B20 found.
+ */
+static void add_ds18b20(struct w1_rom rom, void *user_data)
+{
+    if (rom.family != DS18B20_FAMILY_CODE)
+    {
+        return;
+    }
+    if (d_data.count == CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        d_data.ignored++;
+        return;
+    }
+    d_data.roms[d_data.count++] = rom;
+}
+
+/**
+ * @brief Sets the resolution of one sensor. The caller MUST hold the bus lock.
+ * * The resolution is only written to the scratchpad, not to the sensor's EEPROM.
+ */
+static enum error_e configure_ds18b20(const struct w1_rom *rom)
+{
+    uint8_t scratchpad[DS18B20_SCRATCHPAD_SIZE];
+    enum error_e err = read_scratchpad(rom, scratchpad);
+    if (err != E_SUCCESS || scratchpad[DS18B20_SCRATCHPAD_CONFIG] == DS18B20_CONFIG_VALUE)
+    {
+        return err;
+    }
+    err = select_ds18b20(rom);
+    if (err != E_SUCCESS)
+    {
+        return err;
+    }
+    // TH and TL are kept as they are
+    uint8_t command[] = {DS18B20_CMD_WRITE_SCRATCHPAD, scratchpad[DS18B20_SCRATCHPAD_TH], scratchpad[DS18B20_SCRATCHPAD_TL], DS18B20_CONFIG_VALUE};
+    if (w1_write_block(w1_bus, command, sizeof(command)) < 0)
+    {
+        LOG_ERR("Failed to set DS18B20 resolution.");
+        return E_IO;
+    }
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Finds the sensors on the bus and sets their resolution.
+ * * The resolution is CONFIG_TEMPERATURE_LOGGER_DS18B20_RESOLUTION. It is not persisted
+ * by the sensors, so this runs again on every boot.
+ * * @retval E_SUCCESS At least one sensor found and all sensors found were configured.
+ * @retval E_NODEV The bus is not ready or no sensor answered.
+ * @retval E_IO 1-Wire communication failed.
+ */
+enum error_e init_ds18b20(void)
+{
+    if (!device_is_ready(w1_bus))
+    {
+        LOG_ERR("1-Wire bus is not ready.");
+        return E_NODEV;
+    }
+
+    enum error_e err = E_SUCCESS;
+    w1_lock_bus(w1_bus);
+    d_data.count = 0;
+    d_data.ignored = 0;
+    int result = w1_search_rom(w1_bus, add_ds18b20, NULL);
+    if (result < 0)
+    {
+        LOG_ERR("1-Wire ROM search failed. Error %d.", result);
+        err = E_IO;
+        goto unlock;
+    }
+    if (d_data.count == 0)
+    {
+        LOG_ERR("No DS18B20 found on the 1-Wire bus.");
+        err = E_NODEV;
+        goto unlock;
+    }
+    if (d_data.ignored > 0)
+    {
+        LOG_WRN("Found %d more DS18B20 than there are channels. They are ignored.", (int)d_data.ignored);
+    }
+    for (size_t channel = 0; channel < d_data.count; channel++)
+    {
+        err = configure_ds18b20(&d_data.roms[channel]);
+        if (err != E_SUCCESS)
+        {
+            goto unlock;
+        }
+        uint64_t id = w1_rom_to_uint64(&d_data.roms[channel]);
+        LOG_INF("DS18B20 %08x%08x is channel %d.", (uint32_t)(id >> 32), (uint32_t)id, (int)channel);
+    }
+unlock:
+    w1_unlock_bus(w1_bus);
+    return err;
+}
+
+/**
+ * @brief Returns the number of sensors found by init_ds18b20(). Channels are numbered from 0.
+ */
+size_t get_ds18b20_count(void)
+{
+    return d_data.count;
+}
+
+/**
+ * @brief Tells all sensors to start a conversion and returns without waiting for them.
+ * * @retval E_SUCCESS Conversion started. Read it after get_ds18b20_conversion_time().
+ * @retval E_NODEV No sensor answered.
+ * @retval E_IO 1-Wire communication failed.
+ */
+enum error_e start_ds18b20_conversion(void)
+{
+    w1_lock_bus(w1_bus);
+    enum error_e err = select_ds18b20(NULL);
+    if (err == E_SUCCESS && w1_write_byte(w1_bus, DS18B20_CMD_CONVERT_T) < 0)
+    {
+        LOG_ERR("Failed to start DS18B20 conversion.");
+        err = E_IO;
+    }
+    w1_unlock_bus(w1_bus);
+    return err;
+}
+
+/**
+ * @brief Reads the result of the last conversion of one sensor.
+ * * Bits below the configured resolution are undefined and are cleared.
+ * * @param channel Channel of the sensor. MUST be less than get_ds18b20_count().
+ * @param temperature Pointer to the variable that receives the temperature.
+ * @retval E_SUCCESS Temperature read.
+ * @retval E_RANGE There is no sensor on this channel.
+ * @retval E_NODEV No sensor answered.
+ * @retval E_IO 1-Wire communication failed or the CRC check failed.
+ * @retval E_NULL_PTR If 'temperature' is NULL.
+ */
+enum error_e read_ds18b20_temperature(size_t channel, temperature_t *temperature)
+{
+    if (temperature == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (channel >= d_data.count)
+    {
+        return E_RANGE;
+    }
+
+    uint8_t scratchpad[DS18B20_SCRATCHPAD_SIZE];
+    w1_lock_bus(w1_bus);
+    enum error_e err = read_scratchpad(&d_data.roms[channel], scratchpad);
+    w1_unlock_bus(w1_bus);
+    if (err != E_SUCCESS)
+    {
+        return err;
+    }
+    int16_t raw = (int16_t)((scratchpad[DS18B20_SCRATCHPAD_TEMPERATURE_MSB] << 8) | scratchpad[DS18B20_SCRATCHPAD_TEMPERATURE_LSB]);
+    *temperature = (temperature_t)(raw & ~((1 << DS18B20_RESOLUTION_SHIFT) - 1));
+    return E_SUCCESS;
+}
+
+#else
+
+// there is no sensor in the devicetree (e.g. test apps)
+
+enum error_e init_ds18b20(void)
+{
+    LOG_ERR("DS18B20 device was not found.");
+    return E_NODEV;
+}
+
+size_t get_ds18b20_count(void)
+{
+    return 0;
+}
+
+enum error_e start_ds18b20_conversion(void)
+{
+    return E_NODEV;
+}
+
+enum error_e read_ds18b20_temperature(size_t channel, temperature_t *temperature)
+{
+    return E_NODEV;
+}
+
+#endif
+
+/**
+ * @brief Returns the worst case conversion time for the configured resolution.
+ */
+k_timeout_t get_ds18b20_conversion_time(void)
+{
+    return K_MSEC(DIV_ROUND_UP(DS18B20_MAX_CONVERSION_TIME_MS, 1 << DS18B20_RESOLUTION_SHIFT));
+}
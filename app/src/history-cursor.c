@@ -0,0 +1,335 @@
+/*
+ * History Cursor Module
+ * -----------------------------------------------------------------------------
+ * Pages through the raw history of one channel: the segments in NVS, oldest first,
+ * then the RAM list. The HTTP export, the uplink and the shell all read the history
+ * through a cursor.
+ *
+ * Segments are streamed with the cursor's own segment reader, so reading them takes
+ * no lock at all. The RAM list is copied out under its lock one batch at a time, so a
+ * long export never holds up the compaction worker for more than one batch.
+ *
+ * The segments and the RAM list never overlap in time, so they are read one after
+ * the other and nothing has to be merged.
+ *
+ * The "history show" shell command prints the raw history of a channel through a cursor.
+ *
+ * The history moves on while a cursor reads it:
+ * - A flush turns the RAM list into the next segment at the same positions. A batch
+ *   copied while the list was flushed is thrown away and read again from the segment.
+ * - Segments that are rolled up or compacted before the cursor got to them are gone.
+ *   The cursor skips to the oldest live segment, which may return a few samples again.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "app/history-cursor.h"
+
+#ifdef CONFIG_SHELL
+#include <stdlib.h>
+#include <zephyr/shell/shell.h>
+
+#define HISTORY_SHELL_BATCH_SIZE 16
+#endif
+
+LOG_MODULE_REGISTER(history_cursor, LOG_LEVEL_DBG);
+
+static uint32_t get_list_segment(const struct temperature_history_index_t *index)
+{
+    return index->oldest_segment + index->segment_count;
+}
+
+/**
+ * @brief Opens a cursor at the first sample of a channel at or after 'start_time'.
+ * * Segments that end before 'start_time' are skipped by their first block, without reading their samples.
+ * * @param cursor Pointer to the cursor.
+ * @param channel The channel to read.
+ * @param start_time Time of the first sample to return. 0 for the whole history.
+ * @param final_only Leave out the newest sample of the RAM list while ingest compression may still replace it.
+ * @retval E_SUCCESS Cursor opened.
+ * @retval E_RANGE The channel does not exist.
+ * @retval E_NULL_PTR If 'cursor' is NULL.
+ */
+enum error_e open_history_cursor(struct history_cursor_t *cursor, size_t channel, sys_minutes_t start_time, bool final_only)
+{
+    struct temperature_history_index_t index;
+    if (cursor == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        return E_RANGE;
+    }
+    get_temperature_history_index(channel, &index);
+    enum error_e err = open_history_cursor_at(cursor, channel, index.oldest_segment, 0, final_only);
+    cursor->start_time = start_time;
+    return err;
+}
+
+/**
+ * @brief Opens a cursor at a position returned by an earlier cursor, like a stored uplink cursor.
+ * * A position that is no longer in the history is moved to the oldest live segment by the first read.
+ * * @param segment Sequence number of the segment, or of the segment the RAM list will become.
+ * @param offset Number of samples of that segment to skip.
+ * @retval E_SUCCESS Cursor opened.
+ * @retval E_RANGE The channel does not exist.
+ * @retval E_NULL_PTR If 'cursor' is NULL.
+ */
+enum error_e open_history_cursor_at(struct history_cursor_t *cursor, size_t channel, uint32_t segment, uint32_t offset, bool final_only)
+{
+    if (cursor == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        return E_RANGE;
+    }
+    cursor->channel = channel;
+    cursor->start_time = 0;
+    cursor->final_only = final_only;
+    cursor->segment = segment;
+    cursor->offset = offset;
+    cursor->reader_open = false;
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Moves the cursor to the next segment.
+ */
+static void advance_history_cursor(struct history_cursor_t *cursor)
+{
+    cursor->segment++;
+    cursor->offset = 0;
+    cursor->reader_open = false;
+}
+
+/**
+ * @brief Checks whether the segment of the cursor is still live. Moves the cursor to the oldest live segment if it is not.
+ * * @return true if the cursor was moved.
+ */
+static bool clamp_history_cursor(struct history_cursor_t *cursor, const struct temperature_history_index_t *index)
+{
+    if (cursor->segment >= index->oldest_segment && cursor->segment <= get_list_segment(index))
+    {
+        return false;
+    }
+    LOG_WRN("History cursor of channel %d fell behind the history. Skipping to segment %u.", (int)cursor->channel, index->oldest_segment);
+    cursor->segment = index->oldest_segment;
+    cursor->offset = 0;
+    cursor->reader_open = false;
+    return true;
+}
+
+/**
+ * @brief Reads the next batch from the RAM list.
+ * * @param copied Pointer that receives the number of samples the cursor moved by, including the ones before the start time.
+ * @param count Pointer that receives the number of samples returned.
+ * @return true if the batch is valid. false if the list was flushed while it was copied.
+ */
+static bool read_history_cursor_list(struct history_cursor_t *cursor, uint32_t list_segment, struct temperature_sample_t *samples,
+                                     size_t capacity, size_t *copied, size_t *count)
+{
+    copy_temperature_list_samples(cursor->channel, cursor->offset, cursor->final_only, samples, capacity, copied);
+    struct temperature_history_index_t after;
+    get_temperature_history_index(cursor->channel, &after);
+    if (get_list_segment(&after) != list_segment)
+    {
+        return false;
+    }
+    // the list is sorted, so the samples before the start time all come first
+    size_t skipped = 0;
+    while (skipped < *copied && samples[skipped].uptime < cursor->start_time)
+    {
+        skipped++;
+    }
+    memmove(samples, &samples[skipped], sizeof(struct temperature_sample_t) * (*copied - skipped));
+    cursor->offset += *copied;
+    *count = *copied - skipped;
+    return true;
+}
+
+/**
+ * @brief Opens the segment of the cursor and skips to its offset.
+ * * @retval E_SUCCESS The reader is open.
+ * @retval E_NOENT The segment is gone.
+ * @retval E_ERROR The segment could not be read.
+ */
+static enum error_e open_history_cursor_segment(struct history_cursor_t *cursor)
+{
+    enum error_e err = open_temperature_segment(&cursor->reader, cursor->channel, cursor->segment);
+    if (err != E_SUCCESS)
+    {
+        return err == E_NOENT ? E_NOENT : E_ERROR;
+    }
+    for (uint32_t i = 0; i < cursor->offset && err == E_SUCCESS; i++)
+    {
+        err = read_temperature_segment(&cursor->reader, NULL);
+    }
+    if (err != E_SUCCESS && err != E_END_OF_ITER)
+    {
+        return E_ERROR;
+    }
+    cursor->reader_open = true;
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Reads the next batch of samples, in time order.
+ * * Segments that have been read completely are skipped, so the cursor may move even if nothing is returned.
+ * * @param cursor Pointer to an opened cursor.
+ * @param samples Array that receives the samples.
+ * @param capacity Number of elements in 'samples'.
+ * @param count Pointer that receives the number of samples read. 0 once everything has been read.
+ * @retval E_SUCCESS Batch read. A later read may return more once new samples arrive.
+ * @retval E_ERROR A history segment could not be read.
+ * @retval E_NULL_PTR If any pointer is NULL.
+ */
+enum error_e read_history_cursor(struct history_cursor_t *cursor, struct temperature_sample_t *samples, size_t capacity, size_t *count)
+{
+    if (cursor == NULL || samples == NULL || count == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    *count = 0;
+    bool reopened = false;
+    while (true)
+    {
+        struct temperature_history_index_t index;
+        get_temperature_history_index(cursor->channel, &index);
+        clamp_history_cursor(cursor, &index);
+        uint32_t list_segment = get_list_segment(&index);
+
+        if (cursor->segment == list_segment)
+        {
+            size_t copied;
+            cursor->reader_open = false;
+            if (!read_history_cursor_list(cursor, list_segment, samples, capacity, &copied, count))
+            {
+                // the list was flushed while we copied it. read it back from its segment instead
+                continue;
+            }
+            if (*count > 0 || copied == 0)
+            {
+                return E_SUCCESS;
+            }
+            // only samples before the start time so far
+            continue;
+        }
+
+        enum error_e err = E_SUCCESS;
+        if (!cursor->reader_open)
+        {
+            err = open_history_cursor_segment(cursor);
+            if (err == E_NOENT)
+            {
+                // dropped since we read the index. the next round skips past it
+                get_temperature_history_index(cursor->channel, &index);
+                if (!clamp_history_cursor(cursor, &index))
+                {
+                    return E_ERROR;
+                }
+                continue;
+            }
+            if (err != E_SUCCESS)
+            {
+                return E_ERROR;
+            }
+            if (cursor->reader.last_uptime < cursor->start_time)
+            {
+                advance_history_cursor(cursor);
+                continue;
+            }
+        }
+
+        struct temperature_sample_t sample;
+        uint32_t read = 0;
+        while (*count < capacity && (err = read_temperature_segment(&cursor->reader, &sample)) == E_SUCCESS)
+        {
+            read++;
+            cursor->offset++;
+            if (sample.uptime >= cursor->start_time)
+            {
+                samples[(*count)++] = sample;
+            }
+        }
+        if (err != E_SUCCESS && err != E_END_OF_ITER)
+        {
+            // the segment was dropped or compacted under the reader. start over from the index, once
+            get_temperature_history_index(cursor->channel, &index);
+            if (!clamp_history_cursor(cursor, &index))
+            {
+                if (reopened)
+                {
+                    return E_ERROR;
+                }
+                cursor->offset -= read;
+                cursor->reader_open = false;
+            }
+            *count = 0;
+            reopened = true;
+            continue;
+        }
+        if (*count > 0)
+        {
+            return E_SUCCESS;
+        }
+        advance_history_cursor(cursor);
+    }
+}
+
+#ifdef CONFIG_SHELL
+// the shell runs one command at a time. the reader is too big for the shell stack
+static struct history_cursor_t shell_cursor;
+
+static int cmd_history_show(const struct shell *sh, size_t argc, char **argv)
+{
+    char *end;
+    unsigned long channel = strtoul(argv[1], &end, 10);
+    if (*end != '\0' || open_history_cursor(&shell_cursor, channel, 0, false) != E_SUCCESS)
+    {
+        shell_error(sh, "Invalid channel: %s", argv[1]);
+        return -EINVAL;
+    }
+    if (argc > 2)
+    {
+        shell_cursor.start_time = (sys_minutes_t)strtoul(argv[2], &end, 10);
+        if (*end != '\0')
+        {
+            shell_error(sh, "Invalid start time: %s", argv[2]);
+            return -EINVAL;
+        }
+    }
+
+    struct temperature_sample_t samples[HISTORY_SHELL_BATCH_SIZE];
+    size_t count;
+    size_t total = 0;
+    enum error_e err;
+    while ((err = read_history_cursor(&shell_cursor, samples, ARRAY_SIZE(samples), &count)) == E_SUCCESS && count > 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            shell_print(sh, "%u %d", samples[i].uptime, samples[i].temperature);
+        }
+        total += count;
+    }
+    if (err != E_SUCCESS)
+    {
+        shell_error(sh, "Failed to read the history. Error %d.", err);
+        return -EIO;
+    }
+    shell_print(sh, "%u samples", (unsigned int)total);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(history_commands,
+                               SHELL_CMD_ARG(show, NULL, "Print the raw samples of a channel, oldest first, as \"<time> <1/16 degrees C>\".\n"
+                                                         "Usage: show <channel> [<start time in minutes>]", cmd_history_show, 2, 1),
+                               SHELL_SUBCMD_SET_END);
+SHELL_CMD_REGISTER(history, &history_commands, "Logged history", NULL);
+#endif
@@ -0,0 +1,454 @@
+/*
+ * HTTP Export Module
+ * -----------------------------------------------------------------------------
+ * Serves the logged history of one channel over HTTP, on the AP and the station
+ * interface alike:
+ *
+ *   GET /history.bin?channel=N&start=T   sample codec stream, oldest first (see app/sample-codec.h)
+ *   GET /history.csv?channel=N&start=T   "time,temperature" lines, oldest first.
+ *                                        Unix time in seconds, temperature in degrees C
+ *
+ * The binary stream carries the timestamps as they are stored, in minutes since
+ * TIME_EPOCH_UNIX_SECONDS (see app/time.h).
+ *   GET /metrics                 hot path timings and boot milestones, one per line (see app/metrics.h)
+ *
+ * channel defaults to 0. start is a Unix time in seconds and leaves out the samples
+ * before it. It defaults to the whole history. The history tiers are not exported,
+ * only raw samples.
+ *
+ * The size of the body is not known until the history has been read, so responses
+ * use chunked transfer encoding and the body is never built in memory. The history
+ * is read through a history cursor (see app/history-cursor.h), one block of samples
+ * at a time, and every block becomes one chunk. The cursor only locks the RAM list
+ * while it copies one block, so a slow client does not hold up the logger.
+ * Every block of the codec decodes on its own, so the binary body is simply the
+ * concatenation of all blocks. CSV is formatted one block at a time into the same buffer.
+ *
+ * A download costs one history cursor, one block of samples and one chunk buffer,
+ * all static. Only one client is served at a time. If the history can't be read
+ * halfway through, the connection is closed without the last chunk, so the client
+ * sees a truncated body instead of a short but complete one.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/logging/log.h>
+#include "app/http-export.h"
+#include "app/temperature-logger.h"
+#include "app/history-cursor.h"
+#include "app/sample-codec.h"
+#include "app/metrics.h"
+#include "app/time.h"
+
+LOG_MODULE_REGISTER(http_export, LOG_LEVEL_DBG);
+
+#define HTTP_EXPORT_STACK_SIZE 3072
+#define HTTP_EXPORT_PRIORITY 7
+#define HTTP_EXPORT_RECEIVE_TIMEOUT_SECONDS 5
+#define HTTP_EXPORT_REQUEST_MAX_SIZE 512
+#define HTTP_EXPORT_CSV_LINE_MAX_SIZE 26 /* "259402104900,-2048.0000\n" */
+#define HTTP_EXPORT_CHUNK_BUFFER_SIZE MAX(SAMPLE_CODEC_MAX_ENCODED_SIZE(SAMPLE_CODEC_BLOCK_SIZE), \
+                                          SAMPLE_CODEC_BLOCK_SIZE * HTTP_EXPORT_CSV_LINE_MAX_SIZE)
+
+enum export_format_e
+{
+    EXPORT_FORMAT_BINARY,
+    EXPORT_FORMAT_CSV,
+};
+
+enum query_parameter_e
+{
+    QUERY_PARAMETER_CHANNEL,
+    QUERY_PARAMETER_START,
+    QUERY_PARAMETER_COUNT,
+};
+
+static const char *const query_parameter_names[QUERY_PARAMETER_COUNT] = {
+    [QUERY_PARAMETER_CHANNEL] = "channel",
+    [QUERY_PARAMETER_START] = "start",
+};
+
+struct http_export_data_t
+{
+    char request[HTTP_EXPORT_REQUEST_MAX_SIZE + 1];
+    struct history_cursor_t cursor;
+    struct temperature_sample_t samples[SAMPLE_CODEC_BLOCK_SIZE];
+    uint8_t chunk[HTTP_EXPORT_CHUNK_BUFFER_SIZE];
+    size_t chunk_size; /* number of bytes in chunk */
+    struct k_thread thread;
+};
+
+K_THREAD_STACK_DEFINE(http_export_stack, HTTP_EXPORT_STACK_SIZE);
+
+// only the export thread touches this
+static struct http_export_data_t e_data;
+
+/**
+ * @brief Sends the whole buffer, however many calls it takes.
+ * * @retval E_SUCCESS All bytes sent.
+ * @retval E_IO The connection failed.
+ */
+static enum error_e send_all(int sock, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    while (size > 0)
+    {
+        ssize_t sent = zsock_send(sock, bytes, size, 0);
+        if (sent < 0)
+        {
+            LOG_WRN("Failed to send to HTTP client. Error %d.", errno);
+            return E_IO;
+        }
+        bytes += sent;
+        size -= sent;
+    }
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Sends one chunk of a chunked body. The data is sent from where it is, not copied.
+ * * Empty chunks are skipped, since an empty chunk ends the body.
+ * * @retval E_SUCCESS Chunk sent.
+ * @retval E_IO The connection failed.
+ */
+static enum error_e send_chunk(int sock, const uint8_t *data, size_t size)
+{
+    if (size == 0)
+    {
+        return E_SUCCESS;
+    }
+    char size_line[12];
+    int length = snprintf(size_line, sizeof(size_line), "%x\r\n", (unsigned int)size);
+    if (send_all(sock, size_line, length) != E_SUCCESS || send_all(sock, data, size) != E_SUCCESS)
+    {
+        return E_IO;
+    }
+    return send_all(sock, "\r\n", 2);
+}
+
+static enum error_e send_status(int sock, const char *status)
+{
+    char header[96];
+    int length = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status);
+    return send_all(sock, header, length);
+}
+
+/**
+ * @brief Sends the buffered CSV lines as one chunk and empties the buffer.
+ */
+static enum error_e flush_csv_chunk(int sock)
+{
+    enum error_e err = send_chunk(sock, e_data.chunk, e_data.chunk_size);
+    e_data.chunk_size = 0;
+    return err;
+}
+
+/**
+ * @brief Formats one sample as a CSV line at the end of the chunk buffer, flushing the buffer first if it is full.
+ */
+static enum error_e append_csv_sample(int sock, struct temperature_sample_t sample)
+{
+    if (sizeof(e_data.chunk) - e_data.chunk_size < HTTP_EXPORT_CSV_LINE_MAX_SIZE && flush_csv_chunk(sock) != E_SUCCESS)
+    {
+        return E_IO;
+    }
+    // temperatures are in 1/16 degrees. one sixteenth is 0.0625, so 4 decimals are exact
+    unsigned int magnitude = abs(sample.temperature);
+    int length = snprintf((char *)&e_data.chunk[e_data.chunk_size], sizeof(e_data.chunk) - e_data.chunk_size, "%lld,%s%u.%04u\n",
+                          (long long)get_unix_seconds_of(sample.uptime), sample.temperature < 0 ? "-" : "", magnitude >> 4, (magnitude & 0xF) * 625);
+    e_data.chunk_size += length;
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Sends one batch of samples as one chunk.
+ * * @retval E_SUCCESS Chunk sent.
+ * @retval E_ERROR The samples could not be packed.
+ * @retval E_IO The connection failed.
+ */
+static enum error_e send_samples(int sock, size_t count, enum export_format_e format)
+{
+    if (format == EXPORT_FORMAT_CSV)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (append_csv_sample(sock, e_data.samples[i]) != E_SUCCESS)
+            {
+                return E_IO;
+            }
+        }
+        return flush_csv_chunk(sock);
+    }
+
+    struct sample_encoder_t encoder;
+    init_sample_encoder(&encoder, e_data.chunk, sizeof(e_data.chunk));
+    for (size_t i = 0; i < count; i++)
+    {
+        if (encode_sample(&encoder, e_data.samples[i]) != E_SUCCESS)
+        {
+            LOG_ERR("Failed to pack samples of channel %d for export.", (int)e_data.cursor.channel);
+            return E_ERROR;
+        }
+    }
+    return send_chunk(sock, e_data.chunk, encoder.size);
+}
+
+/**
+ * @brief Streams the history of one channel from 'start_time' on as the body of a chunked response.
+ * * The samples are read through a history cursor, one block at a time, so a flush during the
+ * download neither loses nor repeats the samples that moved out of the RAM list.
+ */
+static enum error_e send_history(int sock, size_t channel, sys_minutes_t start_time, enum export_format_e format)
+{
+    const char *content_type = format == EXPORT_FORMAT_CSV ? "text/csv" : "application/octet-stream";
+    char header[160];
+    int length = snprintf(header, sizeof(header),
+                          "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n", content_type);
+    if (send_all(sock, header, length) != E_SUCCESS)
+    {
+        return E_IO;
+    }
+
+    e_data.chunk_size = 0;
+    open_history_cursor(&e_data.cursor, channel, start_time, false);
+    size_t count;
+    enum error_e err;
+    while ((err = read_history_cursor(&e_data.cursor, e_data.samples, ARRAY_SIZE(e_data.samples), &count)) == E_SUCCESS && count > 0)
+    {
+        err = send_samples(sock, count, format);
+        if (err != E_SUCCESS)
+        {
+            return err;
+        }
+    }
+    if (err != E_SUCCESS)
+    {
+        LOG_ERR("Export of history segment %u of channel %d failed. Error %d.", e_data.cursor.segment, (int)channel, err);
+        return err;
+    }
+    return send_all(sock, "0\r\n\r\n", 5);
+}
+
+/**
+ * @brief Sends the timing statistics of every phase and the boot milestones as a chunked text body, one chunk per line.
+ */
+static enum error_e send_metrics(int sock)
+{
+    const char *header = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n";
+    if (send_all(sock, header, strlen(header)) != E_SUCCESS)
+    {
+        return E_IO;
+    }
+    for (size_t phase = 0; phase < METRICS_PHASE_COUNT; phase++)
+    {
+        int length = format_metrics_phase(phase, (char *)e_data.chunk, sizeof(e_data.chunk));
+        if (send_chunk(sock, e_data.chunk, length) != E_SUCCESS)
+        {
+            return E_IO;
+        }
+    }
+    for (size_t milestone = 0; milestone < METRICS_MILESTONE_COUNT; milestone++)
+    {
+        int length = format_metrics_milestone(milestone, (char *)e_data.chunk, sizeof(e_data.chunk));
+        if (send_chunk(sock, e_data.chunk, length) != E_SUCCESS)
+        {
+            return E_IO;
+        }
+    }
+    return send_all(sock, "0\r\n\r\n", 5);
+}
+
+/**
+ * @brief Receives the request head into e_data.request. The body, if any, is ignored.
+ * * @retval E_SUCCESS The head was received and is null terminated.
+ * @retval E_NOBUFS The head does not fit the buffer.
+ * @retval E_IO The connection failed or timed out.
+ */
+static enum error_e receive_request(int sock)
+{
+    size_t size = 0;
+    e_data.request[0] = '\0';
+    while (strstr(e_data.request, "\r\n\r\n") == NULL)
+    {
+        if (size == HTTP_EXPORT_REQUEST_MAX_SIZE)
+        {
+            return E_NOBUFS;
+        }
+        ssize_t received = zsock_recv(sock, &e_data.request[size], HTTP_EXPORT_REQUEST_MAX_SIZE - size, 0);
+        if (received <= 0)
+        {
+            return E_IO;
+        }
+        size += received;
+        e_data.request[size] = '\0';
+    }
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Parses the numeric parameters of a query string into 'values', indexed by enum query_parameter_e.
+ * * Parameters that are missing keep their value. Unknown parameters are ignored.
+ * * @param query The query, without the '?'. May be NULL.
+ * @retval E_SUCCESS Query parsed.
+ * @retval E_INVAL A known parameter is not a number.
+ */
+static enum error_e parse_query(const char *query, unsigned long long *values)
+{
+    while (query != NULL && *query != '\0')
+    {
+        for (size_t i = 0; i < QUERY_PARAMETER_COUNT; i++)
+        {
+            size_t length = strlen(query_parameter_names[i]);
+            if (strncmp(query, query_parameter_names[i], length) == 0 && query[length] == '=')
+            {
+                char *end;
+                values[i] = strtoull(&query[length + 1], &end, 10);
+                if (end == &query[length + 1] || (*end != '\0' && *end != '&'))
+                {
+                    return E_INVAL;
+                }
+            }
+        }
+        query = strchr(query, '&');
+        query = query != NULL ? query + 1 : NULL;
+    }
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Parses "GET <path>?channel=N&start=T HTTP/1.1" and answers it.
+ */
+static void handle_request(int sock)
+{
+    enum error_e err = receive_request(sock);
+    if (err == E_NOBUFS)
+    {
+        send_status(sock, "431 Request Header Fields Too Large");
+        return;
+    }
+    if (err != E_SUCCESS)
+    {
+        return;
+    }
+    if (strncmp(e_data.request, "GET ", 4) != 0)
+    {
+        send_status(sock, "405 Method Not Allowed");
+        return;
+    }
+
+    char *path = &e_data.request[4];
+    char *path_end = strchr(path, ' ');
+    if (path_end == NULL)
+    {
+        send_status(sock, "400 Bad Request");
+        return;
+    }
+    *path_end = '\0';
+    char *query = strchr(path, '?');
+    if (query != NULL)
+    {
+        *query++ = '\0';
+    }
+
+    enum export_format_e format;
+    if (strcmp(path, "/metrics") == 0)
+    {
+        send_metrics(sock);
+        return;
+    }
+    if (strcmp(path, "/history.bin") == 0)
+    {
+        format = EXPORT_FORMAT_BINARY;
+    }
+    else if (strcmp(path, "/history.csv") == 0)
+    {
+        format = EXPORT_FORMAT_CSV;
+    }
+    else
+    {
+        send_status(sock, "404 Not Found");
+        return;
+    }
+
+    unsigned long long values[QUERY_PARAMETER_COUNT] = {0};
+    if (parse_query(query, values) != E_SUCCESS)
+    {
+        send_status(sock, "400 Bad Request");
+        return;
+    }
+    unsigned long long channel = values[QUERY_PARAMETER_CHANNEL];
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        send_status(sock, "404 Not Found");
+        return;
+    }
+    // samples are stamped in whole minutes, so round up to not return the one before 'start'
+    sys_minutes_t start_time = 0;
+    unsigned long long start = values[QUERY_PARAMETER_START];
+    if (start > TIME_EPOCH_UNIX_SECONDS)
+    {
+        start_time = (sys_minutes_t)MIN((start - TIME_EPOCH_UNIX_SECONDS + 59) / 60, UINT32_MAX);
+    }
+
+    LOG_INF("Exporting history of channel %d.", (int)channel);
+    send_history(sock, channel, start_time, format);
+}
+
+static void run_http_export(void *p1, void *p2, void *p3)
+{
+    int server = zsock_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (server < 0)
+    {
+        LOG_ERR("Failed to create HTTP socket. Error %d.", errno);
+        return;
+    }
+    int reuse = 1;
+    zsock_setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_TEMPERATURE_LOGGER_HTTP_PORT),
+        .sin_addr = {.s_addr = htonl(INADDR_ANY)},
+    };
+    if (zsock_bind(server, (struct sockaddr *)&address, sizeof(address)) < 0 || zsock_listen(server, 1) < 0)
+    {
+        LOG_ERR("Failed to listen on HTTP port %d. Error %d.", CONFIG_TEMPERATURE_LOGGER_HTTP_PORT, errno);
+        zsock_close(server);
+        return;
+    }
+    LOG_INF("HTTP export listening on port %d.", CONFIG_TEMPERATURE_LOGGER_HTTP_PORT);
+
+    while (true)
+    {
+        int client = zsock_accept(server, NULL, NULL);
+        if (client < 0)
+        {
+            LOG_WRN("Failed to accept HTTP client. Error %d.", errno);
+            k_sleep(K_SECONDS(1));
+            continue;
+        }
+        // a client that never finishes its request would block every other download
+        struct zsock_timeval timeout = {.tv_sec = HTTP_EXPORT_RECEIVE_TIMEOUT_SECONDS};
+        zsock_setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        handle_request(client);
+        zsock_close(client);
+    }
+}
+
+/**
+ * @brief Starts the HTTP export server in its own thread.
+ * * The server listens on every interface, so it works once either the AP or the
+ * station is up. Load the history of the temperature logger before calling this function.
+ * * @retval E_SUCCESS Server thread started.
+ */
+enum error_e init_http_export(void)
+{
+    k_thread_create(&e_data.thread, http_export_stack, K_THREAD_STACK_SIZEOF(http_export_stack),
+                    run_http_export, NULL, NULL, NULL, HTTP_EXPORT_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(&e_data.thread, "http_export");
+    return E_SUCCESS;
+}
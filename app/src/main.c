@@ -3,57 +3,67 @@
 #include "app/nvs.h"
 #include "app/config-settings.h"
 #include "app/wifi.h"
+#include "app/workqueue.h"
+#include "app/temperature-logger.h"
+#include "app/http-export.h"
+#include "app/uplink.h"
+#include "app/power-manager.h"
+#include "app/metrics.h"
+#include "app/time.h"
 
 LOG_MODULE_REGISTER(main, LOG_LEVEL_DBG);
 
+/*
+ * Boot sequence. Nothing waits on anything it does not need:
+ * 1. Sampling starts before anything is read from flash. The first samples wait in
+ *    the sample queues.
+ * 2. NVS is mounted and the config settings are loaded.
+ * 3. The station starts connecting from the stored logins and the cached AP. It
+ *    connects in the background while the rest of the boot continues.
+ * 4. The history is loaded and the clock is moved past it. The queued samples are
+ *    stored from here on.
+ * 5. The modules that read the history or need the clock start: SNTP, the HTTP
+ *    export and the uplink.
+ * If NVS cannot be mounted, the history and the uplink cursors are not loaded and the
+ * uplink is not started. The samples stay in RAM.
+ * The time every step was reached is recorded as a boot milestone (see app/metrics.h).
+ */
 int main(void)
 {
     LOG_INF("Hello, World!");
-    k_sleep(K_SECONDS(10));
-    init_nvs();
+    init_app_workqueue();
+    if (init_temperature_logger() != E_SUCCESS)
+    {
+        LOG_ERR("Sampling could not be started.");
+    }
+
+    bool nvs_mounted = init_nvs() == E_SUCCESS;
+    if (nvs_mounted)
+    {
+        record_metrics_milestone(METRICS_MILESTONE_NVS_MOUNTED);
+    }
     init_config_settings();
     init_wifi();
-    k_sleep(K_SECONDS(10));
-    LOG_DBG("Init complete.");
+    init_power_manager();
+    start_wifi_station_from_config_settings();
 
-    enum error_e err;
-    // test wifi logins
-    // set_wifi_logins("Openserve-8B43", "RctVkh8VLh");
-    // set_wifi_logins("wrong ssid", "RctVkh8VLh");
-    set_wifi_logins("Openserve-8B43", "wrong password");
-    enum logins_state_e state;
-    // LOG_DBG("Testing wifi...");
-    err = test_wifi_logins(&state);
-    LOG_DBG("Test wifi logins result: %d.", state);
-    // err = enable_wifi_station();
-    if (err != E_SUCCESS) {
-        LOG_ERR("Wifi test failed. Error %d.", err);
-    } else {
-        LOG_DBG("Wifi test completed successfully.");
+    if (nvs_mounted)
+    {
+        load_temperature_logger_history();
     }
-    while (true)
+    else
     {
-        k_sleep(K_SECONDS(10));
+        // nothing can be read or stored. the samples stay in the sample queues in RAM until they are full
+        LOG_ERR("NVS is not mounted. The history is not loaded and the samples stay in RAM.");
     }
-
-    // struct config_settings_t settings;
-    // load_config_settings(&settings);
-
-    // if (settings.wifi_ssid[0] == 0xFF)
-    // {
-    //     strcpy(settings.wifi_ssid, "my wifi");
-    //     strcpy(settings.wifi_password, "my password");
-    //     store_config_settings(&settings);
-    //     LOG_INF("Reboot the device now.");
-    // }
-    // else
-    // {
-    //     LOG_INF("Wifi SSID: %s", settings.wifi_ssid);
-    //     LOG_INF("Wifi password: %s", settings.wifi_password);
-    // }
-
-    // while (true)
-    // {
-    //     k_sleep(K_FOREVER);
-    // }
-}
\ No newline at end of file
+    init_time();
+    init_http_export();
+    if (nvs_mounted)
+    {
+        init_uplink();
+    }
+    record_metrics_milestone(METRICS_MILESTONE_INIT_DONE);
+    LOG_DBG("Init complete in %lld ms.", (long long)k_uptime_get());
+    log_workqueue_stack_usage();
+    return 0;
+}
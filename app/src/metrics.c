@@ -0,0 +1,202 @@
+/*
+ * Metrics Module
+ * -----------------------------------------------------------------------------
+ * Keeps timing statistics of the hot paths in RAM: count, min, max, average and
+ * a log4 histogram per phase (see enum metrics_phase_e). Also keeps the time
+ * every milestone of the boot was reached (see enum metrics_milestone_e).
+ *
+ * Phases are timed with begin_metrics_phase() and end_metrics_phase(), which read
+ * the cycle counter. Nothing is logged, so timing a phase does not stall the
+ * calling thread. The statistics are read with get_metrics_phase() or as text
+ * with format_metrics_phase(), which the HTTP export serves at GET /metrics and
+ * the "metrics" shell command prints.
+ *
+ * Without CONFIG_TEMPERATURE_LOGGER_METRICS, nothing is recorded and every phase
+ * reads as empty.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include "app/metrics.h"
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+struct metrics_data_t
+{
+    struct metrics_phase_t phases[METRICS_PHASE_COUNT];
+    struct k_spinlock lock; // protects phases. held for a few instructions only
+    atomic_t milestones[METRICS_MILESTONE_COUNT]; /* milliseconds since boot plus one. 0 until reached */
+};
+
+static struct metrics_data_t m_data;
+
+static const char *const metrics_phase_names[METRICS_PHASE_COUNT] = {
+    [METRICS_PHASE_SAMPLE] = "sample",
+    [METRICS_PHASE_COMPACTION] = "compaction",
+    [METRICS_PHASE_SEGMENT_STORE] = "segment_store",
+    [METRICS_PHASE_BLOCK_LOAD] = "block_load",
+    [METRICS_PHASE_CONFIG_STORE] = "config_store",
+    [METRICS_PHASE_WIFI_CONNECT] = "wifi_connect",
+    [METRICS_PHASE_WIFI_DHCP] = "wifi_dhcp",
+};
+
+static const char *const metrics_milestone_names[METRICS_MILESTONE_COUNT] = {
+    [METRICS_MILESTONE_FIRST_SAMPLE] = "boot_first_sample",
+    [METRICS_MILESTONE_NVS_MOUNTED] = "boot_nvs_mounted",
+    [METRICS_MILESTONE_HISTORY_LOADED] = "boot_history_loaded",
+    [METRICS_MILESTONE_INIT_DONE] = "boot_init_done",
+    [METRICS_MILESTONE_WIFI_CONNECTED] = "boot_wifi_connected",
+    [METRICS_MILESTONE_FIRST_UPLINK] = "boot_first_uplink",
+};
+
+static size_t get_histogram_bucket(uint32_t duration_us)
+{
+    // number of base 4 digits. 0 us goes to bucket 0, 1..3 us to bucket 1, 4..15 us to bucket 2 and so on
+    size_t bits = duration_us == 0 ? 0 : 32 - __builtin_clz(duration_us);
+    return MIN(DIV_ROUND_UP(bits, 2), METRICS_HISTOGRAM_BUCKETS - 1);
+}
+
+/**
+ * @brief Adds one duration to the statistics of a phase. Safe to call from any thread or ISR.
+ * Use end_metrics_phase() or record_metrics_phase() instead, which drop out without CONFIG_TEMPERATURE_LOGGER_METRICS.
+ */
+void add_metrics_sample(enum metrics_phase_e phase, uint32_t duration_us)
+{
+    if (phase >= METRICS_PHASE_COUNT)
+    {
+        return;
+    }
+    size_t bucket = get_histogram_bucket(duration_us);
+    k_spinlock_key_t key = k_spin_lock(&m_data.lock);
+    struct metrics_phase_t *m = &m_data.phases[phase];
+    if (m->count == 0 || duration_us < m->min_us)
+    {
+        m->min_us = duration_us;
+    }
+    m->max_us = MAX(m->max_us, duration_us);
+    m->count++;
+    m->total_us += duration_us;
+    m->histogram[bucket]++;
+    k_spin_unlock(&m_data.lock, key);
+}
+
+/**
+ * @brief Copies the statistics of one phase. Unknown phases read as empty.
+ */
+void get_metrics_phase(enum metrics_phase_e phase, struct metrics_phase_t *m)
+{
+    if (phase >= METRICS_PHASE_COUNT)
+    {
+        memset(m, 0, sizeof(struct metrics_phase_t));
+        return;
+    }
+    k_spinlock_key_t key = k_spin_lock(&m_data.lock);
+    memcpy(m, &m_data.phases[phase], sizeof(struct metrics_phase_t));
+    k_spin_unlock(&m_data.lock, key);
+}
+
+void reset_metrics(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&m_data.lock);
+    memset(m_data.phases, 0, sizeof(m_data.phases));
+    k_spin_unlock(&m_data.lock, key);
+}
+
+const char *get_metrics_phase_name(enum metrics_phase_e phase)
+{
+    return phase < METRICS_PHASE_COUNT ? metrics_phase_names[phase] : "unknown";
+}
+
+/**
+ * @brief Formats the statistics of one phase as a single line of text.
+ * * "<name> count=N min=N avg=N max=N hist=N,N,...\n", all durations in microseconds.
+ * * @param buffer Receives the line, null terminated. Cut short if it does not fit.
+ * @return The length of the line, not counting the terminator.
+ */
+int format_metrics_phase(enum metrics_phase_e phase, char *buffer, size_t size)
+{
+    struct metrics_phase_t m;
+    get_metrics_phase(phase, &m);
+    uint32_t average = m.count > 0 ? (uint32_t)(m.total_us / m.count) : 0;
+    int length = snprintf(buffer, size, "%s count=%u min=%u avg=%u max=%u hist=", get_metrics_phase_name(phase),
+                          m.count, m.min_us, average, m.max_us);
+    for (size_t i = 0; i < METRICS_HISTOGRAM_BUCKETS && length >= 0 && (size_t)length < size; i++)
+    {
+        length += snprintf(&buffer[length], size - length, i + 1 < METRICS_HISTOGRAM_BUCKETS ? "%u," : "%u\n", m.histogram[i]);
+    }
+    return MIN(length, size > 0 ? (int)size - 1 : 0);
+}
+
+/**
+ * @brief Records that a milestone has been reached now, unless it has been reached before. Safe to call from any thread.
+ * Use record_metrics_milestone() instead, which drops out without CONFIG_TEMPERATURE_LOGGER_METRICS.
+ */
+void add_metrics_milestone(enum metrics_milestone_e milestone)
+{
+    if (milestone >= METRICS_MILESTONE_COUNT)
+    {
+        return;
+    }
+    atomic_cas(&m_data.milestones[milestone], 0, (atomic_val_t)(k_uptime_get() + 1));
+}
+
+/**
+ * @brief Returns when a milestone was reached, in milliseconds since boot. -1 if it has not been reached.
+ * * reset_metrics() does not clear the milestones. They only happen once per boot.
+ */
+int64_t get_metrics_milestone(enum metrics_milestone_e milestone)
+{
+    if (milestone >= METRICS_MILESTONE_COUNT)
+    {
+        return -1;
+    }
+    return (int64_t)atomic_get(&m_data.milestones[milestone]) - 1;
+}
+
+/**
+ * @brief Formats one milestone as a single line of text.
+ * * "<name> ms=N\n", or "<name> ms=-\n" if it has not been reached.
+ * * @param buffer Receives the line, null terminated. Cut short if it does not fit.
+ * @return The length of the line, not counting the terminator.
+ */
+int format_metrics_milestone(enum metrics_milestone_e milestone, char *buffer, size_t size)
+{
+    const char *name = milestone < METRICS_MILESTONE_COUNT ? metrics_milestone_names[milestone] : "unknown";
+    int64_t ms = get_metrics_milestone(milestone);
+    int length = ms < 0 ? snprintf(buffer, size, "%s ms=-\n", name) : snprintf(buffer, size, "%s ms=%lld\n", name, (long long)ms);
+    return MIN(length, size > 0 ? (int)size - 1 : 0);
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_metrics_show(const struct shell *sh, size_t argc, char **argv)
+{
+    char line[160];
+    for (size_t phase = 0; phase < METRICS_PHASE_COUNT; phase++)
+    {
+        format_metrics_phase(phase, line, sizeof(line));
+        shell_fprintf(sh, SHELL_NORMAL, "%s", line);
+    }
+    for (size_t milestone = 0; milestone < METRICS_MILESTONE_COUNT; milestone++)
+    {
+        format_metrics_milestone(milestone, line, sizeof(line));
+        shell_fprintf(sh, SHELL_NORMAL, "%s", line);
+    }
+    return 0;
+}
+
+static int cmd_metrics_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    reset_metrics();
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(metrics_commands,
+                               SHELL_CMD(show, NULL, "Print the timing of every phase in microseconds and the boot milestones in milliseconds.", cmd_metrics_show),
+                               SHELL_CMD(reset, NULL, "Clear all timings.", cmd_metrics_reset),
+                               SHELL_SUBCMD_SET_END);
+SHELL_CMD_REGISTER(metrics, &metrics_commands, "Hot path timing statistics", NULL);
+#endif
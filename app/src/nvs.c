@@ -1,19 +1,49 @@
+#include <zephyr/kernel.h>
 #include <zephyr/device.h>
 #include <zephyr/drivers/flash.h>
 #include <zephyr/storage/flash_map.h>
 #include <zephyr/fs/nvs.h>
 #include <zephyr/logging/log.h>
 #include "app/error.h"
+#include "app/nvs.h"
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
 
 LOG_MODULE_REGISTER(nvs_helpers, LOG_LEVEL_WRN);
 
 #define NVS_PARTITION storage_partition
 #define NVS_PARTITION_DEVICE FIXED_PARTITION_DEVICE(NVS_PARTITION)
 #define NVS_PARTITION_OFFSET FIXED_PARTITION_OFFSET(NVS_PARTITION)
+#define NVS_PARTITION_SIZE FIXED_PARTITION_SIZE(NVS_PARTITION)
+
+#ifndef CONFIG_TEMPERATURE_LOGGER_NVS_SECTOR_COUNT
+// this is never used. im putting it there so that intellisense doesnt get confused
+#define CONFIG_TEMPERATURE_LOGGER_NVS_SECTOR_COUNT 3
+#endif
+
+// the sector is the upper half of an NVS address. ADDR_SECT_SHIFT in zephyr/subsys/fs/nvs/nvs_priv.h
+#define NVS_ADDRESS_SECTOR_SHIFT 16
 
 static struct nvs_fs fs = {0};
 static struct flash_pages_info info = {0};
 
+struct nvs_counters_t
+{
+    atomic_t write_count;
+    atomic_t write_bytes;
+    atomic_t gc_count;
+    atomic_t write_sector; /* sector of the write position after the last write */
+};
+
+static struct nvs_counters_t n_data;
+
+static uint32_t get_nvs_write_sector(void)
+{
+    return fs.ate_wra >> NVS_ADDRESS_SECTOR_SHIFT;
+}
+
 /*
  * Initialize NVS.
  *
@@ -38,7 +68,12 @@ enum error_e init_nvs()
         return E_ERROR;
     }
     fs.sector_size = info.size;
-    fs.sector_count = 3U;  // TODO: figure out the best sector count size
+    fs.sector_count = CONFIG_TEMPERATURE_LOGGER_NVS_SECTOR_COUNT;
+    if ((size_t)fs.sector_count * fs.sector_size > NVS_PARTITION_SIZE)
+    {
+        LOG_ERR("%d sectors of %d bytes do not fit in the NVS partition.", fs.sector_count, (int)fs.sector_size);
+        return E_ERROR;
+    }
 
     err = nvs_mount(&fs);
     if (err)
@@ -46,9 +81,87 @@ enum error_e init_nvs()
         LOG_ERR("Failed to mount NVS file system.");
         return E_ERROR;
     }
+    atomic_set(&n_data.write_sector, (atomic_val_t)get_nvs_write_sector());
     return E_SUCCESS;
 }
 
 struct nvs_fs* get_nvs_fs(void) {
     return &fs;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Counts the garbage collections since the last write or delete.
+ * * NVS collects the oldest sector whenever the write position moves on to the next one.
+ */
+static void count_nvs_garbage_collections(void)
+{
+    // a write moves on by at most one sector. if two writers race, only one of them counts the move
+    atomic_val_t before = atomic_get(&n_data.write_sector);
+    uint32_t after = get_nvs_write_sector();
+    if ((uint32_t)before != after && atomic_cas(&n_data.write_sector, before, (atomic_val_t)after))
+    {
+        atomic_add(&n_data.gc_count, (atomic_val_t)((after + fs.sector_count - (uint32_t)before) % fs.sector_count));
+    }
+}
+
+/**
+ * @brief Writes a record with nvs_write() and counts the write for get_nvs_stats().
+ * * Every write and delete goes through here or delete_nvs(), so the garbage collections can be counted.
+ * * @return The result of nvs_write(). 0 if the record already held the data.
+ */
+ssize_t write_nvs(uint16_t id, const void *data, size_t len)
+{
+    ssize_t bytes_written = nvs_write(&fs, id, data, len);
+    if (bytes_written > 0)
+    {
+        atomic_inc(&n_data.write_count);
+        atomic_add(&n_data.write_bytes, (atomic_val_t)bytes_written);
+    }
+    count_nvs_garbage_collections();
+    return bytes_written;
+}
+
+/**
+ * @brief Deletes a record with nvs_delete() and counts the garbage collections it triggers for get_nvs_stats().
+ * * A delete writes an empty record if the record exists. nvs_delete() does not tell whether it did, so deletes
+ * are not counted as writes.
+ * * @return The result of nvs_delete(). 0 if the record was deleted or did not exist.
+ */
+int delete_nvs(uint16_t id)
+{
+    int ret = nvs_delete(&fs, id);
+    count_nvs_garbage_collections();
+    return ret;
+}
+
+/**
+ * @brief Returns the write counters since boot and how much space is left.
+ * * Finding the free space scans the sectors, so this is slow. Do not call it from the hot paths.
+ */
+void get_nvs_stats(struct nvs_stats_t *stats)
+{
+    stats->write_count = (uint32_t)atomic_get(&n_data.write_count);
+    stats->write_bytes = (uint32_t)atomic_get(&n_data.write_bytes);
+    stats->gc_count = (uint32_t)atomic_get(&n_data.gc_count);
+    stats->free_space = nvs_calc_free_space(&fs);
+    stats->sector_size = fs.sector_size;
+    stats->sector_count = fs.sector_count;
+    stats->write_sector = get_nvs_write_sector();
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_nvs_stats(const struct shell *sh, size_t argc, char **argv)
+{
+    struct nvs_stats_t stats;
+    get_nvs_stats(&stats);
+    shell_print(sh, "free=%d size=%u sectors=%u write_sector=%u", (int)stats.free_space,
+                stats.sector_size * stats.sector_count, stats.sector_count, stats.write_sector);
+    shell_print(sh, "writes=%u bytes=%u gc=%u", stats.write_count, stats.write_bytes, stats.gc_count);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(nvs_commands,
+                               SHELL_CMD(stats, NULL, "Print the free space and the writes and garbage collections since boot.", cmd_nvs_stats),
+                               SHELL_SUBCMD_SET_END);
+SHELL_CMD_REGISTER(nvs, &nvs_commands, "NVS statistics", NULL);
+#endif
\ No newline at end of file
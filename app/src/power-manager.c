@@ -0,0 +1,173 @@
+/*
+ * Power Manager Module
+ * -----------------------------------------------------------------------------
+ * Decides when the Wi-Fi station is up.
+ *
+ * The radio is by far the largest consumer of the board, so with
+ * CONFIG_TEMPERATURE_LOGGER_LOW_POWER the station is only connected while
+ * someone holds it. The uplink acquires it for the length of one burst and
+ * releases it afterwards. The last release disconnects the station. While it is
+ * held, the station runs in power saving mode and the radio sleeps between the
+ * beacons of the AP.
+ *
+ * Without CONFIG_TEMPERATURE_LOGGER_LOW_POWER, acquiring still connects the
+ * station, but releasing it leaves it connected.
+ *
+ * Everything else in the firmware waits on kernel timeouts (the sampler and the
+ * DS18B20 conversion are delayable work items), so with CONFIG_PM the idle
+ * thread puts the SoC into light sleep between sampling rounds. Light sleep
+ * retains all of RAM, including the RAM lists.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "app/power-manager.h"
+#include "app/wifi.h"
+
+LOG_MODULE_REGISTER(power_manager, LOG_LEVEL_DBG);
+
+struct power_manager_data_t
+{
+    uint32_t station_holders; /* number of callers that acquired the station and did not release it yet */
+    struct k_mutex lock;      /* protects station_holders. serializes connects and disconnects */
+    struct k_poll_signal wifi_signal; /* raised on every Wi-Fi state change */
+    struct k_poll_event wifi_event;
+    struct k_work_poll disconnect_task; /* runs on the system workqueue */
+};
+
+static void perform_disconnect_task(struct k_work *work);
+
+static struct power_manager_data_t p_data = {
+    .lock = Z_MUTEX_INITIALIZER(p_data.lock),
+};
+
+/**
+ * @brief Disconnects the station if nobody holds it.
+ * * A station that is still connecting can't be disconnected. Then this waits for the next Wi-Fi
+ * state change and tries again, so a station that never settles does not wake the SoC up.
+ */
+static void perform_disconnect_task(struct k_work *work)
+{
+    // reset before disconnecting, so a change that happens in between wakes us up again
+    k_poll_signal_reset(&p_data.wifi_signal);
+    p_data.wifi_event.state = K_POLL_STATE_NOT_READY;
+
+    k_mutex_lock(&p_data.lock, K_FOREVER);
+    if (p_data.station_holders == 0 && disable_wifi_station() == E_PERM)
+    {
+        k_work_poll_submit(&p_data.disconnect_task, &p_data.wifi_event, 1, K_FOREVER);
+    }
+    k_mutex_unlock(&p_data.lock);
+}
+
+/**
+ * @brief Drops one hold on the station. The caller MUST hold p_data.lock.
+ */
+static void release_wifi_station_without_locking(void)
+{
+    if (p_data.station_holders == 0)
+    {
+        LOG_WRN("Wi-Fi station released more often than it was acquired.");
+        return;
+    }
+    p_data.station_holders--;
+    if (p_data.station_holders == 0 && IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_LOW_POWER))
+    {
+        LOG_DBG("Wi-Fi station is no longer needed. Disconnecting.");
+        k_work_poll_submit(&p_data.disconnect_task, &p_data.wifi_event, 1, K_NO_WAIT);
+    }
+}
+
+/**
+ * @brief Starts the power manager.
+ * * With CONFIG_TEMPERATURE_LOGGER_LOW_POWER, the station is disconnected until it is acquired.
+ * Initialize Wi-Fi before calling this function.
+ * * @retval E_SUCCESS Power manager started.
+ * @retval E_NOSPC Wi-Fi state changes could not be subscribed to. The station is not disconnected.
+ */
+enum error_e init_power_manager(void)
+{
+    if (!IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_LOW_POWER))
+    {
+        return E_SUCCESS;
+    }
+    if (!IS_ENABLED(CONFIG_PM))
+    {
+        LOG_WRN("CONFIG_PM is off. The SoC will not sleep between sampling rounds.");
+    }
+    k_poll_signal_init(&p_data.wifi_signal);
+    k_poll_event_init(&p_data.wifi_event, K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &p_data.wifi_signal);
+    k_work_poll_init(&p_data.disconnect_task, perform_disconnect_task);
+    enum error_e err = subscribe_wifi_state(&p_data.wifi_signal);
+    if (err != E_SUCCESS)
+    {
+        LOG_ERR("Failed to subscribe to Wi-Fi state changes. The station will not be disconnected.");
+        return err;
+    }
+    k_work_poll_submit(&p_data.disconnect_task, &p_data.wifi_event, 1, K_NO_WAIT);
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Holds the Wi-Fi station up and waits until it is connected.
+ * * Every successful call MUST be paired with release_wifi_station(). On failure, nothing is held.
+ * * @param timeout How long to wait for the connection.
+ * @retval E_SUCCESS The station is connected.
+ * @retval E_TIMEOUT The station did not connect in time.
+ * @retval E_ERROR The station could not connect, for example because the logins are wrong or not set.
+ */
+enum error_e acquire_wifi_station(k_timeout_t timeout)
+{
+    k_timepoint_t deadline = sys_timepoint_calc(timeout);
+    k_mutex_lock(&p_data.lock, K_FOREVER);
+    p_data.station_holders++;
+    enum error_e err = enable_wifi_station();
+    if (err != E_SUCCESS && err != E_ALREADY_DONE && err != E_IN_PROGRESS)
+    {
+        LOG_WRN("Failed to start Wi-Fi station. Error %d.", err);
+        release_wifi_station_without_locking();
+        k_mutex_unlock(&p_data.lock);
+        return E_ERROR;
+    }
+    k_mutex_unlock(&p_data.lock);
+
+    struct wifi_state_t state;
+    while (true)
+    {
+        get_wifi_state(&state);
+        if (state.station_state == STATION_STATE_CONNECTED)
+        {
+            set_wifi_power_saving(true);
+            return E_SUCCESS;
+        }
+        if (state.station_state == STATION_STATE_DISCONNECTED)
+        {
+            err = E_ERROR;
+            break;
+        }
+        if (sys_timepoint_expired(deadline))
+        {
+            err = E_TIMEOUT;
+            break;
+        }
+        // a failed fast connect retries with a full scan, so one steady state may not be the last
+        wait_for_station_steady_state(sys_timepoint_timeout(deadline));
+    }
+
+    LOG_WRN("Wi-Fi station did not connect. Error %d.", err);
+    k_mutex_lock(&p_data.lock, K_FOREVER);
+    release_wifi_station_without_locking();
+    k_mutex_unlock(&p_data.lock);
+    return err;
+}
+
+/**
+ * @brief Drops a hold taken with acquire_wifi_station().
+ * * With CONFIG_TEMPERATURE_LOGGER_LOW_POWER, the last release disconnects the station.
+ */
+void release_wifi_station(void)
+{
+    k_mutex_lock(&p_data.lock, K_FOREVER);
+    release_wifi_station_without_locking();
+    k_mutex_unlock(&p_data.lock);
+}
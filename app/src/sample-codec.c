@@ -0,0 +1,256 @@
+/*
+ * Sample Codec Module
+ * -----------------------------------------------------------------------------
+ * Packs temperature samples for storage. See app/sample-codec.h for the format.
+ *
+ * A raw struct temperature_sample_t takes 8 bytes with padding. Samples come
+ * at a fixed period with small temperature changes, so almost all of them
+ * encode to a single byte.
+ *
+ * Both the encoder and the decoder work one sample at a time, so callers can
+ * stream samples in and out without materializing a whole list.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "app/sample-codec.h"
+
+LOG_MODULE_REGISTER(sample_codec, LOG_LEVEL_WRN);
+
+#define SHORT_FORM_MAX_BYTE 0x7F
+#define LONG_FORM_MARKER 0x80
+#define SHORT_FORM_DOD_SHIFT 5
+#define SHORT_FORM_DOD_MASK 0x3
+#define SHORT_FORM_TEMPERATURE_MASK 0x1F
+
+static uint64_t zigzag_encode(int64_t n)
+{
+    return ((uint64_t)n << 1) ^ (uint64_t)(n >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t n)
+{
+    return (int64_t)(n >> 1) ^ -(int64_t)(n & 1);
+}
+
+static size_t write_varint(uint8_t *buffer, uint64_t value)
+{
+    size_t size = 0;
+    while (value >= 0x80)
+    {
+        buffer[size++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buffer[size++] = (uint8_t)value;
+    return size;
+}
+
+static enum error_e read_varint(struct sample_decoder_t *d, uint64_t *value)
+{
+    *value = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7)
+    {
+        if (d->position == d->size)
+        {
+            return E_INVAL;
+        }
+        uint8_t byte = d->buffer[d->position++];
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return E_SUCCESS;
+        }
+    }
+    return E_INVAL;
+}
+
+/**
+ * @brief Prepares an encoder that writes into the provided buffer.
+ * * @param e Pointer to the encoder.
+ * @param buffer Output buffer.
+ * @param capacity Size of the output buffer in bytes.
+ */
+void init_sample_encoder(struct sample_encoder_t *e, uint8_t *buffer, size_t capacity)
+{
+    if (e == NULL)
+    {
+        return;
+    }
+    memset(e, 0, sizeof(struct sample_encoder_t));
+    e->buffer = buffer;
+    e->capacity = capacity;
+}
+
+/**
+ * @brief Appends one sample to the encoded output.
+ * * A new block is started automatically every SAMPLE_CODEC_BLOCK_SIZE samples.
+ * If the sample does not fit, nothing is written and the encoder stays usable.
+ * * @param e Pointer to the encoder.
+ * @param sample The sample to encode.
+ * @retval E_SUCCESS Sample encoded.
+ * @retval E_NOBUFS The output buffer is full.
+ * @retval E_NULL_PTR If 'e' is NULL.
+ */
+enum error_e encode_sample(struct sample_encoder_t *e, struct temperature_sample_t sample)
+{
+    if (e == NULL || e->buffer == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+
+    uint8_t encoded[SAMPLE_CODEC_BLOCK_HEADER_MAX_SIZE];
+    size_t size = 0;
+    bool new_block = e->block_count == 0 || e->block_count == SAMPLE_CODEC_BLOCK_SIZE;
+    int64_t delta = (int64_t)sample.uptime - (int64_t)e->previous.uptime;
+
+    if (new_block)
+    {
+        // the count is patched as samples are added
+        encoded[size++] = 1;
+        size += write_varint(&encoded[size], sample.uptime);
+        size += write_varint(&encoded[size], zigzag_encode(sample.temperature));
+    }
+    else
+    {
+        uint64_t dod = zigzag_encode(delta - e->previous_delta);
+        uint64_t temperature_delta = zigzag_encode((int64_t)sample.temperature - (int64_t)e->previous.temperature);
+        if (dod <= SHORT_FORM_DOD_MASK && temperature_delta <= SHORT_FORM_TEMPERATURE_MASK)
+        {
+            encoded[size++] = (uint8_t)((dod << SHORT_FORM_DOD_SHIFT) | temperature_delta);
+        }
+        else
+        {
+            encoded[size++] = LONG_FORM_MARKER;
+            size += write_varint(&encoded[size], dod);
+            size += write_varint(&encoded[size], temperature_delta);
+        }
+    }
+
+    if (e->capacity - e->size < size)
+    {
+        return E_NOBUFS;
+    }
+    memcpy(&e->buffer[e->size], encoded, size);
+
+    if (new_block)
+    {
+        e->block_start = e->size;
+        e->block_count = 1;
+        e->previous_delta = 0;
+    }
+    else
+    {
+        e->block_count++;
+        e->buffer[e->block_start] = e->block_count;
+        e->previous_delta = delta;
+    }
+    e->size += size;
+    e->previous = sample;
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Prepares a decoder that reads from the provided buffer.
+ * * @param d Pointer to the decoder.
+ * @param buffer Encoded data.
+ * @param size Size of the encoded data in bytes.
+ */
+void init_sample_decoder(struct sample_decoder_t *d, const uint8_t *buffer, size_t size)
+{
+    if (d == NULL)
+    {
+        return;
+    }
+    memset(d, 0, sizeof(struct sample_decoder_t));
+    d->buffer = buffer;
+    d->size = size;
+}
+
+/**
+ * @brief Decodes the next sample.
+ * * @param d Pointer to the decoder.
+ * @param sample Pointer to the struct that receives the sample.
+ * @retval E_SUCCESS Sample decoded.
+ * @retval E_END_OF_ITER There are no more samples.
+ * @retval E_INVAL The encoded data is malformed or truncated.
+ * @retval E_NULL_PTR If 'd' or 'sample' is NULL.
+ */
+enum error_e decode_sample(struct sample_decoder_t *d, struct temperature_sample_t *sample)
+{
+    if (d == NULL || sample == NULL || d->buffer == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+
+    uint64_t value;
+    enum error_e err;
+    if (d->block_remaining == 0)
+    {
+        if (d->position == d->size)
+        {
+            return E_END_OF_ITER;
+        }
+        uint8_t count = d->buffer[d->position++];
+        if (count == 0 || count > SAMPLE_CODEC_BLOCK_SIZE)
+        {
+            return E_INVAL;
+        }
+        err = read_varint(d, &value);
+        if (err != E_SUCCESS || value > UINT32_MAX)
+        {
+            return E_INVAL;
+        }
+        d->previous.uptime = (sys_minutes_t)value;
+        err = read_varint(d, &value);
+        if (err != E_SUCCESS)
+        {
+            return err;
+        }
+        d->previous.temperature = (temperature_t)zigzag_decode(value);
+        d->previous_delta = 0;
+        d->block_remaining = count - 1;
+        *sample = d->previous;
+        return E_SUCCESS;
+    }
+
+    if (d->position == d->size)
+    {
+        return E_INVAL;
+    }
+    uint8_t byte = d->buffer[d->position++];
+    int64_t dod, temperature_delta;
+    if (byte <= SHORT_FORM_MAX_BYTE)
+    {
+        dod = zigzag_decode((byte >> SHORT_FORM_DOD_SHIFT) & SHORT_FORM_DOD_MASK);
+        temperature_delta = zigzag_decode(byte & SHORT_FORM_TEMPERATURE_MASK);
+    }
+    else if (byte == LONG_FORM_MARKER)
+    {
+        err = read_varint(d, &value);
+        if (err != E_SUCCESS)
+        {
+            return err;
+        }
+        dod = zigzag_decode(value);
+        err = read_varint(d, &value);
+        if (err != E_SUCCESS)
+        {
+            return err;
+        }
+        temperature_delta = zigzag_decode(value);
+    }
+    else
+    {
+        return E_INVAL;
+    }
+
+    d->previous_delta += dod;
+    d->previous.uptime = (sys_minutes_t)((int64_t)d->previous.uptime + d->previous_delta);
+    d->previous.temperature = (temperature_t)((int64_t)d->previous.temperature + temperature_delta);
+    d->block_remaining--;
+    *sample = d->previous;
+    return E_SUCCESS;
+}
@@ -0,0 +1,109 @@
+/*
+ * Sample Compressor Module
+ * -----------------------------------------------------------------------------
+ * Drops samples at ingest that linear interpolation between the samples that are
+ * kept reconstructs within CONFIG_TEMPERATURE_LOGGER_COMPRESSION_TOLERANCE
+ * (swinging door trending). interpolate() and the decimated merges reconstruct
+ * the dropped samples, so every consumer of the history keeps working unchanged.
+ *
+ * Most consecutive DS18B20 readings are equal or only 1/16 degree apart, so with a
+ * tolerance of 1 the RAM list fills many times more slowly, and the flushes, merges
+ * and flash writes happen that much less often. A tolerance of 0 is lossless and
+ * still drops the samples of flat stretches and straight ramps.
+ *
+ * The newest sample is always kept as the candidate. When the next sample arrives,
+ * the line from the anchor to it is checked against every sample since the anchor.
+ * If it passes within the tolerance of all of them, the candidate is dropped and the
+ * new sample takes its place. Otherwise the candidate becomes final and the new anchor.
+ * Everything is integer arithmetic on exact fractions.
+ */
+
+#include <zephyr/kernel.h>
+#include "app/sample-compressor.h"
+
+/**
+ * @brief Compares two slopes. Returns a negative number, zero or a positive number if a is less than, equal to or greater than b.
+ */
+static int compare_sample_slopes(struct sample_slope_t a, struct sample_slope_t b)
+{
+    // both times are positive, so the fractions compare like their cross products. the products fit in 49 bits
+    int64_t left = (int64_t)a.temperature * b.time;
+    int64_t right = (int64_t)b.temperature * a.time;
+    return left < right ? -1 : (left > right ? 1 : 0);
+}
+
+static struct sample_slope_t get_sample_slope(struct temperature_sample_t from, struct temperature_sample_t to, int32_t offset)
+{
+    return (struct sample_slope_t){
+        .temperature = (int32_t)to.temperature + offset - (int32_t)from.temperature,
+        .time = to.uptime - from.uptime,
+    };
+}
+
+/**
+ * @brief Makes 'sample' the candidate. If it has the same time as the anchor, no slope can be
+ * drawn through it, so it becomes final and the new anchor instead.
+ */
+static void start_sample_compressor_door(struct sample_compressor_t *c, struct temperature_sample_t sample)
+{
+    if (sample.uptime == c->anchor.uptime)
+    {
+        c->anchor = sample;
+        c->has_candidate = false;
+        return;
+    }
+    c->candidate = sample;
+    c->upper = get_sample_slope(c->anchor, sample, c->tolerance);
+    c->lower = get_sample_slope(c->anchor, sample, -(int32_t)c->tolerance);
+    c->has_candidate = true;
+}
+
+/**
+ * @brief Starts over. The next sample becomes the anchor.
+ * * Call this whenever the samples before the next one become final by other means, like a flush.
+ * * @param tolerance The largest error a dropped sample may be reconstructed with, in 1/16 degrees.
+ */
+void reset_sample_compressor(struct sample_compressor_t *c, uint16_t tolerance)
+{
+    *c = (struct sample_compressor_t){.tolerance = tolerance};
+}
+
+/**
+ * @brief Runs one sample through the compressor.
+ * * Samples MUST come in time order.
+ * * @param c Pointer to the compressor state.
+ * @param sample The new sample.
+ * @return SAMPLE_COMPRESSOR_REPLACE if the sample replaces the last sample that went through
+ * the compressor, SAMPLE_COMPRESSOR_APPEND if it is appended after it.
+ */
+enum sample_compressor_action_e compress_sample(struct sample_compressor_t *c, struct temperature_sample_t sample)
+{
+    if (!c->has_anchor)
+    {
+        c->anchor = sample;
+        c->has_anchor = true;
+        c->has_candidate = false;
+        return SAMPLE_COMPRESSOR_APPEND;
+    }
+    if (!c->has_candidate)
+    {
+        start_sample_compressor_door(c, sample);
+        return SAMPLE_COMPRESSOR_APPEND;
+    }
+
+    // later than the candidate, so later than the anchor, unless the clock stood still
+    struct sample_slope_t slope = get_sample_slope(c->anchor, sample, 0);
+    if (slope.time != 0 && compare_sample_slopes(slope, c->lower) >= 0 && compare_sample_slopes(slope, c->upper) <= 0)
+    {
+        // the line to the new sample reconstructs every dropped sample. narrow the door by the new sample too
+        struct sample_slope_t upper = get_sample_slope(c->anchor, sample, c->tolerance);
+        struct sample_slope_t lower = get_sample_slope(c->anchor, sample, -(int32_t)c->tolerance);
+        c->upper = compare_sample_slopes(upper, c->upper) < 0 ? upper : c->upper;
+        c->lower = compare_sample_slopes(lower, c->lower) > 0 ? lower : c->lower;
+        c->candidate = sample;
+        return SAMPLE_COMPRESSOR_REPLACE;
+    }
+    c->anchor = c->candidate;
+    start_sample_compressor_door(c, sample);
+    return SAMPLE_COMPRESSOR_APPEND;
+}
@@ -0,0 +1,92 @@
+/*
+ * Sample Queue Module
+ * -----------------------------------------------------------------------------
+ * Hands samples from the sampler to the compaction worker without a lock, so
+ * taking a sample never waits on a flash write.
+ *
+ * atomic_get()/atomic_set() are full barriers, so the sample copy is always
+ * visible before the position that publishes it.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "app/sample-queue.h"
+
+LOG_MODULE_REGISTER(sample_queue, LOG_LEVEL_WRN);
+
+BUILD_ASSERT((CONFIG_TEMPERATURE_LOGGER_SAMPLE_QUEUE_SIZE & (CONFIG_TEMPERATURE_LOGGER_SAMPLE_QUEUE_SIZE - 1)) == 0,
+             "The sample queue size must be a power of two");
+
+#define SLOT(position) ((size_t)(position) & (CONFIG_TEMPERATURE_LOGGER_SAMPLE_QUEUE_SIZE - 1))
+
+/**
+ * @brief Adds a sample to the back of the queue.
+ * * Only the producer thread may call this.
+ * * @param q Pointer to the queue.
+ * @param sample The sample to add.
+ * @retval E_SUCCESS Sample added.
+ * @retval E_NOBUFS The queue is full. The sample was not added.
+ * @retval E_NULL_PTR If 'q' is NULL.
+ */
+enum error_e push_sample_queue(struct sample_queue_t *q, struct temperature_sample_t sample)
+{
+    if (q == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    atomic_val_t tail = atomic_get(&q->tail);
+    if ((unsigned long)tail - (unsigned long)atomic_get(&q->head) == CONFIG_TEMPERATURE_LOGGER_SAMPLE_QUEUE_SIZE)
+    {
+        return E_NOBUFS;
+    }
+    q->samples[SLOT(tail)] = sample;
+    atomic_set(&q->tail, (atomic_val_t)((unsigned long)tail + 1));
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Removes the sample at the front of the queue.
+ * * Only the consumer thread may call this.
+ * * @param q Pointer to the queue.
+ * @param sample Pointer to the struct that receives the sample.
+ * @retval E_SUCCESS Sample removed.
+ * @retval E_NODATA The queue is empty.
+ * @retval E_NULL_PTR If 'q' or 'sample' is NULL.
+ */
+enum error_e pop_sample_queue(struct sample_queue_t *q, struct temperature_sample_t *sample)
+{
+    if (q == NULL || sample == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    atomic_val_t head = atomic_get(&q->head);
+    if (head == atomic_get(&q->tail))
+    {
+        return E_NODATA;
+    }
+    *sample = q->samples[SLOT(head)];
+    atomic_set(&q->head, (atomic_val_t)((unsigned long)head + 1));
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Checks if the queue is empty. Safe to call from either thread.
+ */
+bool sample_queue_is_empty(struct sample_queue_t *q)
+{
+    return q == NULL || atomic_get(&q->head) == atomic_get(&q->tail);
+}
+
+/**
+ * @brief Returns the number of samples in the queue. Safe to call from either thread, but may be stale by the time it returns.
+ */
+size_t get_sample_queue_length(struct sample_queue_t *q)
+{
+    if (q == NULL)
+    {
+        return 0;
+    }
+    return (size_t)((unsigned long)atomic_get(&q->tail) - (unsigned long)atomic_get(&q->head));
+}
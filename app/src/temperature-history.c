@@ -0,0 +1,1057 @@
+/*
+ * Temperature History Module
+ * -----------------------------------------------------------------------------
+ * Persists flushed temperature lists in NVS as an append-only ring of segments.
+ *
+ * Rewriting one big history blob on every flush costs a full read-modify-write
+ * and forces NVS garbage collection nearly every time. Instead, a flush writes
+ * exactly one segment (the full RAM list) plus the small index record.
+ *
+ * Layout (every channel has its own ring, see app/temperature-history.h):
+ * - NVS_KEY_TEMPERATURE_HISTORY_INDEX + channel holds struct temperature_history_index_t.
+ * - Segment with sequence number n uses ring slot n % CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT.
+ * - A segment is stored as one NVS record per block of SAMPLE_CODEC_BLOCK_SIZE samples.
+ *   Each record is a struct temperature_block_header_t, a struct temperature_block_summary_t
+ *   and one block packed with the sample codec (see app/sample-codec.h). An empty
+ *   segment is a single record with no samples. Records written before summaries
+ *   were added (SEGMENT_FORMAT_PACKED) have no summary and are still read.
+ *
+ * The summary lets range queries skip or count a whole block from the first few
+ * bytes of its record. Only blocks at the edges of the range are decoded.
+ *
+ * Working one block at a time keeps the RAM cost of reading or writing a segment
+ * to a single block buffer instead of a whole temperature list.
+ *
+ * Segments are always written before the index is updated, so a power loss in
+ * between only leaves an unreferenced record behind. No live segment is ever
+ * rewritten. Compaction writes the merge of the two oldest segments to a spare
+ * slot of the channel, and the index commit that drops the oldest segment makes
+ * it live in place of the second oldest. The two spare slots take turns, so the
+ * one the oldest segment lives in is never written. Every block still carries
+ * the generation of the write that produced it, so a reader that was streaming
+ * a slot while it was reused detects it.
+ *
+ * The index is committed A/B: every write bumps a sequence number, goes to the
+ * slot the sequence number selects (NVS_KEY_TEMPERATURE_HISTORY_INDEX or
+ * NVS_KEY_TEMPERATURE_HISTORY_INDEX_B) and carries a CRC. At boot both slots are
+ * read and the newer valid one wins. An index that cannot be read falls back to
+ * the previous commit instead of an empty history.
+ *
+ * The RAM list that has not been flushed yet is journaled. Every block of
+ * SAMPLE_CODEC_BLOCK_SIZE samples of the list is one record under
+ * NVS_KEY_TEMPERATURE_JOURNAL_BASE, tagged with the sequence number the list
+ * will get when it is flushed. Once the index has moved on, the records are
+ * stale and are never read again, so a flush does not have to clear them.
+ * Recovering the tail at boot reads at most TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT records.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/logging/log.h>
+#include "app/temperature-history.h"
+#include "app/nvs.h"
+#include "app/sample-codec.h"
+#include "app/metrics.h"
+
+LOG_MODULE_REGISTER(temp_history, LOG_LEVEL_DBG);
+
+#define SEGMENT_FORMAT_PACKED 0x02
+#define SEGMENT_FORMAT_SUMMARIZED 0x03
+
+struct temperature_block_header_t
+{
+    uint8_t format;
+    uint8_t generation;       /* low bits of the index generation at the time of the write */
+    uint8_t block;            /* index of this block in the segment */
+    uint8_t block_count;      /* number of blocks in the segment */
+    uint16_t length;          /* number of samples in the segment */
+    uint16_t reserved;
+    sys_minutes_t last_uptime; /* uptime of the last sample in the segment */
+};
+
+struct temperature_block_summary_t
+{
+    sys_minutes_t first_uptime;
+    sys_minutes_t last_uptime;
+    int32_t sum;
+    temperature_t min;
+    temperature_t max;
+};
+
+/* what is stored in either index slot */
+struct temperature_index_record_t
+{
+    struct temperature_history_index_t index;
+    uint32_t sequence; /* bumped on every index write. selects the slot */
+    uint32_t crc;      /* crc32_ieee of everything above */
+};
+
+/* an index record written before the spare slots were added. read as an index without a spare */
+struct temperature_index_record_without_spare_t
+{
+    uint32_t oldest_segment;
+    uint32_t segment_count;
+    uint32_t generation;
+    uint32_t sequence;
+    uint32_t crc;
+};
+
+struct temperature_journal_header_t
+{
+    uint32_t segment; /* sequence number the RAM list gets when it is flushed */
+    uint8_t block;    /* index of this block in the RAM list */
+    uint8_t length;   /* number of samples in this block */
+    uint16_t reserved;
+};
+
+BUILD_ASSERT(sizeof(struct temperature_block_header_t) == TEMPERATURE_HISTORY_BLOCK_HEADER_SIZE);
+BUILD_ASSERT(sizeof(struct temperature_journal_header_t) <= TEMPERATURE_HISTORY_BLOCK_HEADER_SIZE + TEMPERATURE_HISTORY_BLOCK_SUMMARY_SIZE,
+             "A journal record must fit the block buffer.");
+BUILD_ASSERT(sizeof(struct temperature_block_summary_t) == TEMPERATURE_HISTORY_BLOCK_SUMMARY_SIZE);
+BUILD_ASSERT(CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT <= NVS_KEY_TEMPERATURE_HISTORY_INDEX_LAST - NVS_KEY_TEMPERATURE_HISTORY_INDEX + 1,
+             "Not enough NVS keys are reserved for the history indexes.");
+BUILD_ASSERT(sizeof(struct temperature_index_record_without_spare_t) != sizeof(struct temperature_index_record_t),
+             "Index records of either layout must be told apart by their size.");
+BUILD_ASSERT(NVS_KEY_TEMPERATURE_SEGMENT_BASE + CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT * (CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT + TEMPERATURE_HISTORY_SPARE_SLOTS) * TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT <= NVS_KEY_TEMPERATURE_JOURNAL_BASE &&
+                 NVS_KEY_TEMPERATURE_JOURNAL_BASE + CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT * TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT <= NVS_KEY_TEMPERATURE_TIER_BASE,
+             "History blocks and journal blocks overlap in NVS.");
+
+struct temperature_history_data_t
+{
+    struct temperature_history_index_t index[CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT];
+    uint32_t sequence[CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT]; /* sequence number of the last index write */
+    uint8_t block_buffer[TEMPERATURE_HISTORY_BLOCK_RECORD_MAX_SIZE];
+    struct k_mutex lock; /* protects index, sequence and block_buffer */
+};
+
+static struct temperature_history_data_t h_data = {
+    .lock = Z_MUTEX_INITIALIZER(h_data.lock),
+};
+
+static uint16_t slot_block_key(uint32_t slot, uint8_t block)
+{
+    return NVS_KEY_TEMPERATURE_SEGMENT_BASE + (uint16_t)slot * TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT + block;
+}
+
+/**
+ * @brief Returns the slot of spare 'spare' (1 or 2, like temperature_history_index_t.oldest_spare) of a channel.
+ */
+static uint32_t get_spare_slot(size_t channel, uint32_t spare)
+{
+    return CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT * CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT + channel * TEMPERATURE_HISTORY_SPARE_SLOTS + spare - 1;
+}
+
+/**
+ * @brief Returns the slot a segment lives in. The caller MUST hold h_data.lock.
+ * * Only the oldest segment can live in a spare slot. Every other segment lives in its ring slot.
+ */
+static uint32_t get_segment_slot_without_locking(size_t channel, uint32_t segment)
+{
+    const struct temperature_history_index_t *index = &h_data.index[channel];
+    if (segment == index->oldest_segment && index->oldest_spare != 0)
+    {
+        return get_spare_slot(channel, index->oldest_spare);
+    }
+    return channel * CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT + segment % CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT;
+}
+
+/**
+ * @brief Returns the NVS key of one block of a segment. The caller MUST hold h_data.lock.
+ */
+static uint16_t block_key(size_t channel, uint32_t segment, uint8_t block)
+{
+    return slot_block_key(get_segment_slot_without_locking(channel, segment), block);
+}
+
+static uint16_t journal_key(size_t channel, uint8_t block)
+{
+    return NVS_KEY_TEMPERATURE_JOURNAL_BASE + channel * TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT + block;
+}
+
+static uint16_t index_key(size_t channel, uint32_t sequence)
+{
+    return (sequence & 1) ? NVS_KEY_TEMPERATURE_HISTORY_INDEX_B + channel : NVS_KEY_TEMPERATURE_HISTORY_INDEX + channel;
+}
+
+static uint32_t get_index_record_crc(const struct temperature_index_record_t *record)
+{
+    return crc32_ieee((const uint8_t *)record, offsetof(struct temperature_index_record_t, crc));
+}
+
+/**
+ * @brief Writes the index of one channel to the slot that is not the newest. The caller MUST hold h_data.lock.
+ * * If the write is interrupted, the other slot still holds the previous commit.
+ */
+static enum error_e store_index_without_locking(size_t channel, struct temperature_history_index_t *index)
+{
+    // the generation is only ever advanced by store_temperature_segment()
+    index->generation = h_data.index[channel].generation;
+    struct temperature_index_record_t record = {
+        .index = *index,
+        .sequence = h_data.sequence[channel] + 1,
+    };
+    record.crc = get_index_record_crc(&record);
+    ssize_t bytes_written = write_nvs(index_key(channel, record.sequence), &record, sizeof(record));
+    if (bytes_written != sizeof(record) && bytes_written != 0)
+    {
+        LOG_ERR("Failed to write history index of channel %d to NVS. Error %d.", (int)channel, (int)bytes_written);
+        return E_ERROR;
+    }
+    memcpy(&h_data.index[channel], index, sizeof(struct temperature_history_index_t));
+    h_data.sequence[channel] = record.sequence;
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Reads and checks one index slot.
+ * * An index written before the A/B commit (a bare index in slot A) is read as sequence number 0.
+ * Records written before the spare slots were added are read with every segment in its ring slot.
+ * * @retval E_SUCCESS 'record' holds a valid index.
+ * @retval E_NOENT The slot is empty.
+ * @retval E_ERROR The slot holds a torn or corrupted index.
+ */
+static enum error_e read_index_record(size_t channel, uint32_t slot, struct temperature_index_record_t *record)
+{
+    struct nvs_fs *fs = get_nvs_fs();
+    memset(record, 0, sizeof(struct temperature_index_record_t));
+    ssize_t bytes_read = nvs_read(fs, index_key(channel, slot), record, sizeof(struct temperature_index_record_t));
+    if (bytes_read == -ENOENT)
+    {
+        return E_NOENT;
+    }
+    if (bytes_read == sizeof(struct temperature_index_record_without_spare_t))
+    {
+        struct temperature_index_record_without_spare_t old;
+        memcpy(&old, record, sizeof(old));
+        if (old.crc != crc32_ieee((const uint8_t *)&old, offsetof(struct temperature_index_record_without_spare_t, crc)))
+        {
+            return E_ERROR;
+        }
+        *record = (struct temperature_index_record_t){
+            .index = {.oldest_segment = old.oldest_segment, .segment_count = old.segment_count, .generation = old.generation},
+            .sequence = old.sequence,
+        };
+    }
+    else
+    {
+        // the bare legacy index has no spare either. the memset above leaves it at 0
+        bool legacy = bytes_read == offsetof(struct temperature_index_record_without_spare_t, sequence) && slot == 0;
+        if (!legacy && (bytes_read != sizeof(struct temperature_index_record_t) || record->crc != get_index_record_crc(record)))
+        {
+            return E_ERROR;
+        }
+    }
+    bool valid = record->index.segment_count <= CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT && record->index.oldest_spare <= TEMPERATURE_HISTORY_SPARE_SLOTS &&
+                 (record->index.oldest_spare == 0 || record->index.segment_count > 0);
+    return valid ? E_SUCCESS : E_ERROR;
+}
+
+/**
+ * @brief Loads the newer valid slot of the history index of one channel from NVS. The caller MUST hold h_data.lock.
+ */
+static enum error_e load_index_without_locking(size_t channel)
+{
+    struct temperature_index_record_t records[2];
+    enum error_e errs[2];
+    for (uint32_t slot = 0; slot < 2; slot++)
+    {
+        errs[slot] = read_index_record(channel, slot, &records[slot]);
+    }
+    if (errs[0] == E_NOENT && errs[1] == E_NOENT)
+    {
+        if (channel == 0)
+        {
+            // first boot with segmented history
+            delete_nvs(NVS_KEY_TEMPERATURE_DATA);
+        }
+        memset(&h_data.index[channel], 0, sizeof(struct temperature_history_index_t));
+        h_data.sequence[channel] = 0;
+        struct temperature_history_index_t index = {0};
+        return store_index_without_locking(channel, &index);
+    }
+    if (errs[0] != E_SUCCESS && errs[1] != E_SUCCESS)
+    {
+        LOG_ERR("Both history index slots of channel %d in NVS are invalid.", (int)channel);
+        memset(&h_data.index[channel], 0, sizeof(struct temperature_history_index_t));
+        h_data.sequence[channel] = 0;
+        return E_ERROR;
+    }
+
+    size_t newest;
+    if (errs[0] == E_SUCCESS && errs[1] == E_SUCCESS)
+    {
+        // sequence numbers wrap, so compare the distance instead of the values
+        newest = (int32_t)(records[1].sequence - records[0].sequence) > 0 ? 1 : 0;
+    }
+    else
+    {
+        newest = errs[0] == E_SUCCESS ? 0 : 1;
+        if (errs[1 - newest] == E_ERROR)
+        {
+            LOG_WRN("A history index slot of channel %d is invalid. Using commit %u.", (int)channel, records[newest].sequence);
+        }
+    }
+    memcpy(&h_data.index[channel], &records[newest].index, sizeof(struct temperature_history_index_t));
+    h_data.sequence[channel] = records[newest].sequence;
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Loads the history indexes of all channels from NVS.
+ * Initialize NVS before calling this function.
+ * * If a channel has no index yet, an empty one is created. The legacy
+ * single-blob history record is deleted along with creating the index of channel 0.
+ * If only one slot of an index is valid, that commit is used.
+ * * @retval E_SUCCESS All indexes loaded or created.
+ * @retval E_ERROR Neither slot of an index could be read. That channel starts empty. The other channels are still loaded.
+ */
+enum error_e init_temperature_history(void)
+{
+    enum error_e err = E_SUCCESS;
+    k_mutex_lock(&h_data.lock, K_FOREVER);
+    for (size_t channel = 0; channel < CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT; channel++)
+    {
+        if (load_index_without_locking(channel) != E_SUCCESS)
+        {
+            err = E_ERROR;
+        }
+    }
+    k_mutex_unlock(&h_data.lock);
+    return err;
+}
+
+/**
+ * @brief Copies the current history index of one channel.
+ * * @param channel The channel. Out of range channels are ignored.
+ * @param index Pointer to the struct that receives the copy.
+ */
+void get_temperature_history_index(size_t channel, struct temperature_history_index_t *index)
+{
+    if (index == NULL || channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        return;
+    }
+    k_mutex_lock(&h_data.lock, K_FOREVER);
+    memcpy(index, &h_data.index[channel], sizeof(struct temperature_history_index_t));
+    k_mutex_unlock(&h_data.lock);
+}
+
+static size_t get_block_data_offset(uint8_t format)
+{
+    size_t offset = sizeof(struct temperature_block_header_t);
+    return format == SEGMENT_FORMAT_SUMMARIZED ? offset + sizeof(struct temperature_block_summary_t) : offset;
+}
+
+/**
+ * @brief Checks a block header against the header of block 0 of the same segment.
+ * * @param header The header to check.
+ * @param first The header of block 0. For block 0 itself, this is 'header'.
+ * @param block The index the block was read for.
+ * @param bytes_read The size of the record.
+ */
+static bool block_header_is_valid(const struct temperature_block_header_t *header, const struct temperature_block_header_t *first, uint8_t block, ssize_t bytes_read)
+{
+    if (header->format != SEGMENT_FORMAT_PACKED && header->format != SEGMENT_FORMAT_SUMMARIZED)
+    {
+        return false;
+    }
+    return bytes_read >= (ssize_t)get_block_data_offset(header->format) && bytes_read <= TEMPERATURE_HISTORY_BLOCK_RECORD_MAX_SIZE &&
+           header->block == block && header->generation == first->generation &&
+           header->block_count == first->block_count && header->length == first->length &&
+           header->block_count <= TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT && header->length <= CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE;
+}
+
+/**
+ * @brief Reads one block record of the reader's segment into its buffer and checks it.
+ * * @retval E_SUCCESS Block loaded. The decoder is ready.
+ * @retval E_NOENT The segment does not exist.
+ * @retval E_ERROR Read failed, or the block does not belong to the same write as block 0.
+ */
+static enum error_e load_segment_block(struct temperature_segment_reader_t *reader, uint8_t block)
+{
+    struct nvs_fs *fs = get_nvs_fs();
+    struct temperature_block_header_t header;
+    k_mutex_lock(&h_data.lock, K_FOREVER);
+    uint16_t key = block_key(reader->channel, reader->segment, block);
+    k_mutex_unlock(&h_data.lock);
+    uint32_t start = begin_metrics_phase();
+    ssize_t bytes_read = nvs_read(fs, key, reader->buffer, sizeof(reader->buffer));
+    end_metrics_phase(METRICS_PHASE_BLOCK_LOAD, start);
+    if (bytes_read == -ENOENT && block == 0)
+    {
+        return E_NOENT;
+    }
+    if (bytes_read < (ssize_t)sizeof(header) || (size_t)bytes_read > sizeof(reader->buffer))
+    {
+        LOG_ERR("Failed to load block %u of history segment %u from NVS. Read %d bytes.", block, reader->segment, (int)bytes_read);
+        return E_ERROR;
+    }
+    memcpy(&header, reader->buffer, sizeof(header));
+
+    if (block == 0)
+    {
+        reader->generation = header.generation;
+        reader->block_count = header.block_count;
+        reader->length = header.length;
+        reader->last_uptime = header.last_uptime;
+    }
+    struct temperature_block_header_t first = {
+        .generation = reader->generation,
+        .block_count = reader->block_count,
+        .length = reader->length,
+    };
+    if (!block_header_is_valid(&header, &first, block, bytes_read))
+    {
+        LOG_ERR("Block %u of history segment %u is corrupted or from an interrupted write.", block, reader->segment);
+        return E_ERROR;
+    }
+    reader->block = block;
+    size_t offset = get_block_data_offset(header.format);
+    init_sample_decoder(&reader->decoder, &reader->buffer[offset], bytes_read - offset);
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Decodes the next sample of the segment into reader->next, loading the next block when needed.
+ * * @retval E_SUCCESS reader->next holds the next sample.
+ * @retval E_END_OF_ITER All samples have been decoded.
+ * @retval E_ERROR The segment is corrupted.
+ */
+static enum error_e decode_next_sample(struct temperature_segment_reader_t *reader)
+{
+    while (true)
+    {
+        enum error_e err = decode_sample(&reader->decoder, &reader->next);
+        if (err == E_SUCCESS)
+        {
+            return E_SUCCESS;
+        }
+        if (err != E_END_OF_ITER)
+        {
+            LOG_ERR("Block %u of history segment %u could not be decoded.", reader->block, reader->segment);
+            return E_ERROR;
+        }
+        if (reader->block + 1 >= reader->block_count)
+        {
+            return E_END_OF_ITER;
+        }
+        err = load_segment_block(reader, reader->block + 1);
+        if (err != E_SUCCESS)
+        {
+            return E_ERROR;
+        }
+    }
+}
+
+/**
+ * @brief Opens one history segment for streaming.
+ * * Only the first block is read. The rest are read on demand by read_temperature_segment().
+ * * @param reader Pointer to the reader to initialize.
+ * @param channel The channel the segment belongs to.
+ * @param segment Sequence number of the segment.
+ * @retval E_SUCCESS Segment opened. reader->length holds its number of samples.
+ * @retval E_NOENT The segment does not exist.
+ * @retval E_RANGE The channel does not exist.
+ * @retval E_ERROR Read failed due to NVS error or a corrupted segment.
+ * @retval E_NULL_PTR If 'reader' is NULL.
+ */
+enum error_e open_temperature_segment(struct temperature_segment_reader_t *reader, size_t channel, uint32_t segment)
+{
+    if (reader == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        reader->length = 0;
+        return E_RANGE;
+    }
+
+    reader->channel = channel;
+    reader->segment = segment;
+    reader->consumed = 0;
+    enum error_e err = load_segment_block(reader, 0);
+    if (err != E_SUCCESS)
+    {
+        reader->length = 0;
+        return err;
+    }
+    if (reader->length == 0)
+    {
+        return E_SUCCESS;
+    }
+    err = decode_next_sample(reader);
+    if (err != E_SUCCESS)
+    {
+        reader->length = 0;
+        return E_ERROR;
+    }
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Returns the next sample of the segment without consuming it.
+ * * @param reader Pointer to an opened reader.
+ * @param sample Pointer to the struct that receives the sample.
+ * @retval E_SUCCESS Sample returned.
+ * @retval E_END_OF_ITER All samples have been read.
+ * @retval E_NULL_PTR If 'reader' or 'sample' is NULL.
+ */
+enum error_e peek_temperature_segment(struct temperature_segment_reader_t *reader, struct temperature_sample_t *sample)
+{
+    if (reader == NULL || sample == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (reader->consumed == reader->length)
+    {
+        return E_END_OF_ITER;
+    }
+    *sample = reader->next;
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Returns the next sample of the segment and advances the reader.
+ * * @param reader Pointer to an opened reader.
+ * @param sample Pointer to the struct that receives the sample. May be NULL to skip a sample.
+ * @retval E_SUCCESS Sample returned.
+ * @retval E_END_OF_ITER All samples have been read.
+ * @retval E_ERROR The rest of the segment is corrupted. The reader stops.
+ * @retval E_NULL_PTR If 'reader' is NULL.
+ */
+enum error_e read_temperature_segment(struct temperature_segment_reader_t *reader, struct temperature_sample_t *sample)
+{
+    if (reader == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (reader->consumed == reader->length)
+    {
+        return E_END_OF_ITER;
+    }
+    if (sample != NULL)
+    {
+        *sample = reader->next;
+    }
+    reader->consumed++;
+    if (reader->consumed == reader->length)
+    {
+        return E_SUCCESS;
+    }
+    if (decode_next_sample(reader) != E_SUCCESS)
+    {
+        // the header promised more samples than the blocks hold
+        reader->length = reader->consumed;
+        return E_ERROR;
+    }
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Returns the packed samples of one block of an opened segment, exactly as they are stored in NVS.
+ * * The data points into the reader's buffer and stays valid until the reader is used again.
+ * It is one block of the sample codec, so the blocks of a segment can be concatenated and
+ * decoded as one stream. Do not mix this with read_temperature_segment() on the same reader.
+ * * @param reader Pointer to an opened reader.
+ * @param block Index of the block. Blocks are cheapest to read in order.
+ * @param data Pointer that receives the start of the packed samples.
+ * @param size Pointer that receives the number of packed bytes. 0 for an empty segment.
+ * @retval E_SUCCESS Block returned.
+ * @retval E_END_OF_ITER The segment has no such block.
+ * @retval E_ERROR The block is corrupted or from a different write than block 0.
+ * @retval E_NULL_PTR If 'reader', 'data' or 'size' is NULL.
+ */
+enum error_e read_temperature_segment_block(struct temperature_segment_reader_t *reader, uint8_t block, const uint8_t **data, size_t *size)
+{
+    if (reader == NULL || data == NULL || size == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (block >= reader->block_count)
+    {
+        return E_END_OF_ITER;
+    }
+    if (block != reader->block && load_segment_block(reader, block) != E_SUCCESS)
+    {
+        return E_ERROR;
+    }
+    *data = reader->decoder.buffer;
+    *size = reader->decoder.size;
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Writes a list to one slot, one block record at a time. The caller MUST hold h_data.lock and the list's lock.
+ */
+static enum error_e store_segment_without_locking(size_t channel, uint32_t segment, uint32_t slot, struct temperature_list_t *t)
+{
+    struct sample_encoder_t encoder;
+    enum error_e err = E_SUCCESS;
+    size_t total_size = 0;
+    uint32_t start = begin_metrics_phase();
+
+    h_data.index[channel].generation++;
+    struct temperature_block_header_t header = {
+        .format = SEGMENT_FORMAT_SUMMARIZED,
+        .generation = (uint8_t)h_data.index[channel].generation,
+        .block_count = MAX(1, DIV_ROUND_UP(t->length, SAMPLE_CODEC_BLOCK_SIZE)),
+        .length = (uint16_t)t->length,
+        .last_uptime = t->length > 0 ? t->uptime[t->length - 1] : 0,
+    };
+
+    size_t offset = get_block_data_offset(header.format);
+    for (size_t block = 0; block < header.block_count; block++)
+    {
+        header.block = (uint8_t)block;
+        memcpy(h_data.block_buffer, &header, sizeof(header));
+        init_sample_encoder(&encoder, &h_data.block_buffer[offset], sizeof(h_data.block_buffer) - offset);
+        size_t first = block * SAMPLE_CODEC_BLOCK_SIZE;
+        size_t end = MIN(t->length, first + SAMPLE_CODEC_BLOCK_SIZE);
+        struct temperature_block_summary_t summary = {
+            .first_uptime = end > first ? t->uptime[first] : 0,
+            .last_uptime = end > first ? t->uptime[end - 1] : 0,
+            .min = INT16_MAX,
+            .max = INT16_MIN,
+        };
+        for (size_t i = first; i < end; i++)
+        {
+            err = encode_sample(&encoder, get_temperature_list_sample(t, i));
+            if (err != E_SUCCESS)
+            {
+                // cant happen. the buffer fits the worst case
+                LOG_ERR("Failed to encode history segment %u of channel %d.", segment, (int)channel);
+                return err;
+            }
+            summary.sum += t->temperature[i];
+            summary.min = MIN(summary.min, t->temperature[i]);
+            summary.max = MAX(summary.max, t->temperature[i]);
+        }
+        memcpy(&h_data.block_buffer[sizeof(header)], &summary, sizeof(summary));
+
+        size_t size = offset + encoder.size;
+        ssize_t bytes_written = write_nvs(slot_block_key(slot, header.block), h_data.block_buffer, size);
+        if ((size_t)bytes_written != size && bytes_written != 0)
+        {
+            LOG_ERR("Failed to write history segment %u of channel %d to NVS. Expected to write %d bytes or 0 bytes. Wrote %d bytes.", segment, (int)channel, (int)size, (int)bytes_written);
+            return E_ERROR;
+        }
+        total_size += size;
+    }
+    LOG_DBG("Stored history segment %u of channel %d. %d samples in %d bytes.", segment, (int)channel, (int)t->length, (int)total_size);
+    end_metrics_phase(METRICS_PHASE_SEGMENT_STORE, start);
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Writes the provided list to NVS as one history segment, one block record at a time.
+ * * The segment goes to the slot it lives in. This does not touch the index. Use
+ * append_temperature_segment() to add a new segment.
+ * ASSUMPTION: The caller MUST hold the list's lock before calling.
+ * * @param channel The channel the segment belongs to.
+ * @param segment Sequence number of the segment.
+ * @param t Pointer to the list structure whose data will be stored.
+ * @retval E_SUCCESS Data successfully written.
+ * @retval E_RANGE The channel does not exist.
+ * @retval E_ERROR Write failed due to NVS error.
+ * @retval E_NULL_PTR If 't' is NULL.
+ */
+enum error_e store_temperature_segment(size_t channel, uint32_t segment, struct temperature_list_t *t)
+{
+    if (t == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        return E_RANGE;
+    }
+
+    k_mutex_lock(&h_data.lock, K_FOREVER);
+    enum error_e err = store_segment_without_locking(channel, segment, get_segment_slot_without_locking(channel, segment), t);
+    k_mutex_unlock(&h_data.lock);
+    return err;
+}
+
+/**
+ * @brief Stores the provided list as the newest history segment.
+ * * The caller MUST make room first (see drop_oldest_temperature_segment()) if all
+ * CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT segments are in use.
+ * ASSUMPTION: The caller MUST hold the list's lock before calling.
+ * * @param channel The channel the segment belongs to.
+ * @param t Pointer to the list structure whose data will be stored.
+ * @retval E_SUCCESS Segment and index successfully written.
+ * @retval E_NOSPC All segments of the channel are in use.
+ * @retval E_RANGE The channel does not exist.
+ * @retval E_ERROR Write failed due to NVS error.
+ * @retval E_NULL_PTR If 't' is NULL.
+ */
+enum error_e append_temperature_segment(size_t channel, struct temperature_list_t *t)
+{
+    if (t == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        return E_RANGE;
+    }
+
+    enum error_e err;
+    k_mutex_lock(&h_data.lock, K_FOREVER);
+    struct temperature_history_index_t index = h_data.index[channel];
+    if (index.segment_count == CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT)
+    {
+        err = E_NOSPC;
+        goto unlock;
+    }
+    err = store_temperature_segment(channel, index.oldest_segment + index.segment_count, t);
+    if (err != E_SUCCESS)
+    {
+        goto unlock;
+    }
+    index.segment_count++;
+    err = store_index_without_locking(channel, &index);
+unlock:
+    k_mutex_unlock(&h_data.lock);
+    return err;
+}
+
+/**
+ * @brief Removes the oldest segment from the history of one channel.
+ * * Only the index is rewritten. The record is left in place and gets reused.
+ * * @param channel The channel.
+ * @retval E_SUCCESS Index successfully updated.
+ * @retval E_NODATA The history is empty.
+ * @retval E_RANGE The channel does not exist.
+ * @retval E_ERROR Write failed due to NVS error.
+ */
+enum error_e drop_oldest_temperature_segment(size_t channel)
+{
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        return E_RANGE;
+    }
+
+    enum error_e err;
+    k_mutex_lock(&h_data.lock, K_FOREVER);
+    struct temperature_history_index_t index = h_data.index[channel];
+    if (index.segment_count == 0)
+    {
+        err = E_NODATA;
+        goto unlock;
+    }
+    index.oldest_segment++;
+    index.segment_count--;
+    // the next oldest segment always lives in its ring slot
+    index.oldest_spare = 0;
+    err = store_index_without_locking(channel, &index);
+unlock:
+    k_mutex_unlock(&h_data.lock);
+    return err;
+}
+
+/**
+ * @brief Replaces the two oldest segments of a channel with one, without rewriting either of them.
+ * * The list is written to the spare slot the oldest segment does not live in. The index commit that
+ * drops the oldest segment then makes it the new oldest segment, in place of the second oldest.
+ * A power loss before the commit keeps both segments, one after it keeps the merged one.
+ * ASSUMPTION: The caller MUST hold the list's lock before calling.
+ * * @param channel The channel.
+ * @param t Pointer to the list that holds the merge of the two oldest segments.
+ * @retval E_SUCCESS Segment and index successfully written.
+ * @retval E_NODATA The history has fewer than two segments.
+ * @retval E_RANGE The channel does not exist.
+ * @retval E_ERROR Write failed due to NVS error. Both segments are still live.
+ * @retval E_NULL_PTR If 't' is NULL.
+ */
+enum error_e compact_oldest_temperature_segments(size_t channel, struct temperature_list_t *t)
+{
+    if (t == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        return E_RANGE;
+    }
+
+    enum error_e err;
+    k_mutex_lock(&h_data.lock, K_FOREVER);
+    struct temperature_history_index_t index = h_data.index[channel];
+    if (index.segment_count < 2)
+    {
+        err = E_NODATA;
+        goto unlock;
+    }
+    uint32_t spare = index.oldest_spare == 1 ? 2 : 1;
+    err = store_segment_without_locking(channel, index.oldest_segment + 1, get_spare_slot(channel, spare), t);
+    if (err != E_SUCCESS)
+    {
+        goto unlock;
+    }
+    index.oldest_segment++;
+    index.segment_count--;
+    index.oldest_spare = spare;
+    err = store_index_without_locking(channel, &index);
+unlock:
+    k_mutex_unlock(&h_data.lock);
+    return err;
+}
+
+/**
+ * @brief Journals the samples of a RAM list from 'first' on.
+ * * Every block of SAMPLE_CODEC_BLOCK_SIZE samples of the list is one journal record. Only the
+ * blocks that hold samples from 'first' on are written, so a full block is written once.
+ * The records are tagged with the sequence number the list gets when it is appended.
+ * ASSUMPTION: The caller MUST hold the list's lock before calling.
+ * * @param channel The channel the list belongs to.
+ * @param t Pointer to the list structure whose data will be journaled.
+ * @param first Index of the first sample that is not in the journal yet.
+ * @retval E_SUCCESS Data successfully written.
+ * @retval E_RANGE The channel does not exist.
+ * @retval E_ERROR Write failed due to NVS error.
+ * @retval E_NULL_PTR If 't' is NULL.
+ */
+enum error_e store_temperature_journal(size_t channel, struct temperature_list_t *t, size_t first)
+{
+    if (t == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        return E_RANGE;
+    }
+
+    struct sample_encoder_t encoder;
+    enum error_e err = E_SUCCESS;
+    const size_t offset = sizeof(struct temperature_journal_header_t);
+
+    k_mutex_lock(&h_data.lock, K_FOREVER);
+    struct temperature_journal_header_t header = {
+        .segment = h_data.index[channel].oldest_segment + h_data.index[channel].segment_count,
+    };
+    for (size_t block = first / SAMPLE_CODEC_BLOCK_SIZE; block * SAMPLE_CODEC_BLOCK_SIZE < t->length; block++)
+    {
+        size_t start = block * SAMPLE_CODEC_BLOCK_SIZE;
+        size_t end = MIN(t->length, start + SAMPLE_CODEC_BLOCK_SIZE);
+        header.block = (uint8_t)block;
+        header.length = (uint8_t)(end - start);
+        memcpy(h_data.block_buffer, &header, sizeof(header));
+        init_sample_encoder(&encoder, &h_data.block_buffer[offset], sizeof(h_data.block_buffer) - offset);
+        for (size_t i = start; i < end; i++)
+        {
+            err = encode_sample(&encoder, get_temperature_list_sample(t, i));
+            if (err != E_SUCCESS)
+            {
+                // cant happen. the buffer fits the worst case
+                LOG_ERR("Failed to encode journal block %d of channel %d.", (int)block, (int)channel);
+                goto unlock;
+            }
+        }
+
+        size_t size = offset + encoder.size;
+        ssize_t bytes_written = write_nvs(journal_key(channel, header.block), h_data.block_buffer, size);
+        if ((size_t)bytes_written != size && bytes_written != 0)
+        {
+            LOG_ERR("Failed to write journal block %d of channel %d to NVS. Error %d.", (int)block, (int)channel, (int)bytes_written);
+            err = E_ERROR;
+            goto unlock;
+        }
+    }
+unlock:
+    k_mutex_unlock(&h_data.lock);
+    return err;
+}
+
+/**
+ * @brief Reads the samples journaled since the last flush of a channel into an empty RAM list.
+ * * Records that are not tagged with the sequence number of the next segment were flushed
+ * already and are skipped. Reading stops at the first missing, stale or corrupted block, or
+ * after the first block that is not full. The summary of the list is not updated.
+ * ASSUMPTION: The caller MUST hold the list's lock before calling.
+ * * @param channel The channel the list belongs to.
+ * @param t Pointer to the list structure that receives the samples. Its length MUST be 0.
+ * @retval E_SUCCESS All journaled samples are in 't'. There may be none.
+ * @retval E_RANGE The channel does not exist.
+ * @retval E_NULL_PTR If 't' is NULL.
+ */
+enum error_e load_temperature_journal(size_t channel, struct temperature_list_t *t)
+{
+    if (t == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        return E_RANGE;
+    }
+
+    struct nvs_fs *fs = get_nvs_fs();
+    struct sample_decoder_t decoder;
+    struct temperature_sample_t sample;
+    struct temperature_journal_header_t header;
+    const size_t offset = sizeof(struct temperature_journal_header_t);
+
+    k_mutex_lock(&h_data.lock, K_FOREVER);
+    uint32_t segment = h_data.index[channel].oldest_segment + h_data.index[channel].segment_count;
+    for (uint8_t block = 0; block < TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT; block++)
+    {
+        ssize_t bytes_read = nvs_read(fs, journal_key(channel, block), h_data.block_buffer, sizeof(h_data.block_buffer));
+        if (bytes_read < (ssize_t)offset || (size_t)bytes_read > sizeof(h_data.block_buffer))
+        {
+            break;
+        }
+        memcpy(&header, h_data.block_buffer, sizeof(header));
+        if (header.segment != segment || header.block != block || header.length == 0 || header.length > SAMPLE_CODEC_BLOCK_SIZE)
+        {
+            break;
+        }
+
+        size_t start = t->length;
+        init_sample_decoder(&decoder, &h_data.block_buffer[offset], bytes_read - offset);
+        while (t->length < CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE && decode_sample(&decoder, &sample) == E_SUCCESS)
+        {
+            set_temperature_list_sample(t, t->length++, sample);
+        }
+        if (t->length - start != header.length)
+        {
+            LOG_ERR("Journal block %u of channel %d could not be decoded.", block, (int)channel);
+            t->length = start;
+            break;
+        }
+        if (header.length < SAMPLE_CODEC_BLOCK_SIZE)
+        {
+            break;
+        }
+    }
+    k_mutex_unlock(&h_data.lock);
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Adds the samples of a segment whose uptime lies in [start, end] to 'stats'.
+ * * Only the header and summary of each block are read, unless the block is at an edge of
+ * the range or has no summary. Then the whole block is read and decoded.
+ * The samples of every block MUST be sorted by uptime.
+ * * @param channel The channel the segment belongs to.
+ * @param segment Sequence number of the segment.
+ * @param start First uptime of the range.
+ * @param end Last uptime of the range.
+ * @param stats Pointer to the stats to add to.
+ * @retval E_SUCCESS Query successful.
+ * @retval E_NOENT The segment does not exist.
+ * @retval E_RANGE The channel does not exist.
+ * @retval E_ERROR Read failed due to NVS error or a corrupted segment. Blocks before the error were added.
+ * @retval E_NULL_PTR If 'stats' is NULL.
+ */
+enum error_e query_temperature_segment(size_t channel, uint32_t segment, sys_minutes_t start, sys_minutes_t end, struct temperature_stats_t *stats)
+{
+    if (stats == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        return E_RANGE;
+    }
+
+    struct nvs_fs *fs = get_nvs_fs();
+    struct temperature_block_header_t first = {0};
+    struct temperature_block_header_t header;
+    struct temperature_block_summary_t summary;
+    struct sample_decoder_t decoder;
+    struct temperature_sample_t sample;
+    enum error_e err = E_SUCCESS;
+
+    k_mutex_lock(&h_data.lock, K_FOREVER);
+    for (uint8_t block = 0; block == 0 || block < first.block_count; block++)
+    {
+        uint16_t key = block_key(channel, segment, block);
+        ssize_t bytes_read = nvs_read(fs, key, h_data.block_buffer, sizeof(header) + sizeof(summary));
+        if (bytes_read == -ENOENT && block == 0)
+        {
+            err = E_NOENT;
+            goto unlock;
+        }
+        if (bytes_read < (ssize_t)sizeof(header))
+        {
+            err = E_ERROR;
+            goto unlock;
+        }
+        memcpy(&header, h_data.block_buffer, sizeof(header));
+        if (block == 0)
+        {
+            first = header;
+        }
+        if (!block_header_is_valid(&header, &first, block, bytes_read))
+        {
+            LOG_ERR("Block %u of history segment %u is corrupted or from an interrupted write.", block, segment);
+            err = E_ERROR;
+            goto unlock;
+        }
+        if (header.length == 0)
+        {
+            break;
+        }
+
+        if (header.format == SEGMENT_FORMAT_SUMMARIZED)
+        {
+            memcpy(&summary, &h_data.block_buffer[sizeof(header)], sizeof(summary));
+            if (summary.last_uptime < start || summary.first_uptime > end)
+            {
+                continue;
+            }
+            if (summary.first_uptime >= start && summary.last_uptime <= end)
+            {
+                struct temperature_stats_t block_stats = {
+                    .min = summary.min,
+                    .max = summary.max,
+                    .sum = summary.sum,
+                    .count = MIN(SAMPLE_CODEC_BLOCK_SIZE, header.length - block * SAMPLE_CODEC_BLOCK_SIZE),
+                };
+                add_temperature_stats(stats, &block_stats);
+                continue;
+            }
+        }
+
+        // an edge of the range, or a block without a summary
+        bytes_read = nvs_read(fs, key, h_data.block_buffer, sizeof(h_data.block_buffer));
+        size_t offset = get_block_data_offset(header.format);
+        if (bytes_read < (ssize_t)offset || (size_t)bytes_read > sizeof(h_data.block_buffer))
+        {
+            err = E_ERROR;
+            goto unlock;
+        }
+        init_sample_decoder(&decoder, &h_data.block_buffer[offset], bytes_read - offset);
+        while ((err = decode_sample(&decoder, &sample)) == E_SUCCESS)
+        {
+            if (sample.uptime >= start && sample.uptime <= end)
+            {
+                add_temperature_stats_sample(stats, sample.temperature);
+            }
+        }
+        if (err != E_END_OF_ITER)
+        {
+            LOG_ERR("Block %u of history segment %u could not be decoded.", block, segment);
+            err = E_ERROR;
+            goto unlock;
+        }
+        err = E_SUCCESS;
+    }
+unlock:
+    k_mutex_unlock(&h_data.lock);
+    return err;
+}
@@ -5,55 +5,153 @@
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
 #include <zephyr/fs/nvs.h>
-#include <zephyr/drivers/sensor.h>
 #include <zephyr/logging/log.h>
 #include "app/error.h"
 #include "app/temperature-logger.h"
-#include "app/nvs.h"
-#include "app/lock.h"
+#include "app/temperature-history.h"
+#include "app/temperature-tiers.h"
+#include "app/sample-queue.h"
+#include "app/workqueue.h"
+#include "app/sample-compressor.h"
+#include "app/ds18b20.h"
+#include "app/uplink.h"
+#include "app/metrics.h"
+#include "app/time.h"
 #include "app/test.h"
 
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
 LOG_MODULE_REGISTER(temp_log, LOG_LEVEL_DBG);
 
-struct temperature_logger_data_t
+#ifdef CONFIG_TEMPERATURE_LOGGER_COMPRESSION
+#define INGEST_COMPRESSION_TOLERANCE CONFIG_TEMPERATURE_LOGGER_COMPRESSION_TOLERANCE
+#else
+#define INGEST_COMPRESSION_TOLERANCE 0 /* the compressors are reset, but never run */
+#endif
+
+#define INJECT_RETRY_DELAY K_MSEC(1)
+#define INJECT_STEP (INGEST_COMPRESSION_TOLERANCE + 1) /* injected samples zigzag by this much, so the compressor keeps them all */
+
+BUILD_ASSERT(CONFIG_TEMPERATURE_LOGGER_MIN_SAMPLING_PERIOD <= CONFIG_TEMPERATURE_LOGGER_MAX_SAMPLING_PERIOD,
+             "The minimum sampling period must not be longer than the maximum.");
+
+/* one per DS18B20 on the bus */
+struct temperature_channel_t
 {
     struct temperature_list_t temperature_list;
-    struct temperature_list_t scratch_temperature_list; /* used when operating on nvs data */
-    struct device *temperature_sensor;
-    struct k_work_delayable sampling_task;
+    struct sample_queue_t sample_queue;      /* sampler -> compaction worker */
+    temperature_t last_temperature;          /* last reading. only used by the sampler */
+    bool has_last_temperature;
+    sys_minutes_t last_pushed_time;          /* time of the last sample pushed onto sample_queue. only used by the sampler */
+    size_t journaled_length;                 /* samples of temperature_list already in the journal. protected by its lock */
+    size_t unjournaled_count;                /* samples appended or replaced since the last journal write. protected by its lock */
+    size_t recovered_length;                 /* samples the journal brought back at boot. set once by load_temperature_logger_history() */
+    uint32_t recovered_segment;              /* segment the recovered samples were flushed into */
+    struct sample_compressor_t compressor;   /* ingest compression. protected by temperature_list.lock */
+};
+
+struct temperature_logger_data_t
+{
+    struct temperature_channel_t channels[CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT];
+    struct temperature_segment_reader_t compaction_readers[2]; /* shared by all channels. only used by the compaction worker */
+    struct temperature_tier_reader_t query_tier_reader;         /* protected by query_lock */
+    struct k_mutex query_lock;
+    atomic_t history_loaded;                 /* set by load_temperature_logger_history(). nothing is drained before */
+    sys_minutes_t restored_time;             /* samples before this time were taken before the clock was restored from the history */
+    sys_minutes_t restore_shift;             /* minutes the clock was moved forward when it was restored */
+    sys_minutes_t conversion_time;           /* time when the running conversion was started */
+    int64_t sampling_start;                  /* k_uptime_get() when the running round was started */
+    uint32_t sampling_period;                /* seconds between sampling rounds. adapted after every round */
+    atomic_t period_override;                /* seconds between sampling rounds set by set_sampling_period_override(). 0 to adapt */
+    atomic_t inject_remaining;               /* synthetic samples inject_temperature_samples() has yet to push */
+    size_t inject_channel;                   /* only used by the inject task while inject_remaining > 0 */
+    uint32_t inject_count;
+    int64_t inject_start;
+    struct k_work_delayable sampling_task;   /* runs on sampling_workqueue */
+    struct k_work_delayable conversion_task; /* runs on sampling_workqueue */
+    struct k_work period_task;               /* runs on sampling_workqueue */
+    struct k_work_delayable inject_task;     /* runs on sampling_workqueue */
+    struct k_work compaction_task;           /* runs on app_workqueue */
 };
 
 static void perform_sampling_task(struct k_work *work);
+static void perform_conversion_task(struct k_work *work);
+static void perform_compaction_task(struct k_work *work);
+static void perform_period_task(struct k_work *work);
+static void perform_inject_task(struct k_work *work);
+static void recover_temperature_journal(size_t channel);
+static void restore_time_from_history(void);
 
 static struct temperature_logger_data_t t_data = {
-    .temperature_list.lock = Z_MUTEX_INITIALIZER(t_data.temperature_list.lock),
-    .scratch_temperature_list.lock = Z_MUTEX_INITIALIZER(t_data.scratch_temperature_list.lock),
-    .temperature_sensor = DEVICE_DT_GET_ANY(maxim_ds18b20),
-    .sampling_task = Z_WORK_DELAYABLE_INITIALIZER(perform_sampling_task)};
+    .sampling_period = CONFIG_TEMPERATURE_LOGGER_MIN_SAMPLING_PERIOD,
+    .query_lock = Z_MUTEX_INITIALIZER(t_data.query_lock),
+    .sampling_task = Z_WORK_DELAYABLE_INITIALIZER(perform_sampling_task),
+    .conversion_task = Z_WORK_DELAYABLE_INITIALIZER(perform_conversion_task),
+    .period_task = Z_WORK_INITIALIZER(perform_period_task),
+    .inject_task = Z_WORK_DELAYABLE_INITIALIZER(perform_inject_task),
+    .compaction_task = Z_WORK_INITIALIZER(perform_compaction_task)};
 
 
 /**
- * @brief Initializes the temperature logging subsystem.
- * * This includes checking device readiness and scheduling the first sampling task 
- * via the system workqueue. This is the main exposed entry point.
+ * @brief Initializes the temperature logging subsystem and starts sampling.
+ * * This includes finding the sensors and scheduling the first sampling task on sampling_workqueue,
+ * which takes the first sample right away. Nothing is read from NVS yet. The samples wait in the
+ * sample queues until load_temperature_logger_history() has loaded the history. This is the main exposed entry point.
+ * Start the workqueues (init_app_workqueue()) before calling this function.
  * * @retval E_SUCCESS Successful initialization.
- * @retval E_ERROR Sensor device not found or not ready.
+ * @retval E_ERROR Sensor not found or could not be configured.
  */
 enum error_e init_temperature_logger(void)
 {
-    if (t_data.temperature_sensor == NULL)
+    for (size_t channel = 0; channel < CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT; channel++)
     {
-        LOG_ERR("Temperature sensor device was not found.");
-        return E_ERROR;
+        k_mutex_init(&t_data.channels[channel].temperature_list.lock);
+        reset_sample_compressor(&t_data.channels[channel].compressor, INGEST_COMPRESSION_TOLERANCE);
     }
 
-    if (!device_is_ready(t_data.temperature_sensor))
+    if (init_ds18b20() != E_SUCCESS)
     {
-        LOG_ERR("Temperature sensor device is not ready.");
+        LOG_ERR("Temperature sensor is not ready.");
         return E_ERROR;
     }
 
-    k_work_reschedule(&t_data.sampling_task, K_NO_WAIT);
+    k_work_reschedule_for_queue(&sampling_workqueue, &t_data.sampling_task, K_NO_WAIT);
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Loads the history and starts storing samples.
+ * * This includes loading the history indexes, recovering the journal and moving the clock past the
+ * newest sample. Samples that were taken before are moved forward by as much as the clock was, so
+ * they still sort after the history. Then the compaction worker drains the sample queues.
+ * Initialize NVS and the temperature logger before calling this function. Call it once.
+ * * @retval E_SUCCESS History loaded. Samples are stored from now on, even if the history could not be read.
+ */
+enum error_e load_temperature_logger_history(void)
+{
+    if (init_temperature_history() != E_SUCCESS)
+    {
+        // not fatal. the history index has been reset and will be rewritten on the next flush
+        LOG_WRN("Temperature history could not be loaded. Starting with an empty history.");
+    }
+    if (IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_TIERS) && init_temperature_tiers() != E_SUCCESS)
+    {
+        LOG_WRN("Temperature history tiers could not be loaded. Starting with empty tiers.");
+    }
+    if (CONFIG_TEMPERATURE_LOGGER_JOURNAL_INTERVAL > 0)
+    {
+        for (size_t channel = 0; channel < CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT; channel++)
+        {
+            recover_temperature_journal(channel);
+        }
+    }
+    restore_time_from_history();
+
+    atomic_set(&t_data.history_loaded, 1);
+    record_metrics_milestone(METRICS_MILESTONE_HISTORY_LOADED);
+    k_work_submit_to_queue(&app_workqueue, &t_data.compaction_task);
     return E_SUCCESS;
 }
 
@@ -76,153 +174,323 @@ EXPOSE_FOR_TESTING enum error_e reset_temperature_list(struct temperature_list_t
 }
 
 /**
- * @brief Reads the temperature list from NVS flash storage into the provided list structure.
- * * If the key does not exist, the list is reset and a zeroed structure is written.
- * ASSUMPTION: The caller MUST hold the list's lock before calling.
- * * @param t Pointer to the list structure where data will be loaded.
- * @retval E_SUCCESS Data successfully loaded or key created.
- * @retval E_ERROR Read failed due to NVS error or size mismatch.
- * @retval E_NULL_PTR If 't' is NULL.
+ * @brief Divides and rounds the result to the nearest integer. Halves are rounded away from zero.
+ * * @param numerator Any value.
+ * @param denominator Must be greater than zero.
  */
-EXPOSE_FOR_TESTING enum error_e load_temperature_list(struct temperature_list_t *t)
+int64_t divide_and_round(int64_t numerator, int64_t denominator)
 {
-    if (t == NULL)
+    if (numerator >= 0)
+    {
+        return (numerator + denominator / 2) / denominator;
+    }
+    return -((-numerator + denominator / 2) / denominator);
+}
+
+/**
+ * @brief Appends a single temperature sample to the end of a list.
+ * * ASSUMPTION: The caller MUST hold the list's lock before calling.
+ * * @param list Pointer to the destination list.
+ * @param sample The temperature sample to append (copied by value).
+ * @retval E_SUCCESS Sample successfully appended.
+ * @retval E_NOBUFS The list is already full (length == CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE).
+ * @retval E_NULL_PTR If 'list' is NULL.
+ */
+EXPOSE_FOR_TESTING enum error_e append_temperature_sample(struct temperature_list_t *list, struct temperature_sample_t sample)
+{
+    if (list == NULL)
     {
         LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
         return E_NULL_PTR;
     }
+    if (list->length == CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE)
+    {
+        return E_NOBUFS;
+    }
+    struct temperature_stats_t *summary = &list->summary[list->length / TEMPERATURE_LIST_SUMMARY_BLOCK_SIZE];
+    if (list->length % TEMPERATURE_LIST_SUMMARY_BLOCK_SIZE == 0)
+    {
+        init_temperature_stats(summary);
+    }
+    add_temperature_stats_sample(summary, sample.temperature);
+    set_temperature_list_sample(list, list->length, sample);
+    list->length++;
+    return E_SUCCESS;
+}
 
-    struct nvs_fs *fs = get_nvs_fs();
-    enum error_e err;
-
-    // try to read
-    ssize_t bytes_read = nvs_read(fs, NVS_KEY_TEMPERATURE_DATA, t, offsetof(struct temperature_list_t, lock));
-    if (bytes_read == -ENOENT)
+/**
+ * @brief Overwrites the last sample of a non-empty list. Only the summary of the last block is recomputed.
+ * * ASSUMPTION: The caller MUST hold the list's lock before calling.
+ * * @param list Pointer to the list.
+ * @param sample The sample that takes the place of the last one.
+ * @retval E_SUCCESS Sample replaced.
+ * @retval E_NOENT The list is empty.
+ * @retval E_NULL_PTR If 'list' is NULL.
+ */
+EXPOSE_FOR_TESTING enum error_e replace_last_temperature_sample(struct temperature_list_t *list, struct temperature_sample_t sample)
+{
+    if (list == NULL)
     {
-        // key does not exist. create key
-        reset_temperature_list(t);
-        nvs_write(fs, NVS_KEY_TEMPERATURE_DATA, t, offsetof(struct temperature_list_t, lock));
-        err = E_SUCCESS;
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
     }
-    else if (bytes_read != offsetof(struct temperature_list_t, lock))
+    if (list->length == 0)
     {
-        // for some reason, the read failed
-        LOG_ERR("Failed to load temperature list from NVS. Expected to read %d bytes. Read %d bytes.", (int)offsetof(struct temperature_list_t, lock), (int)bytes_read);
-        err = E_ERROR;
+        return E_NOENT;
     }
-    else
+    set_temperature_list_sample(list, list->length - 1, sample);
+    size_t first = (list->length - 1) / TEMPERATURE_LIST_SUMMARY_BLOCK_SIZE * TEMPERATURE_LIST_SUMMARY_BLOCK_SIZE;
+    struct temperature_stats_t *summary = &list->summary[first / TEMPERATURE_LIST_SUMMARY_BLOCK_SIZE];
+    init_temperature_stats(summary);
+    for (size_t i = first; i < list->length; i++)
     {
-        err = E_SUCCESS;
+        add_temperature_stats_sample(summary, list->temperature[i]);
     }
-    return err;
+    return E_SUCCESS;
 }
 
 /**
- * @brief Writes the temperature list to NVS flash storage.
+ * @brief Recomputes the block summaries of a list from its samples.
  * * ASSUMPTION: The caller MUST hold the list's lock before calling.
- * * @param t Pointer to the list structure whose data will be stored.
- * @retval E_SUCCESS Data successfully written.
- * @retval E_ERROR Write failed due to NVS error.
- * @retval E_NULL_PTR If 't' is NULL.
+ * * @param t Pointer to the list.
  */
-EXPOSE_FOR_TESTING enum error_e store_temperature_list(struct temperature_list_t *t)
+EXPOSE_FOR_TESTING void update_temperature_list_summary(struct temperature_list_t *t)
 {
     if (t == NULL)
+    {
+        return;
+    }
+    for (size_t i = 0; i < t->length; i++)
+    {
+        struct temperature_stats_t *summary = &t->summary[i / TEMPERATURE_LIST_SUMMARY_BLOCK_SIZE];
+        if (i % TEMPERATURE_LIST_SUMMARY_BLOCK_SIZE == 0)
+        {
+            init_temperature_stats(summary);
+        }
+        add_temperature_stats_sample(summary, t->temperature[i]);
+    }
+}
+
+/**
+ * @brief Adds the samples of a list whose uptime lies in [start, end] to 'stats'.
+ * * Blocks that lie entirely inside the range are taken from the summary. Only the
+ * blocks at the edges of the range are scanned.
+ * ASSUMPTION: The caller MUST hold the list's lock before calling. The list MUST be sorted by uptime.
+ * * @param t Pointer to the list.
+ * @param start First uptime of the range.
+ * @param end Last uptime of the range.
+ * @param stats Pointer to the stats to add to.
+ * @retval E_SUCCESS Query successful.
+ * @retval E_NULL_PTR If 't' or 'stats' is NULL.
+ */
+EXPOSE_FOR_TESTING enum error_e query_temperature_list(struct temperature_list_t *t, sys_minutes_t start, sys_minutes_t end, struct temperature_stats_t *stats)
+{
+    if (t == NULL || stats == NULL)
     {
         LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
         return E_NULL_PTR;
     }
+    for (size_t first = 0; first < t->length; first += TEMPERATURE_LIST_SUMMARY_BLOCK_SIZE)
+    {
+        size_t last = MIN(first + TEMPERATURE_LIST_SUMMARY_BLOCK_SIZE, t->length) - 1;
+        if (t->uptime[last] < start || t->uptime[first] > end)
+        {
+            continue;
+        }
+        if (t->uptime[first] >= start && t->uptime[last] <= end)
+        {
+            add_temperature_stats(stats, &t->summary[first / TEMPERATURE_LIST_SUMMARY_BLOCK_SIZE]);
+            continue;
+        }
+        for (size_t i = first; i <= last; i++)
+        {
+            if (t->uptime[i] >= start && t->uptime[i] <= end)
+            {
+                add_temperature_stats_sample(stats, t->temperature[i]);
+            }
+        }
+    }
+    return E_SUCCESS;
+}
 
-    struct nvs_fs *fs = get_nvs_fs();
-    ssize_t bytes_written = nvs_write(fs, NVS_KEY_TEMPERATURE_DATA, t, offsetof(struct temperature_list_t, lock));
-    enum error_e err = bytes_written == offsetof(struct temperature_list_t, lock) || bytes_written == 0 ? E_SUCCESS : E_ERROR;
-    if (err != E_SUCCESS)
+/**
+ * @brief Returns the mean of the stats, rounded to the nearest 1/16 degree. 0 if there are no samples.
+ */
+temperature_t get_temperature_stats_mean(const struct temperature_stats_t *stats)
+{
+    if (stats == NULL || stats->count == 0)
     {
-        LOG_ERR("Failed to write temperature list to NVS. Expected to write %d bytes or 0 bytes. Wrote %d bytes.", (int)offsetof(struct temperature_list_t, lock), (int)bytes_written);
+        return 0;
     }
-    return err;
+    return (temperature_t)divide_and_round(stats->sum, stats->count);
 }
 
 /**
- * @brief Converts a standard sensor_value struct (val1=whole, val2=micro) into 
- * the 4-bit fixed-point temperature_t format.
- * * @param v The sensor_value struct containing raw temperature readings.
- * @return temperature_t The temperature value scaled by 16 (4 fractional bits).
+ * @brief Returns how many samples of the RAM list of a channel the journal brought back at boot.
+ * * The samples were flushed into the segment the RAM list would have become, at the same positions.
+ * Call this after load_temperature_logger_history().
+ * * @param channel The channel.
+ * @param segment Pointer that receives the segment the samples were flushed into. Only set if samples were recovered.
+ * @return The number of recovered samples. 0 if there were none, or the channel does not exist.
  */
-EXPOSE_FOR_TESTING temperature_t sensor_value_to_temperature(struct sensor_value v)
+size_t get_recovered_temperature_journal(size_t channel, uint32_t *segment)
 {
-    float whole = (float)v.val1;
-    float fractional = (float)v.val2 / 1000000.0f;
-    float float_temperature = whole + fractional;
-    temperature_t temperature = (temperature_t)(float_temperature * 16);
-    return temperature;
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT || t_data.channels[channel].recovered_length == 0)
+    {
+        return 0;
+    }
+    if (segment != NULL)
+    {
+        *segment = t_data.channels[channel].recovered_segment;
+    }
+    return t_data.channels[channel].recovered_length;
 }
 
 /**
- * @brief Fetches data from the sensor and creates a single temperature sample.
- * * Reads the current sensor value and combines it with the current system uptime (in minutes).
- * * @param t Pointer to the temperature_sample_t structure to fill.
- * @retval E_SUCCESS Sample successfully acquired and prepared.
- * @retval E_ERROR Sensor fetching/reading failed.
- * @retval E_NULL_PTR If 't' is NULL.
+ * @brief Computes the min, max and mean temperature of one channel over an uptime range.
+ * * Looks at the history tiers, the history segments and the RAM list. Segments and the
+ * RAM list are summarized per block, so only the blocks at the edges of the range are scanned.
+ * Tier aggregates are counted whole if their bucket overlaps the range.
+ * * Synchronization: Holds the channel's temperature_list.lock for the entire walk. Every flush,
+ * roll-up and compaction runs under it, so no sample is counted twice or missed while the
+ * history moves. Samples wait in the sample queue meanwhile.
+ * * @param channel The channel.
+ * @param start First uptime of the range.
+ * @param end Last uptime of the range.
+ * @param stats Pointer to the struct that receives the stats.
+ * @retval E_SUCCESS Stats computed.
+ * @retval E_NODATA There are no samples in the range.
+ * @retval E_RANGE The channel does not exist.
+ * @retval E_INVAL 'start' is after 'end'.
+ * @retval E_ERROR Part of the history could not be read. 'stats' covers the rest.
+ * @retval E_NULL_PTR If 'stats' is NULL.
  */
-EXPOSE_FOR_TESTING enum error_e get_temperature_sample(struct temperature_sample_t *t)
+enum error_e query_temperature_range(size_t channel, sys_minutes_t start, sys_minutes_t end, struct temperature_stats_t *stats)
 {
-    if (t == NULL)
+    if (stats == NULL)
     {
         LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
         return E_NULL_PTR;
     }
-    struct sensor_value temperature;
-    int result = sensor_sample_fetch(t_data.temperature_sensor);
-    t->uptime = get_uptime_in_minutes();
-    if (result != 0)
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
     {
-        LOG_ERR("Failed to request temperature sample. Error %d.", result);
-        return E_ERROR;
+        return E_RANGE;
     }
-    result = sensor_channel_get(t_data.temperature_sensor, SENSOR_CHAN_AMBIENT_TEMP, &temperature);
-    if (result != 0)
+    if (start > end)
     {
-        LOG_ERR("Failed to read temperature sample. Error %d.", result);
-        return E_ERROR;
+        return E_INVAL;
     }
-    t->temperature = sensor_value_to_temperature(temperature);
-    return E_SUCCESS;
+
+    enum error_e err = E_SUCCESS;
+    struct temperature_list_t *list = &t_data.channels[channel].temperature_list;
+    init_temperature_stats(stats);
+    k_mutex_lock(&list->lock, K_FOREVER);
+
+    if (IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_TIERS))
+    {
+        struct temperature_aggregate_t aggregate;
+        k_mutex_lock(&t_data.query_lock, K_FOREVER);
+        for (size_t tier = 0; tier < TEMPERATURE_TIER_COUNT; tier++)
+        {
+            open_temperature_tier(&t_data.query_tier_reader, channel, tier);
+            sys_minutes_t period = get_temperature_tier_period(tier);
+            while (read_temperature_tier(&t_data.query_tier_reader, &aggregate) == E_SUCCESS)
+            {
+                if (aggregate.start <= end && aggregate.start + period > start)
+                {
+                    struct temperature_stats_t aggregate_stats = {
+                        .min = aggregate.min,
+                        .max = aggregate.max,
+                        .sum = aggregate.sum,
+                        .count = aggregate.count,
+                    };
+                    add_temperature_stats(stats, &aggregate_stats);
+                }
+            }
+        }
+        k_mutex_unlock(&t_data.query_lock);
+    }
+
+    struct temperature_history_index_t index;
+    get_temperature_history_index(channel, &index);
+    for (uint32_t segment = index.oldest_segment; segment < index.oldest_segment + index.segment_count; segment++)
+    {
+        if (query_temperature_segment(channel, segment, start, end, stats) != E_SUCCESS)
+        {
+            LOG_WRN("History segment %u of channel %d could not be queried.", segment, (int)channel);
+            err = E_ERROR;
+        }
+    }
+
+    query_temperature_list(list, start, end, stats);
+    k_mutex_unlock(&list->lock);
+
+    if (err == E_SUCCESS && stats->count == 0)
+    {
+        return E_NODATA;
+    }
+    return err;
 }
 
 /**
- * @brief Appends a single temperature sample to the end of a list.
- * * ASSUMPTION: The caller MUST hold the list's lock before calling.
- * * @param list Pointer to the destination list.
- * @param sample The temperature sample to append (copied by value).
- * @retval E_SUCCESS Sample successfully appended.
- * @retval E_NOBUFS The list is already full (length == CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE).
- * @retval E_NULL_PTR If 'list' is NULL.
+ * @brief Copies a run of samples out of the RAM list of one channel.
+ * * The list lock is only held for the copy, so callers can page through the list
+ * without blocking the sampler while they do slow work (like sending) in between.
+ * The list is emptied when it is flushed to NVS, so pages read across a flush may
+ * skip or repeat samples.
+ * * @param channel The channel.
+ * @param first Index of the first sample to copy.
+ * @param final_only Leave out the last sample while ingest compression may still replace it.
+ * Callers that remember how far they read, like the uplink, need this to not miss the replacement.
+ * @param samples Array that receives the samples.
+ * @param capacity Number of elements in 'samples'.
+ * @param copied Pointer that receives the number of samples copied. 0 once 'first' is past the end.
+ * @retval E_SUCCESS Samples copied.
+ * @retval E_RANGE The channel does not exist.
+ * @retval E_NULL_PTR If 'samples' or 'copied' is NULL.
  */
-EXPOSE_FOR_TESTING enum error_e append_temperature_sample(struct temperature_list_t *list, struct temperature_sample_t sample)
+enum error_e copy_temperature_list_samples(size_t channel, size_t first, bool final_only, struct temperature_sample_t *samples, size_t capacity, size_t *copied)
 {
-    if (list == NULL)
+    if (samples == NULL || copied == NULL)
     {
         LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
         return E_NULL_PTR;
     }
-    if (list->length == CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE)
+    *copied = 0;
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
     {
-        return E_NOBUFS;
+        return E_RANGE;
     }
-    list->data[list->length] = sample;
-    list->length++;
+
+    struct temperature_channel_t *c = &t_data.channels[channel];
+    struct temperature_list_t *list = &c->temperature_list;
+    k_mutex_lock(&list->lock, K_FOREVER);
+    size_t length = list->length;
+    if (final_only && IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_COMPRESSION) && sample_compressor_has_candidate(&c->compressor))
+    {
+        length--;
+    }
+    size_t count = first < length ? MIN(capacity, length - first) : 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        samples[i] = get_temperature_list_sample(list, first + i);
+    }
+    k_mutex_unlock(&list->lock);
+    *copied = count;
     return E_SUCCESS;
 }
 
+#if CONFIG_BUILD_TEST_APP
+// only the tests use the single sample version. it is the reference for interpolate_uniform()
 /**
  * @brief Performs linear interpolation between two samples (t1 and t2) at a given uptime.
  * * Calculates the synthesized temperature and stores it in the result structure.
+ * Integer only. The result is rounded to the nearest 1/16 degree, halves away from zero.
+ * If both samples have the same uptime, the result is their rounded average.
  * * @param t1 Pointer to the first sample.
  * @param t2 Pointer to the second sample.
  * @param result Pointer to the structure where the synthesized temperature will be stored. 
- * The result->uptime field MUST be set by the caller before calling.
+ * The result->uptime field MUST be set by the caller before calling and MUST lie between the two uptimes.
  * @retval E_SUCCESS Interpolation successful.
  * @retval E_NULL_PTR If t1, t2, or result is NULL.
  */
@@ -235,7 +503,7 @@ EXPOSE_FOR_TESTING enum error_e interpolate(struct temperature_sample_t *t1, str
     }
     if (t1->uptime == t2->uptime)
     {
-        result->temperature = (t1->temperature + t2->temperature) / 2;
+        result->temperature = (temperature_t)divide_and_round((int32_t)t1->temperature + (int32_t)t2->temperature, 2);
         return E_SUCCESS;
     }
     struct temperature_sample_t *earlier, *later;
@@ -250,144 +518,273 @@ EXPOSE_FOR_TESTING enum error_e interpolate(struct temperature_sample_t *t1, str
         later = t1;
     }
 
-    int32_t d_temp = (int32_t)t2->temperature - (int32_t)t1->temperature;
-    uint32_t d_uptime = (uint32_t)(later->uptime - earlier->uptime);
-    uint32_t d_uptime_to_result = (uint32_t)(result->uptime - earlier->uptime);
-    int16_t d_temp_to_result = (int16_t)((float)d_temp * (float)d_uptime_to_result / (float)d_uptime);
+    int64_t d_temp = (int32_t)later->temperature - (int32_t)earlier->temperature;
+    int64_t d_uptime = (uint32_t)(later->uptime - earlier->uptime);
+    int64_t d_uptime_to_result = (uint32_t)(result->uptime - earlier->uptime);
+    int64_t d_temp_to_result = divide_and_round(d_temp * d_uptime_to_result, d_uptime);
     result->temperature = (temperature_t)(earlier->temperature + d_temp_to_result);
     return E_SUCCESS;
 }
+#endif
 
 /**
- * @brief Initializes the merge iterator for two source lists.
- * * Sets the initial current list and indices based on which list has the earliest sample.
- * ASSUMPTION: The caller MUST hold the lists' locks before calling.
- * * @param m Pointer to the merge_iterator_t structure to initialize.
- * @param src1 Pointer to the first source list.
- * @param src2 Pointer to the second source list.
- * @retval E_SUCCESS Initialization complete.
- * @retval E_NULL_PTR If any input pointer is NULL.
+ * @brief Interpolates 'count' uniformly spaced samples between two samples in a single pass.
+ * * Produces exactly the same temperatures as calling interpolate() once per output, but only
+ * divides once. Each further output is an integer add with carry.
+ * * @param t1 Pointer to the first sample.
+ * @param t2 Pointer to the second sample.
+ * @param start_uptime Uptime of the first output.
+ * @param period Uptime between consecutive outputs. May be zero.
+ * @param count Number of outputs.
+ * @param uptimes Array of at least 'count' uptimes that receives the output uptimes.
+ * @param temperatures Array of at least 'count' temperatures that receives the output temperatures.
+ * @retval E_SUCCESS Interpolation successful.
+ * @retval E_RANGE An output uptime does not lie between the two uptimes.
+ * @retval E_NULL_PTR If t1, t2, uptimes or temperatures is NULL.
  */
-EXPOSE_FOR_TESTING enum error_e init_merge_iterator(struct merge_iterator_t *m, struct temperature_list_t *src1, struct temperature_list_t *src2)
+EXPOSE_FOR_TESTING enum error_e interpolate_uniform(struct temperature_sample_t *t1, struct temperature_sample_t *t2, sys_minutes_t start_uptime, sys_minutes_t period, size_t count, sys_minutes_t *uptimes, temperature_t *temperatures)
 {
-    if (m == NULL || src1 == NULL || src2 == NULL)
+    if (t1 == NULL || t2 == NULL || uptimes == NULL || temperatures == NULL)
     {
         LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
         return E_NULL_PTR;
     }
-    m->src1 = src1;
-    m->src2 = src2;
-    m->current_index = 0;
+    if (count == 0)
+    {
+        return E_SUCCESS;
+    }
+    struct temperature_sample_t *earlier = t1->uptime <= t2->uptime ? t1 : t2;
+    struct temperature_sample_t *later = t1->uptime <= t2->uptime ? t2 : t1;
+    uint64_t end_uptime = (uint64_t)start_uptime + (uint64_t)(count - 1) * period;
+    if (start_uptime < earlier->uptime || end_uptime > later->uptime)
+    {
+        return E_RANGE;
+    }
 
-    // if both lists have length zero
-    // will return E_END_OF_ITER forever
-    if (src1->length == 0 && src2->length == 0)
+    if (earlier->uptime == later->uptime)
     {
-        m->current_list = NULL;
-        return;
+        temperature_t average = (temperature_t)divide_and_round((int32_t)t1->temperature + (int32_t)t2->temperature, 2);
+        for (size_t i = 0; i < count; i++)
+        {
+            uptimes[i] = start_uptime;
+            temperatures[i] = average;
+        }
+        return E_SUCCESS;
     }
-    else if (src1->length == 0)
+
+    // work with the magnitude of the slope so rounding half away from zero is a floor
+    int64_t d_temp = (int32_t)later->temperature - (int32_t)earlier->temperature;
+    int64_t sign = d_temp < 0 ? -1 : 1;
+    uint64_t magnitude = (uint64_t)(d_temp * sign);
+    uint64_t d_uptime = later->uptime - earlier->uptime;
+    uint64_t numerator = magnitude * (start_uptime - earlier->uptime) + d_uptime / 2;
+    uint64_t quotient = numerator / d_uptime;
+    uint64_t remainder = numerator % d_uptime;
+    uint64_t step_quotient = (magnitude * period) / d_uptime;
+    uint64_t step_remainder = (magnitude * period) % d_uptime;
+
+    sys_minutes_t uptime = start_uptime;
+    for (size_t i = 0; i < count; i++)
     {
-        m->current_list = src2;
-        m->next_src1_index = 0;
-        m->next_src2_index = 1;
-        return;
+        uptimes[i] = uptime;
+        temperatures[i] = (temperature_t)(earlier->temperature + sign * (int64_t)quotient);
+        uptime += period;
+        quotient += step_quotient;
+        remainder += step_remainder;
+        if (remainder >= d_uptime)
+        {
+            quotient++;
+            remainder -= d_uptime;
+        }
     }
-    else if (src2->length == 0)
+    return E_SUCCESS;
+}
+
+static size_t get_source_length(const struct temperature_source_t *s)
+{
+    return s->list != NULL ? s->list->length : s->reader->length;
+}
+
+/**
+ * @brief Returns the sample that is 'consumed' samples away from the start (or the end, if reversed) of a source.
+ * * Segment readers can only return the next unread sample, so for them 'consumed' must match the reader.
+ */
+static enum error_e peek_source(struct temperature_source_t *s, size_t consumed, bool reverse, struct temperature_sample_t *sample)
+{
+    if (s->list != NULL)
     {
-        m->current_list = src1;
-        m->next_src1_index = 1;
-        m->next_src2_index = 0;
-        return;
+        *sample = get_temperature_list_sample(s->list, reverse ? s->list->length - 1 - consumed : consumed);
+        return E_SUCCESS;
     }
-    // current starts at the earliest datapoint
-    else if (src1->data[0].uptime < src2->data[0].uptime)
+    return peek_temperature_segment(s->reader, sample);
+}
+
+static enum error_e advance_source(struct temperature_source_t *s)
+{
+    if (s->list != NULL)
     {
-        m->current_list = src1;
-        m->next_src1_index = 1;
-        m->next_src2_index = 0;
+        return E_SUCCESS;
     }
-    else
+    return read_temperature_segment(s->reader, NULL);
+}
+
+/**
+ * @brief Initializes the merge iterator for two sources.
+ * * The iterator returns samples from both sources in chronological order.
+ * When two samples have the same uptime, the one from src2 comes first.
+ * ASSUMPTION: The caller MUST hold the lists' locks before calling.
+ * Segment readers MUST be freshly opened.
+ * * @param m Pointer to the merge_iterator_t structure to initialize.
+ * @param src1 Pointer to the first source.
+ * @param src2 Pointer to the second source.
+ * @retval E_SUCCESS Initialization complete.
+ * @retval E_INVAL A source has neither or both of a list and a reader.
+ * @retval E_NULL_PTR If any input pointer is NULL.
+ */
+EXPOSE_FOR_TESTING enum error_e init_source_merge_iterator(struct merge_iterator_t *m, struct temperature_source_t *src1, struct temperature_source_t *src2)
+{
+    if (m == NULL || src1 == NULL || src2 == NULL)
     {
-        m->current_list = src2;
-        m->next_src1_index = 0;
-        m->next_src2_index = 1;
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if ((src1->list == NULL) == (src1->reader == NULL) || (src2->list == NULL) == (src2->reader == NULL))
+    {
+        return E_INVAL;
     }
+    m->src1 = *src1;
+    m->src2 = *src2;
+    m->src1_consumed = 0;
+    m->src2_consumed = 0;
+    m->reverse = false;
     return E_SUCCESS;
 }
 
 /**
- * @brief Advances the merge iterator and returns a pointer to the chronologically next sample.
+ * @brief Initializes the merge iterator for two source lists.
+ * * The iterator returns samples from both lists in chronological order.
+ * When two samples have the same uptime, the one from src2 comes first.
+ * ASSUMPTION: The caller MUST hold the lists' locks before calling.
+ * * @param m Pointer to the merge_iterator_t structure to initialize.
+ * @param src1 Pointer to the first source list.
+ * @param src2 Pointer to the second source list.
+ * @retval E_SUCCESS Initialization complete.
+ * @retval E_NULL_PTR If any input pointer is NULL.
+ */
+EXPOSE_FOR_TESTING enum error_e init_merge_iterator(struct merge_iterator_t *m, struct temperature_list_t *src1, struct temperature_list_t *src2)
+{
+    if (src1 == NULL || src2 == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    struct temperature_source_t source1 = {.list = src1};
+    struct temperature_source_t source2 = {.list = src2};
+    return init_source_merge_iterator(m, &source1, &source2);
+}
+
+/**
+ * @brief Initializes the merge iterator to walk two source lists from the latest sample to the earliest.
+ * * This yields exactly the reverse of the sequence produced by init_merge_iterator().
+ * ASSUMPTION: The caller MUST hold the lists' locks before calling.
+ * * @param m Pointer to the merge_iterator_t structure to initialize.
+ * @param src1 Pointer to the first source list.
+ * @param src2 Pointer to the second source list.
+ * @retval E_SUCCESS Initialization complete.
+ * @retval E_NULL_PTR If any input pointer is NULL.
+ */
+EXPOSE_FOR_TESTING enum error_e init_reverse_merge_iterator(struct merge_iterator_t *m, struct temperature_list_t *src1, struct temperature_list_t *src2)
+{
+    enum error_e err = init_merge_iterator(m, src1, src2);
+    if (err == E_SUCCESS)
+    {
+        m->reverse = true;
+    }
+    return err;
+}
+
+/**
+ * @brief Advances the merge iterator and returns the next sample.
+ * * The sample is returned by value.
  * * @param m Pointer to the merge iterator state.
- * @param sample Output pointer (pointer to a pointer) that will be set to the address of the next sample.
- * @retval E_SUCCESS Sample pointer successfully returned and iterator advanced.
- * @retval E_END_OF_ITER No more samples left in either source list.
+ * @param sample Pointer to the struct that receives a copy of the next sample.
+ * @retval E_SUCCESS Sample successfully returned and iterator advanced.
+ * @retval E_END_OF_ITER No more samples left in either source.
+ * @retval E_ERROR A segment reader failed.
  * @retval E_NULL_PTR If 'm' or 'sample' is NULL.
  */
-EXPOSE_FOR_TESTING enum error_e merge_iterate(struct merge_iterator_t *m, struct temperature_sample_t **sample)
+EXPOSE_FOR_TESTING enum error_e merge_iterate(struct merge_iterator_t *m, struct temperature_sample_t *sample)
 {
-
     if (m == NULL || sample == NULL)
     {
         LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
         return E_NULL_PTR;
     }
-    if (m->current_list == NULL)
+
+    size_t src1_remaining = get_source_length(&m->src1) - m->src1_consumed;
+    size_t src2_remaining = get_source_length(&m->src2) - m->src2_consumed;
+    if (src1_remaining == 0 && src2_remaining == 0)
     {
         return E_END_OF_ITER;
     }
-    else
+
+    struct temperature_sample_t sample1, sample2;
+    if ((src1_remaining > 0 && peek_source(&m->src1, m->src1_consumed, m->reverse, &sample1) != E_SUCCESS) ||
+        (src2_remaining > 0 && peek_source(&m->src2, m->src2_consumed, m->reverse, &sample2) != E_SUCCESS))
     {
-        *sample = &(m->current_list->data[m->current_index]);
+        return E_ERROR;
     }
 
-    bool at_src1_end = m->next_src1_index == m->src1->length;
-    bool at_src2_end = m->next_src2_index == m->src2->length;
-
-    // if at the end of both lists
-    if (at_src1_end && at_src2_end)
+    bool take_src1;
+    if (src1_remaining == 0)
+    {
+        take_src1 = false;
+    }
+    else if (src2_remaining == 0)
     {
-        // set to null to return E_END_OF_ITER on next call
-        m->current_list = NULL;
+        take_src1 = true;
     }
-    else if (at_src1_end)
+    else if (m->reverse)
     {
-        // forced to progress src2
-        m->current_list = m->src2;
-        m->current_index = m->next_src2_index;
-        m->next_src2_index++;
+        take_src1 = sample1.uptime >= sample2.uptime;
     }
-    else if (at_src2_end)
+    else
     {
-        // forced to progress src1
-        m->current_list = m->src1;
-        m->current_index = m->next_src1_index;
-        m->next_src1_index++;
+        take_src1 = sample1.uptime < sample2.uptime;
     }
-    else if (m->src1->data[m->next_src1_index].uptime < m->src2->data[m->next_src2_index].uptime)
+
+    enum error_e err;
+    if (take_src1)
     {
-        m->current_list = m->src1;
-        m->current_index = m->next_src1_index;
-        m->next_src1_index++;
+        *sample = sample1;
+        err = advance_source(&m->src1);
+        m->src1_consumed++;
     }
     else
     {
-        m->current_list = m->src2;
-        m->current_index = m->next_src2_index;
-        m->next_src2_index++;
+        *sample = sample2;
+        err = advance_source(&m->src2);
+        m->src2_consumed++;
     }
-    return E_SUCCESS;
+    return err == E_SUCCESS ? E_SUCCESS : E_ERROR;
+}
+
+static bool merge_iterator_has_next(struct merge_iterator_t *m)
+{
+    return m->src1_consumed < get_source_length(&m->src1) || m->src2_consumed < get_source_length(&m->src2);
 }
 
 /**
  * @brief Merges two source lists chronologically into a destination list without decimation.
  * * Used when the total number of input elements is less than or equal to the capacity.
+ * The merge runs back to front, so dest may be the same list as src1 or src2 and
+ * no extra buffer is needed.
  * ASSUMPTION: The caller MUST hold the lists' locks before calling.
  * * @param src1 Pointer to the first source list.
  * @param src2 Pointer to the second source list.
  * @param dest Pointer to the destination list where the full, merged set is copied.
  * @retval E_SUCCESS Merge successful.
- * @retval E_ERROR An error occurred during iteration.
+ * @retval E_NOBUFS The merged set does not fit in dest.
  * @retval E_NULL_PTR If any input pointer is NULL.
  */
 EXPOSE_FOR_TESTING enum error_e merge_without_decimation(struct temperature_list_t *src1, struct temperature_list_t *src2, struct temperature_list_t *dest)
@@ -397,115 +794,408 @@ EXPOSE_FOR_TESTING enum error_e merge_without_decimation(struct temperature_list
         LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
         return E_NULL_PTR;
     }
+    size_t length = src1->length + src2->length;
+    if (length > CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE)
+    {
+        return E_NOBUFS;
+    }
 
-    struct temperature_sample_t merged[CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE];
-    struct merge_iterator_t iterator;
-    struct temperature_sample_t *sample;
-    size_t index = 0;
-    enum error_e err;
-
-    init_merge_iterator(&iterator, src1, src2);
-    while (true)
+    // the write position is always at or past the unread part of whichever source is dest
+    size_t i = src1->length;
+    size_t j = src2->length;
+    size_t index = length;
+    while (i > 0 && j > 0)
     {
-        err = merge_iterate(&iterator, &sample);
-        if (err == E_END_OF_ITER)
+        index--;
+        if (src1->uptime[i - 1] >= src2->uptime[j - 1])
         {
-            err = E_SUCCESS;
-            memmove(dest->data, merged, sizeof(struct temperature_sample_t) * index);
-            dest->length = index;
-            return E_SUCCESS;
+            set_temperature_list_sample(dest, index, get_temperature_list_sample(src1, i - 1));
+            i--;
         }
-        else if (err != E_SUCCESS)
+        else
         {
-            LOG_ERR("Merging without interpolation failed. Error %d.", err);
-            return E_ERROR;
+            set_temperature_list_sample(dest, index, get_temperature_list_sample(src2, j - 1));
+            j--;
         }
-        merged[index] = *sample;
-        index++;
     }
+    // whatever is left is already in order and belongs at the front
+    if (i > 0)
+    {
+        memmove(dest->uptime, src1->uptime, sizeof(sys_minutes_t) * i);
+        memmove(dest->temperature, src1->temperature, sizeof(temperature_t) * i);
+    }
+    if (j > 0)
+    {
+        memmove(dest->uptime, src2->uptime, sizeof(sys_minutes_t) * j);
+        memmove(dest->temperature, src2->temperature, sizeof(temperature_t) * j);
+    }
+    dest->length = length;
+    return E_SUCCESS;
 }
 
 /**
- * @brief Merges two source lists into a destination list using uniform interpolation (decimation).
- * * Used when the total number of input elements exceeds the list capacity.
- * The result is a list of CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE samples uniformly spaced by time.
+ * @brief Checks if writing sample 'index' of dest would overwrite a source sample that has not been read yet.
+ * * Only sources that are the same list as dest can be overwritten.
+ */
+static bool decimation_write_is_unsafe(struct merge_iterator_t *m, struct temperature_list_t *dest, size_t index)
+{
+    struct temperature_list_t *sources[2] = {m->src1.list, m->src2.list};
+    size_t consumed[2] = {m->src1_consumed, m->src2_consumed};
+    for (size_t i = 0; i < 2; i++)
+    {
+        if (sources[i] != dest)
+        {
+            continue;
+        }
+        // forward: unread samples are at [consumed, length). reverse: at [0, length - consumed)
+        size_t unread_start = m->reverse ? 0 : consumed[i];
+        size_t unread_end = m->reverse ? sources[i]->length - consumed[i] : sources[i]->length;
+        if (index >= unread_start && index < unread_end)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * The decimated outputs split the merged time range into DECIMATION_INTERVALS periods.
+ * Output k is at start_uptime + k * base_period + MIN(k, long_periods),
+ * so the first long_periods periods are one minute longer than the rest.
+ */
+#define DECIMATION_INTERVALS (CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE - 1)
+
+struct decimation_grid_t
+{
+    sys_minutes_t start_uptime;
+    sys_minutes_t base_period;
+    sys_minutes_t long_periods;
+};
+
+/**
+ * @brief Computes the output times of a decimated merge of two non-empty sources.
+ * * DECIMATION_INTERVALS is a build time constant, so the division and the modulo compile to
+ * a shift and a mask when it is a power of two, and to a multiplication otherwise.
+ * @retval E_SUCCESS Grid computed.
+ * @retval E_ERROR A segment reader failed.
+ */
+static enum error_e get_decimation_grid(struct temperature_source_t *src1, struct temperature_source_t *src2, struct decimation_grid_t *grid)
+{
+    struct temperature_sample_t first1, first2;
+    if (peek_source(src1, 0, false, &first1) != E_SUCCESS || peek_source(src2, 0, false, &first2) != E_SUCCESS)
+    {
+        return E_ERROR;
+    }
+    sys_minutes_t last1 = src1->list != NULL ? src1->list->uptime[src1->list->length - 1] : src1->reader->last_uptime;
+    sys_minutes_t last2 = src2->list != NULL ? src2->list->uptime[src2->list->length - 1] : src2->reader->last_uptime;
+    grid->start_uptime = MIN(first1.uptime, first2.uptime);
+    sys_minutes_t merge_duration = MAX(last1, last2) - grid->start_uptime;
+    grid->base_period = merge_duration / DECIMATION_INTERVALS;
+    grid->long_periods = merge_duration % DECIMATION_INTERVALS;
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Produces the uniformly spaced decimated samples in one sweep over both sources.
+ * * Only the two samples around the current output uptime are kept, and they are kept
+ * by value, so outputs can be written straight into dest even if dest is one of the sources.
+ * All outputs that fall between the same two samples are produced by one interpolate_uniform() call.
+ * Both sources MUST be non-empty. Sweeps over segment readers MUST be forward and not dry runs.
+ * This is the general version. Merges that are not in place use fast_decimation_sweep().
  * ASSUMPTION: The caller MUST hold the lists' locks before calling.
- * * @param src1 Pointer to the first source list.
- * @param src2 Pointer to the second source list.
- * @param dest Pointer to the destination list (output size = CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE).
- * @retval E_SUCCESS Merge successful.
+ * * @param reverse Sweep from the latest output to the earliest.
+ * @param dry_run Only check that the sweep never overwrites an unread source sample. Nothing is written.
+ * @retval E_SUCCESS Sweep successful.
+ * @retval E_NOBUFS The sweep would overwrite an unread source sample.
  * @retval E_ERROR An error occurred during iteration or interpolation.
- * @retval E_NULL_PTR If any input pointer is NULL.
  */
-EXPOSE_FOR_TESTING enum error_e merge_with_decimation(struct temperature_list_t *src1, struct temperature_list_t *src2, struct temperature_list_t *dest)
+EXPOSE_FOR_TESTING enum error_e decimation_sweep(struct temperature_source_t *src1, struct temperature_source_t *src2, struct temperature_list_t *dest, bool reverse, bool dry_run)
 {
-    if (src1 == NULL || src2 == NULL || dest == NULL)
+    struct decimation_grid_t grid;
+    if (get_decimation_grid(src1, src2, &grid) != E_SUCCESS)
     {
-        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
-        return E_NULL_PTR;
+        return E_ERROR;
     }
-    struct temperature_sample_t merged[CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE];
+    sys_minutes_t start_uptime = grid.start_uptime;
+    sys_minutes_t sample_base_period = grid.base_period;
+    sys_minutes_t long_periods_needed = grid.long_periods;
 
-    // time
-    sys_minutes_t start_uptime = MIN(src1->data[0].uptime, src2->data[0].uptime);
-    sys_minutes_t end_uptime = MAX(src1->data[src1->length - 1].uptime, src2->data[src2->length - 1].uptime);
-    sys_minutes_t merge_duration = end_uptime - start_uptime;
-    sys_minutes_t sample_base_period = merge_duration / (CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE - 1);
-    sys_minutes_t long_periods_needed = merge_duration % (CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE - 1);
-
-    struct temperature_sample_t *current = NULL, *prev = NULL;
+    // 'ahead' is the next sample in the direction of the sweep. 'behind' is the one before it.
+    struct temperature_sample_t behind, ahead;
     struct merge_iterator_t iterator;
-    init_merge_iterator(&iterator, src1, src2);
-    merge_iterate(&iterator, &prev);
-    merge_iterate(&iterator, &current);
+    if (reverse)
+    {
+        // only lists can be walked backwards
+        init_reverse_merge_iterator(&iterator, src1->list, src2->list);
+    }
+    else
+    {
+        init_source_merge_iterator(&iterator, src1, src2);
+    }
+    if (merge_iterate(&iterator, &behind) != E_SUCCESS || merge_iterate(&iterator, &ahead) != E_SUCCESS)
+    {
+        return E_ERROR;
+    }
 
-    size_t merge_index = 0;
-    sys_minutes_t merge_uptime = start_uptime;
     enum error_e err = E_SUCCESS;
-
-    while (merge_index < CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE)
+    size_t n = 0;
+    while (n < CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE)
     {
-        // if time is between the two points, perform an interpolation
-        // otherwise, shift the current and prev samples
-        if (merge_uptime >= prev->uptime && merge_uptime <= current->uptime)
+        size_t merge_index = reverse ? CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE - 1 - n : n;
+        sys_minutes_t merge_uptime = start_uptime + merge_index * sample_base_period + MIN(merge_index, long_periods_needed);
+
+        // shift the samples until the time is between them
+        // both directions must settle on the same pair: the first sample at or after the time and the one before it
+        while (reverse ? merge_uptime <= ahead.uptime && merge_iterator_has_next(&iterator) : merge_uptime > ahead.uptime)
         {
-            merged[merge_index].uptime = merge_uptime;
-            err = interpolate(prev, current, &merged[merge_index]);
+            behind = ahead;
+            err = merge_iterate(&iterator, &ahead);
             if (err != E_SUCCESS)
             {
-                return err;
+                LOG_ERR("Merge with interpolation failed. Error %d.", err);
+                return E_ERROR;
+            }
+        }
+
+        // find the run of outputs that share this pair and the same period
+        size_t first_index, run_length;
+        sys_minutes_t period;
+        if (!reverse)
+        {
+            bool long_period = merge_index < long_periods_needed;
+            size_t last_index = long_period ? long_periods_needed : CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE - 1;
+            period = sample_base_period + (long_period ? 1 : 0);
+            run_length = last_index - merge_index;
+            if (period != 0)
+            {
+                run_length = MIN(run_length, (ahead.uptime - merge_uptime) / period);
             }
-            merge_index++;
-            merge_uptime += sample_base_period + (merge_index <= long_periods_needed ? 1 : 0);
+            run_length++;
+            first_index = merge_index;
         }
         else
         {
-            prev = current;
-            err = merge_iterate(&iterator, &current);
+            bool long_period = merge_index <= long_periods_needed;
+            size_t last_index = long_period ? 0 : long_periods_needed;
+            period = sample_base_period + (long_period ? 1 : 0);
+            run_length = merge_index - last_index;
+            // outputs must stay after 'ahead', unless it is the very first sample
+            if (period != 0 && merge_uptime > ahead.uptime)
+            {
+                run_length = MIN(run_length, (merge_uptime - ahead.uptime - 1) / period);
+            }
+            run_length++;
+            first_index = merge_index + 1 - run_length;
+        }
+
+        for (size_t i = first_index; i < first_index + run_length; i++)
+        {
+            if (decimation_write_is_unsafe(&iterator, dest, i))
+            {
+                return E_NOBUFS;
+            }
+        }
+        if (!dry_run)
+        {
+            sys_minutes_t first_uptime = start_uptime + first_index * sample_base_period + MIN(first_index, long_periods_needed);
+            err = interpolate_uniform(&behind, &ahead, first_uptime, period, run_length, &dest->uptime[first_index], &dest->temperature[first_index]);
             if (err != E_SUCCESS)
             {
                 LOG_ERR("Merge with interpolation failed. Error %d.", err);
                 return E_ERROR;
             }
         }
+        n += run_length;
+    }
+    if (!dry_run)
+    {
+        dest->length = CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE;
+    }
+    return E_SUCCESS;
+}
+
+/* One source of fast_decimation_sweep(). The next sample is kept, so every step reads each source once. */
+struct decimation_cursor_t
+{
+    struct temperature_source_t *source;
+    struct temperature_sample_t next; /* only valid while remaining > 0 */
+    size_t consumed;
+    size_t remaining;
+};
+
+static enum error_e load_decimation_cursor(struct decimation_cursor_t *c)
+{
+    if (c->remaining == 0)
+    {
+        return E_SUCCESS;
+    }
+    if (c->source->list != NULL)
+    {
+        c->next.uptime = c->source->list->uptime[c->consumed];
+        c->next.temperature = c->source->list->temperature[c->consumed];
+        return E_SUCCESS;
+    }
+    return read_temperature_segment(c->source->reader, &c->next) == E_SUCCESS ? E_SUCCESS : E_ERROR;
+}
+
+static enum error_e init_decimation_cursor(struct decimation_cursor_t *c, struct temperature_source_t *source)
+{
+    c->source = source;
+    c->consumed = 0;
+    c->remaining = get_source_length(source);
+    return load_decimation_cursor(c);
+}
+
+/**
+ * @brief Returns the next sample of two cursors in chronological order. On a tie, the one from c2 comes first, like merge_iterate().
+ */
+static inline enum error_e take_decimation_sample(struct decimation_cursor_t *c1, struct decimation_cursor_t *c2, struct temperature_sample_t *sample)
+{
+    struct decimation_cursor_t *c = c2->remaining == 0 || (c1->remaining != 0 && c1->next.uptime < c2->next.uptime) ? c1 : c2;
+    if (c->remaining == 0)
+    {
+        return E_ERROR;
+    }
+    *sample = c->next;
+    c->consumed++;
+    c->remaining--;
+    return load_decimation_cursor(c);
+}
+
+/**
+ * @brief Interpolates the temperature at 'uptime', which lies in [earlier->uptime, later->uptime].
+ * * Gives exactly the same result as interpolate_uniform(). When the two samples are less than
+ * UINT16_MAX minutes apart, the product of the temperature and the time differences fits in 32
+ * bits, so the division is a 32 bit one. That is the case for every pair but the odd long gap.
+ */
+static inline temperature_t interpolate_between(const struct temperature_sample_t *earlier, const struct temperature_sample_t *later, sys_minutes_t uptime)
+{
+    sys_minutes_t d_uptime = later->uptime - earlier->uptime;
+    if (d_uptime == 0)
+    {
+        return (temperature_t)divide_and_round((int32_t)earlier->temperature + (int32_t)later->temperature, 2);
+    }
+    int32_t d_temp = (int32_t)later->temperature - (int32_t)earlier->temperature;
+    uint32_t magnitude = (uint32_t)(d_temp < 0 ? -d_temp : d_temp);
+    uint32_t quotient;
+    if (d_uptime <= UINT16_MAX)
+    {
+        quotient = (magnitude * (uptime - earlier->uptime) + d_uptime / 2) / d_uptime;
+    }
+    else
+    {
+        quotient = (uint32_t)(((uint64_t)magnitude * (uptime - earlier->uptime) + d_uptime / 2) / d_uptime);
+    }
+    return (temperature_t)(d_temp < 0 ? earlier->temperature - (int32_t)quotient : earlier->temperature + (int32_t)quotient);
+}
+
+/**
+ * @brief Produces the uniformly spaced decimated samples front to back, for merges that are not in place.
+ * * Gives exactly the same result as a forward decimation_sweep(), but with a two pointer merge over
+ * the cached next samples instead of merge_iterate(), one output per step with the output time kept
+ * by addition, and no checks for overwritten source samples.
+ * Both sources MUST be non-empty and dest MUST NOT be one of them.
+ * ASSUMPTION: The caller MUST hold the lists' locks before calling.
+ * * @retval E_SUCCESS Sweep successful.
+ * @retval E_ERROR A segment reader failed.
+ */
+static enum error_e fast_decimation_sweep(struct temperature_source_t *src1, struct temperature_source_t *src2, struct temperature_list_t *dest)
+{
+    struct decimation_grid_t grid;
+    struct decimation_cursor_t c1, c2;
+    if (get_decimation_grid(src1, src2, &grid) != E_SUCCESS ||
+        init_decimation_cursor(&c1, src1) != E_SUCCESS ||
+        init_decimation_cursor(&c2, src2) != E_SUCCESS)
+    {
+        return E_ERROR;
+    }
+
+    // 'ahead' is the first sample at or after the output time. 'behind' is the one before it.
+    struct temperature_sample_t behind, ahead;
+    if (take_decimation_sample(&c1, &c2, &behind) != E_SUCCESS || take_decimation_sample(&c1, &c2, &ahead) != E_SUCCESS)
+    {
+        return E_ERROR;
     }
 
-    // copy the result to dest
-    memmove(dest->data, merged, sizeof(struct temperature_sample_t) * CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE);
+    sys_minutes_t uptime = grid.start_uptime;
+    for (size_t k = 0; k < CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE; k++)
+    {
+        // the last output is the latest sample, so this never runs past the end of both sources
+        while (uptime > ahead.uptime)
+        {
+            behind = ahead;
+            if (take_decimation_sample(&c1, &c2, &ahead) != E_SUCCESS)
+            {
+                LOG_ERR("Merge with interpolation failed.");
+                return E_ERROR;
+            }
+        }
+        dest->uptime[k] = uptime;
+        dest->temperature[k] = interpolate_between(&behind, &ahead, uptime);
+        uptime += grid.base_period + (k < grid.long_periods ? 1 : 0);
+    }
     dest->length = CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE;
     return E_SUCCESS;
 }
 
+/**
+ * @brief Merges two source lists into a destination list using uniform interpolation (decimation).
+ * * Used when the total number of input elements exceeds the list capacity.
+ * The result is a list of CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE samples uniformly spaced by time.
+ * The output is written straight into dest, and dest may be the same list as src1 or src2.
+ * If it is not, the specialized fast_decimation_sweep() is used. Otherwise a dry run picks a sweep direction (front to back or back to front) that never
+ * overwrites a sample before it is read. Only constant extra memory is used.
+ * ASSUMPTION: The caller MUST hold the lists' locks before calling.
+ * * @param src1 Pointer to the first source list.
+ * @param src2 Pointer to the second source list.
+ * @param dest Pointer to the destination list (output size = CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE).
+ * @retval E_SUCCESS Merge successful.
+ * @retval E_NOBUFS dest is a source and neither sweep direction can run in place. dest is unchanged.
+ * @retval E_ERROR An error occurred during iteration or interpolation.
+ * @retval E_NULL_PTR If any input pointer is NULL.
+ */
+EXPOSE_FOR_TESTING enum error_e merge_with_decimation(struct temperature_list_t *src1, struct temperature_list_t *src2, struct temperature_list_t *dest)
+{
+    if (src1 == NULL || src2 == NULL || dest == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (src1->length == 0 || src2->length == 0 || src1->length + src2->length <= CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE)
+    {
+        return E_INVAL;
+    }
+
+    struct temperature_source_t source1 = {.list = src1};
+    struct temperature_source_t source2 = {.list = src2};
+    if (dest != src1 && dest != src2)
+    {
+        return fast_decimation_sweep(&source1, &source2, dest);
+    }
+    if (decimation_sweep(&source1, &source2, dest, false, true) == E_SUCCESS)
+    {
+        return decimation_sweep(&source1, &source2, dest, false, false);
+    }
+    if (decimation_sweep(&source1, &source2, dest, true, true) == E_SUCCESS)
+    {
+        return decimation_sweep(&source1, &source2, dest, true, false);
+    }
+    LOG_ERR("Merge with interpolation cannot run in place for these lists.");
+    return E_NOBUFS;
+}
+
 /**
  * @brief Dispatcher function that selects between chronological merge and decimation/interpolation.
  * * If total length <= capacity, it calls merge_without_decimation.
  * Otherwise, it calls merge_with_decimation.
+ * dest may be the same list as src1 or src2.
  * ASSUMPTION: The caller MUST hold the lists' locks before calling.
  * * @param src1 Pointer to the first source list.
  * @param src2 Pointer to the second source list.
  * @param dest Pointer to the destination list.
  * @retval E_SUCCESS Merge successful.
  * @retval E_NULL_PTR If any input pointer is NULL.
+ * @retval E_NOBUFS The decimated merge cannot run in place. dest is unchanged.
  * @retval E_ERROR Propagated error from helper functions.
  */
 EXPOSE_FOR_TESTING enum error_e merge_temperature_lists(struct temperature_list_t *src1, struct temperature_list_t *src2, struct temperature_list_t *dest)
@@ -524,6 +1214,65 @@ EXPOSE_FOR_TESTING enum error_e merge_temperature_lists(struct temperature_list_
     {
         err = merge_with_decimation(src1, src2, dest);
     }
+    update_temperature_list_summary(dest);
+    return err;
+}
+
+/**
+ * @brief Merges two sources front to back into a destination list, decimating if needed.
+ * * Works like merge_temperature_lists(), but the sources may be segment readers, so the
+ * history can be merged without loading it into RAM first. Only one pass is made over each source.
+ * If both sources are lists, this is merge_temperature_lists() and dest may be one of them.
+ * Otherwise dest MUST NOT be one of the sources.
+ * ASSUMPTION: The caller MUST hold the lists' locks before calling.
+ * * @param src1 Pointer to the first source.
+ * @param src2 Pointer to the second source.
+ * @param dest Pointer to the destination list.
+ * @retval E_SUCCESS Merge successful.
+ * @retval E_INVAL dest is one of the sources, or a source is malformed.
+ * @retval E_ERROR A segment reader failed or interpolation failed.
+ * @retval E_NULL_PTR If any input pointer is NULL.
+ */
+EXPOSE_FOR_TESTING enum error_e merge_temperature_sources(struct temperature_source_t *src1, struct temperature_source_t *src2, struct temperature_list_t *dest)
+{
+    if (src1 == NULL || src2 == NULL || dest == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (src1->list != NULL && src2->list != NULL)
+    {
+        return merge_temperature_lists(src1->list, src2->list, dest);
+    }
+    if (src1->list == dest || src2->list == dest)
+    {
+        return E_INVAL;
+    }
+
+    struct merge_iterator_t iterator;
+    enum error_e err = init_source_merge_iterator(&iterator, src1, src2);
+    if (err != E_SUCCESS)
+    {
+        return err;
+    }
+    size_t length = get_source_length(src1) + get_source_length(src2);
+    if (length > CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE)
+    {
+        // a source never holds more than a full list, so both are non-empty here
+        err = fast_decimation_sweep(src1, src2, dest);
+    }
+    else
+    {
+        struct temperature_sample_t sample;
+        dest->length = 0;
+        while ((err = merge_iterate(&iterator, &sample)) == E_SUCCESS)
+        {
+            set_temperature_list_sample(dest, dest->length, sample);
+            dest->length++;
+        }
+        err = err == E_END_OF_ITER ? E_SUCCESS : err;
+    }
+    update_temperature_list_summary(dest);
     return err;
 }
 
@@ -532,62 +1281,561 @@ static bool temperature_list_is_full(struct temperature_list_t *t)
     return t != NULL && t->length == CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE;
 }
 
+/**
+ * @brief Merges the two oldest history segments of a channel into one to free up a segment.
+ * * The merge result replaces both segments with one index commit (see compact_oldest_temperature_segments()),
+ * so a power loss keeps either both segments or the merge result. Both segments are streamed out of NVS. The merge result is built in the channel's RAM list,
+ * so it MUST already be flushed.
+ * ASSUMPTION: The caller MUST hold the RAM list's lock before calling.
+ * * @param channel The channel to compact.
+ * @retval E_SUCCESS Compaction successful.
+ * @retval E_ERROR Propagated error from the history or merge functions.
+ */
+static enum error_e compact_temperature_history(size_t channel)
+{
+    struct temperature_list_t *list = &t_data.channels[channel].temperature_list;
+    struct temperature_history_index_t index;
+    get_temperature_history_index(channel, &index);
+
+    struct temperature_segment_reader_t *older = &t_data.compaction_readers[0];
+    struct temperature_segment_reader_t *newer = &t_data.compaction_readers[1];
+    enum error_e err = open_temperature_segment(older, channel, index.oldest_segment);
+    if (err != E_SUCCESS)
+    {
+        return err;
+    }
+    err = open_temperature_segment(newer, channel, index.oldest_segment + 1);
+    if (err != E_SUCCESS)
+    {
+        return err;
+    }
+    struct temperature_source_t src1 = {.reader = newer};
+    struct temperature_source_t src2 = {.reader = older};
+    err = merge_temperature_sources(&src1, &src2, list);
+    if (err != E_SUCCESS)
+    {
+        return err;
+    }
+    return compact_oldest_temperature_segments(channel, list);
+}
+
+/**
+ * @brief Rolls the oldest history segment of a channel up into the history tiers and drops it.
+ * * Unlike compact_temperature_history(), only the oldest segment is read and the RAM list is not touched.
+ * * @param channel The channel to roll up.
+ * @retval E_SUCCESS Roll-up successful.
+ * @retval E_ERROR Propagated error from the history or tier functions.
+ */
+static enum error_e roll_up_temperature_history(size_t channel)
+{
+    struct temperature_history_index_t index;
+    get_temperature_history_index(channel, &index);
+
+    struct temperature_segment_reader_t *oldest = &t_data.compaction_readers[0];
+    enum error_e err = open_temperature_segment(oldest, channel, index.oldest_segment);
+    if (err != E_SUCCESS)
+    {
+        return err;
+    }
+    err = roll_up_temperature_segment(channel, oldest);
+    if (err != E_SUCCESS)
+    {
+        return err;
+    }
+    return drop_oldest_temperature_segment(channel);
+}
+
+/**
+ * @brief Writes the full RAM list of a channel out as a new history segment and clears it.
+ * * Compaction runs lazily: only when all segments are in use after the write.
+ * With CONFIG_TEMPERATURE_LOGGER_TIERS the oldest segment is rolled up into the tiers,
+ * otherwise the two oldest segments are merged.
+ * ASSUMPTION: The caller MUST hold the RAM list's lock before calling.
+ * * @param channel The channel to flush.
+ * @retval E_SUCCESS Flush successful.
+ * @retval E_ERROR Propagated error from the history or merge functions.
+ */
+static enum error_e flush_temperature_list(size_t channel)
+{
+    struct temperature_list_t *list = &t_data.channels[channel].temperature_list;
+    enum error_e err;
+    struct temperature_history_index_t index;
+    get_temperature_history_index(channel, &index);
+    if (index.segment_count == CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT)
+    {
+        // the compaction after the previous flush failed. dont get stuck, make room instead
+        LOG_WRN("All history segments of channel %d are in use. Dropping the oldest segment.", (int)channel);
+        err = drop_oldest_temperature_segment(channel);
+        if (err != E_SUCCESS)
+        {
+            return err;
+        }
+    }
+
+    err = append_temperature_segment(channel, list);
+    if (err != E_SUCCESS)
+    {
+        return err;
+    }
+    reset_temperature_list(list);
+    // the journal is stale now that the index moved on, and the flushed samples are final
+    t_data.channels[channel].journaled_length = 0;
+    t_data.channels[channel].unjournaled_count = 0;
+    reset_sample_compressor(&t_data.channels[channel].compressor, INGEST_COMPRESSION_TOLERANCE);
+
+    get_temperature_history_index(channel, &index);
+    if (index.segment_count == CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT)
+    {
+        uint32_t start = begin_metrics_phase();
+        if (IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_TIERS))
+        {
+            err = roll_up_temperature_history(channel);
+        }
+        else
+        {
+            err = compact_temperature_history(channel);
+            // the RAM list was used as a buffer
+            reset_temperature_list(list);
+        }
+        end_metrics_phase(METRICS_PHASE_COMPACTION, start);
+    }
+    return err;
+}
+
 
 /**
- * @brief The handler function executed by the k_work_delayable structure.
- * * This is the central synchronization point. It acquires the locks, checks if the 
- * RAM list is full, performs the merge/store cycle if needed, takes a new sample, 
- * appends it, and reschedules itself.
- * * Synchronization: Acquires DOUBLE_LOCK on t_data.temperature_list and 
- * t_data.scratch_temperature_list for the entire execution.
+ * @brief Reads the samples that were journaled but not flushed before the last reset back and flushes them.
+ * * The uptime starts over after a reset, so the recovered samples are flushed as their own segment
+ * instead of being kept in the RAM list, where the new samples would sort before them.
+ * * @param channel The channel to recover.
+ */
+static void recover_temperature_journal(size_t channel)
+{
+    struct temperature_list_t *list = &t_data.channels[channel].temperature_list;
+    k_mutex_lock(&list->lock, K_FOREVER);
+    load_temperature_journal(channel, list);
+    if (list->length > 0)
+    {
+        LOG_INF("Recovered %d samples of channel %d from the journal.", (int)list->length, (int)channel);
+        update_temperature_list_summary(list);
+        // the journal is tagged with the segment the list becomes, so positions in the list stay valid
+        struct temperature_history_index_t index;
+        get_temperature_history_index(channel, &index);
+        size_t length = list->length;
+        enum error_e err = flush_temperature_list(channel);
+        if (err != E_SUCCESS)
+        {
+            LOG_ERR("Failed to flush the recovered samples of channel %d. Error %d.", (int)channel, err);
+            reset_temperature_list(list);
+        }
+        else
+        {
+            t_data.channels[channel].recovered_length = length;
+            t_data.channels[channel].recovered_segment = index.oldest_segment + index.segment_count;
+        }
+    }
+    k_mutex_unlock(&list->lock);
+}
+
+/**
+ * @brief Moves the clock past the newest sample in the history, so that new samples sort after it
+ * even before the clock has been synced.
+ * * Only the first block of the newest segment of every channel is read. Run this after the journal
+ * has been recovered, while the compaction worker is not running yet. The samples that are already
+ * in the sample queues are moved forward by drain_sample_queue().
+ */
+static void restore_time_from_history(void)
+{
+    sys_minutes_t newest = 0;
+    bool found = false;
+    struct temperature_segment_reader_t *reader = &t_data.compaction_readers[0];
+    for (size_t channel = 0; channel < CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT; channel++)
+    {
+        struct temperature_history_index_t index;
+        get_temperature_history_index(channel, &index);
+        if (index.segment_count == 0)
+        {
+            continue;
+        }
+        if (open_temperature_segment(reader, channel, index.oldest_segment + index.segment_count - 1) == E_SUCCESS && reader->length > 0)
+        {
+            newest = found ? MAX(newest, reader->last_uptime) : reader->last_uptime;
+            found = true;
+        }
+    }
+    if (found)
+    {
+        t_data.restored_time = newest + 1;
+        t_data.restore_shift = advance_time_in_minutes(newest + 1);
+    }
+}
+
+/**
+ * @brief Picks the period of the next sampling round.
+ * * Any change of at least CONFIG_TEMPERATURE_LOGGER_SAMPLING_THRESHOLD drops the period to
+ * the minimum. Otherwise the period doubles, up to the maximum. Flat stretches end up at the
+ * maximum period after a few rounds and a change is picked up within one round.
+ * * @param period The current period in seconds.
+ * @param largest_change The largest temperature change of any channel in this round.
+ */
+static uint32_t get_next_sampling_period(uint32_t period, int32_t largest_change)
+{
+    if (largest_change >= CONFIG_TEMPERATURE_LOGGER_SAMPLING_THRESHOLD)
+    {
+        return CONFIG_TEMPERATURE_LOGGER_MIN_SAMPLING_PERIOD;
+    }
+    return MIN(period * 2, CONFIG_TEMPERATURE_LOGGER_MAX_SAMPLING_PERIOD);
+}
+
+/**
+ * @brief The sampler. Executed by the k_work_delayable structure on sampling_workqueue.
+ * * Starts a conversion on all sensors at once and schedules perform_conversion_task() for when it is done.
+ * Nothing blocks while the sensor converts, so the workqueue stays free for other work.
  * * @param work Pointer to the k_work structure (unused but required).
  */
 static void perform_sampling_task(struct k_work *work)
 {
     LOG_DBG("Performing sampling task");
-    DOUBLE_LOCK(&t_data.temperature_list.lock, &t_data.scratch_temperature_list.lock, K_FOREVER);
+    // reschedule first so the period does not include the sensor read.
+    // perform_conversion_task() moves this once it has picked the next period
+    k_work_reschedule_for_queue(&sampling_workqueue, &t_data.sampling_task, K_SECONDS(t_data.sampling_period));
 
-    enum error_e err;
-    // if RAM list is not full, sample the temperature
-    // if the RAM list is full
-    // read the NVS list, merge the two lists, store the result in NVS, clear the RAM list, sample the temperature
+    t_data.sampling_start = k_uptime_get();
+    t_data.conversion_time = get_time_in_minutes();
+    enum error_e err = start_ds18b20_conversion();
+    if (err != E_SUCCESS)
+    {
+        LOG_ERR("Failed to complete sampling task. Error %d.", err);
+        return;
+    }
+    k_work_reschedule_for_queue(&sampling_workqueue, &t_data.conversion_task, get_ds18b20_conversion_time());
+}
 
-    if (temperature_list_is_full(&t_data.temperature_list))
+/**
+ * @brief Reads the finished conversions. Executed by the k_work_delayable structure on sampling_workqueue.
+ * * Pushes one sample per channel onto the channel's sample queue and wakes the compaction worker.
+ * No lock is taken, so the sampling period does not depend on flash latency.
+ * If a sensor cannot be read, or the compaction worker has fallen behind and the queue
+ * is full, only that channel's sample is dropped.
+ * * Afterwards the next sampling round is moved according to how much the temperatures changed.
+ * * @param work Pointer to the k_work structure (unused but required).
+ */
+static void perform_conversion_task(struct k_work *work)
+{
+    int32_t largest_change = 0;
+    size_t count = get_ds18b20_count();
+    for (size_t channel = 0; channel < count; channel++)
     {
-        err = load_temperature_list(&t_data.scratch_temperature_list);
+        struct temperature_channel_t *c = &t_data.channels[channel];
+        struct temperature_sample_t sample = {.uptime = t_data.conversion_time};
+        uint32_t start = begin_metrics_phase();
+        enum error_e err = read_ds18b20_temperature(channel, &sample.temperature);
+        end_metrics_phase(METRICS_PHASE_SAMPLE, start);
         if (err != E_SUCCESS)
         {
-            goto reschedule;
+            LOG_ERR("Failed to read temperature sample of channel %d. Error %d.", (int)channel, err);
+            continue;
         }
-        err = merge_temperature_lists(&t_data.temperature_list, &t_data.scratch_temperature_list, &t_data.scratch_temperature_list);
-        if (err != E_SUCCESS)
+        if (c->has_last_temperature)
         {
-            goto reschedule;
+            largest_change = MAX(largest_change, abs((int32_t)sample.temperature - (int32_t)c->last_temperature));
         }
-        err = store_temperature_list(&t_data.scratch_temperature_list);
+        c->last_temperature = sample.temperature;
+        c->has_last_temperature = true;
+
+        // an injection may have pushed samples stamped after the start of this conversion
+        sample.uptime = MAX(sample.uptime, c->last_pushed_time);
+        err = push_sample_queue(&c->sample_queue, sample);
         if (err != E_SUCCESS)
         {
-            goto reschedule;
+            LOG_WRN("Sample queue of channel %d is full. Dropping sample.", (int)channel);
+            continue;
         }
-        err = reset_temperature_list(&t_data.temperature_list);
-        if (err != E_SUCCESS)
+        c->last_pushed_time = sample.uptime;
+        record_metrics_milestone(METRICS_MILESTONE_FIRST_SAMPLE);
+    }
+    k_work_submit_to_queue(&app_workqueue, &t_data.compaction_task);
+    notify_uplink_sampling_round();
+
+    uint32_t period = get_next_sampling_period(t_data.sampling_period, largest_change);
+    uint32_t override = (uint32_t)atomic_get(&t_data.period_override);
+    period = override != 0 ? override : period;
+    if (period != t_data.sampling_period)
+    {
+        LOG_DBG("Sampling period changed to %u s.", period);
+        t_data.sampling_period = period;
+        int64_t elapsed = k_uptime_get() - t_data.sampling_start;
+        k_work_reschedule_for_queue(&sampling_workqueue, &t_data.sampling_task, K_MSEC(MAX((int64_t)period * 1000 - elapsed, 0)));
+    }
+}
+
+/**
+ * @brief Applies a new period override to the running round. Executed by the k_work structure on sampling_workqueue.
+ * * If a conversion is running, perform_conversion_task() picks the override up instead.
+ * * @param work Pointer to the k_work structure (unused but required).
+ */
+static void perform_period_task(struct k_work *work)
+{
+    uint32_t override = (uint32_t)atomic_get(&t_data.period_override);
+    // without an override, start adapting from the minimum, so a change is picked up within one round
+    t_data.sampling_period = override != 0 ? override : CONFIG_TEMPERATURE_LOGGER_MIN_SAMPLING_PERIOD;
+    if (!k_work_delayable_is_pending(&t_data.conversion_task))
+    {
+        int64_t elapsed = k_uptime_get() - t_data.sampling_start;
+        k_work_reschedule_for_queue(&sampling_workqueue, &t_data.sampling_task, K_MSEC(MAX((int64_t)t_data.sampling_period * 1000 - elapsed, 0)));
+    }
+}
+
+/**
+ * @brief Fixes the sampling period until it is cleared again or the device restarts.
+ * * Meant for diagnosis. The period is not stored.
+ * * @param seconds Seconds between sampling rounds. 0 to adapt the period to the temperatures again.
+ */
+void set_sampling_period_override(uint32_t seconds)
+{
+    atomic_set(&t_data.period_override, (atomic_val_t)seconds);
+    k_work_submit_to_queue(&sampling_workqueue, &t_data.period_task);
+}
+
+/**
+ * @brief Pushes synthetic samples onto a sample queue. Executed by the k_work_delayable structure on sampling_workqueue.
+ * * This is the producer side of the queue, just like perform_conversion_task(). Whenever the queue is full,
+ * the compaction worker is woken up and the task tries again INJECT_RETRY_DELAY later.
+ * * @param work Pointer to the k_work structure (unused but required).
+ */
+static void perform_inject_task(struct k_work *work)
+{
+    // the last decrement frees the slot for the next injection, so everything needed after it is copied first
+    size_t channel = t_data.inject_channel;
+    uint32_t count = t_data.inject_count;
+    int64_t start = t_data.inject_start;
+    struct temperature_channel_t *c = &t_data.channels[channel];
+    struct temperature_sample_t sample;
+    uint32_t remaining = (uint32_t)atomic_get(&t_data.inject_remaining);
+    while (remaining > 0)
+    {
+        // one minute apart and never before a sample a conversion pushed, so the queue stays in time order.
+        // the burst runs ahead of the clock. conversions are stamped after it until the clock catches up
+        sample.uptime = MAX(get_time_in_minutes(), c->last_pushed_time + 1);
+        // every sample lies more than the tolerance off the line between its neighbours, so none is compressed away
+        sample.temperature = c->last_temperature + (remaining % 2 == 0 ? INJECT_STEP : 0);
+        if (push_sample_queue(&c->sample_queue, sample) != E_SUCCESS)
         {
-            goto reschedule;
+            break;
         }
+        c->last_pushed_time = sample.uptime;
+        remaining = (uint32_t)atomic_dec(&t_data.inject_remaining) - 1;
+    }
+    k_work_submit_to_queue(&app_workqueue, &t_data.compaction_task);
+    if (remaining > 0)
+    {
+        k_work_reschedule_for_queue(&sampling_workqueue, &t_data.inject_task, INJECT_RETRY_DELAY);
+        return;
     }
+    int64_t elapsed = MAX(k_uptime_get() - start, 1);
+    LOG_INF("Injected %u samples into channel %d in %lld ms (%lld samples/s).", count, (int)channel,
+            (long long)elapsed, (long long)count * 1000 / elapsed);
+}
 
+/**
+ * @brief Injects synthetic samples into a channel as fast as the compaction worker stores them.
+ * * For stress tests of the ingest, flush and compaction paths on the device. The samples go through
+ * the sample queue like real ones and stay in the history. They are stamped one minute apart, starting
+ * at the current time or after the last sample pushed onto the queue, whichever is later.
+ * Their temperatures zigzag above the last reading of the channel. The rate is logged once all are in.
+ * * @param channel The channel.
+ * @param count Number of samples to inject.
+ * @retval E_SUCCESS Injection started.
+ * @retval E_RANGE The channel does not exist.
+ * @retval E_INVAL 'count' is 0.
+ * @retval E_BUSY An injection is already running.
+ */
+enum error_e inject_temperature_samples(size_t channel, uint32_t count)
+{
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        return E_RANGE;
+    }
+    if (count == 0)
+    {
+        return E_INVAL;
+    }
+    // claiming the slot first keeps a second caller from overwriting the channel of a running injection.
+    // the inject task does not read it before it is scheduled below
+    if (!atomic_cas(&t_data.inject_remaining, 0, (atomic_val_t)count))
+    {
+        return E_BUSY;
+    }
+    t_data.inject_channel = channel;
+    t_data.inject_count = count;
+    t_data.inject_start = k_uptime_get();
+    k_work_reschedule_for_queue(&sampling_workqueue, &t_data.inject_task, K_NO_WAIT);
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Drains the sample queue of one channel into its RAM list.
+ * * With CONFIG_TEMPERATURE_LOGGER_COMPRESSION, a sample that the line between its neighbours
+ * reconstructs is replaced by the next one instead of being kept (see sample-compressor.c).
+ * Whenever the RAM list is full, it is flushed to a new history segment first,
+ * compacting the oldest segments if they are all used. Afterwards the new samples are
+ * journaled once CONFIG_TEMPERATURE_LOGGER_JOURNAL_INTERVAL of them have piled up.
+ * * Synchronization: Acquires the channel's temperature_list.lock for the entire execution.
+ * * @param channel The channel to drain.
+ */
+static void drain_sample_queue(size_t channel)
+{
+    struct temperature_channel_t *c = &t_data.channels[channel];
+    k_mutex_lock(&c->temperature_list.lock, K_FOREVER);
+
+    enum error_e err;
     struct temperature_sample_t sample;
-    err = get_temperature_sample(&sample);
-    if (err != E_SUCCESS)
+    while (pop_sample_queue(&c->sample_queue, &sample) == E_SUCCESS)
+    {
+        if (sample.uptime < t_data.restored_time)
+        {
+            // taken before the clock was moved past the history at boot. move it by as much as the clock
+            sample.uptime += t_data.restore_shift;
+        }
+        if (IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_COMPRESSION) &&
+            compress_sample(&c->compressor, sample) == SAMPLE_COMPRESSOR_REPLACE)
+        {
+            replace_last_temperature_sample(&c->temperature_list, sample);
+            // the replaced sample may have been journaled already
+            c->journaled_length = MIN(c->journaled_length, c->temperature_list.length - 1);
+            c->unjournaled_count++;
+            continue;
+        }
+        if (temperature_list_is_full(&c->temperature_list))
+        {
+            err = flush_temperature_list(channel);
+            if (err != E_SUCCESS)
+            {
+                // the sample is lost, just like it would be if it was never taken
+                LOG_ERR("Failed to flush temperature list of channel %d. Error %d.", (int)channel, err);
+                reset_sample_compressor(&c->compressor, INGEST_COMPRESSION_TOLERANCE);
+                break;
+            }
+            // the flush reset the compressor. start it again from this sample
+            if (IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_COMPRESSION))
+            {
+                compress_sample(&c->compressor, sample);
+            }
+        }
+        append_temperature_sample(&c->temperature_list, sample);
+        c->unjournaled_count++;
+    }
+
+    // replacements count too, so the newest sample of a flat stretch is journaled as often as new samples would be
+    if (CONFIG_TEMPERATURE_LOGGER_JOURNAL_INTERVAL > 0 && c->unjournaled_count >= CONFIG_TEMPERATURE_LOGGER_JOURNAL_INTERVAL)
+    {
+        err = store_temperature_journal(channel, &c->temperature_list, c->journaled_length);
+        if (err == E_SUCCESS)
+        {
+            c->journaled_length = c->temperature_list.length;
+            c->unjournaled_count = 0;
+        }
+        else
+        {
+            // not fatal. the samples are still in RAM and the next round tries again
+            LOG_WRN("Failed to journal channel %d. Error %d.", (int)channel, err);
+        }
+    }
+    k_mutex_unlock(&c->temperature_list.lock);
+}
+
+/**
+ * @brief The compaction worker. Executed by the k_work structure on app_workqueue.
+ * * Drains the sample queues of all channels, one channel after the other, once the history has been loaded.
+ * Channels are never compacted at the same time, so they can share the compaction readers.
+ * * @param work Pointer to the k_work structure (unused but required).
+ */
+static void perform_compaction_task(struct k_work *work)
+{
+    LOG_DBG("Performing compaction task");
+    if (!atomic_get(&t_data.history_loaded))
     {
-        goto reschedule;
+        // the samples wait in the queues. load_temperature_logger_history() starts the worker again
+        return;
+    }
+    for (size_t channel = 0; channel < CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT; channel++)
+    {
+        drain_sample_queue(channel);
+    }
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_logger_status(const struct shell *sh, size_t argc, char **argv)
+{
+    uint32_t override = (uint32_t)atomic_get(&t_data.period_override);
+    shell_print(sh, "period=%u s%s", t_data.sampling_period, override != 0 ? " (fixed)" : "");
+    for (size_t channel = 0; channel < CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT; channel++)
+    {
+        struct temperature_channel_t *c = &t_data.channels[channel];
+        k_mutex_lock(&c->temperature_list.lock, K_FOREVER);
+        size_t length = c->temperature_list.length;
+        size_t unjournaled = c->unjournaled_count;
+        k_mutex_unlock(&c->temperature_list.lock);
+        struct temperature_history_index_t index;
+        get_temperature_history_index(channel, &index);
+        shell_print(sh, "channel %d: list=%u/%u queue=%u/%u unjournaled=%u segments=%u/%u oldest=%u", (int)channel,
+                    (unsigned int)length, CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE,
+                    (unsigned int)get_sample_queue_length(&c->sample_queue), CONFIG_TEMPERATURE_LOGGER_SAMPLE_QUEUE_SIZE,
+                    (unsigned int)unjournaled, index.segment_count, CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT, index.oldest_segment);
+    }
+    return 0;
+}
+
+static int cmd_logger_period(const struct shell *sh, size_t argc, char **argv)
+{
+    if (strcmp(argv[1], "auto") == 0)
+    {
+        set_sampling_period_override(0);
+        return 0;
+    }
+    char *end;
+    unsigned long seconds = strtoul(argv[1], &end, 10);
+    if (*end != '\0' || seconds == 0 || seconds > UINT16_MAX)
+    {
+        shell_error(sh, "Invalid period: %s", argv[1]);
+        return -EINVAL;
+    }
+    set_sampling_period_override((uint32_t)seconds);
+    return 0;
+}
+
+static int cmd_logger_inject(const struct shell *sh, size_t argc, char **argv)
+{
+    char *channel_end;
+    char *count_end;
+    unsigned long channel = strtoul(argv[1], &channel_end, 10);
+    unsigned long count = strtoul(argv[2], &count_end, 10);
+    if (*channel_end != '\0' || *count_end != '\0' || count == 0 || count > INT32_MAX)
+    {
+        shell_error(sh, "Usage: inject <channel> <count>");
+        return -EINVAL;
+    }
+    enum error_e err = inject_temperature_samples(channel, (uint32_t)count);
+    if (err == E_BUSY)
+    {
+        shell_error(sh, "An injection is already running.");
+        return -EBUSY;
     }
-    err = append_temperature_sample(&t_data.temperature_list, sample);
-reschedule:
     if (err != E_SUCCESS)
     {
-        LOG_ERR("Failed to complete sampling task. Error %d.", err);
+        shell_error(sh, "Invalid channel: %s", argv[1]);
+        return -EINVAL;
     }
-    k_work_reschedule(&t_data.sampling_task, K_SECONDS(30));
-    DOUBLE_UNLOCK(&t_data.temperature_list.lock, &t_data.scratch_temperature_list.lock);
-}
\ No newline at end of file
+    shell_print(sh, "Injecting %lu samples. The rate is logged when done.", count);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(logger_commands,
+                               SHELL_CMD(status, NULL, "Print the sampling period and how full the lists, queues and segments are.", cmd_logger_status),
+                               SHELL_CMD_ARG(period, NULL, "Fix the sampling period until the next restart.\n"
+                                                           "Usage: period <seconds>|auto", cmd_logger_period, 2, 0),
+                               SHELL_CMD_ARG(inject, NULL, "Push synthetic samples through the ingest path as fast as they are stored. They stay in the history.\n"
+                                                           "Usage: inject <channel> <count>", cmd_logger_inject, 3, 0),
+                               SHELL_SUBCMD_SET_END);
+SHELL_CMD_REGISTER(logger, &logger_commands, "Temperature logger diagnostics", NULL);
+#endif
@@ -0,0 +1,468 @@
+/*
+ * Temperature Tiers Module
+ * -----------------------------------------------------------------------------
+ * Keeps min/max/mean aggregates of old history at three resolutions
+ * (5 minutes, 1 hour, 1 day). See app/temperature-tiers.h for the layout.
+ *
+ * Decimating the whole history on every compaction costs a pass over all of it
+ * and blurs recent data as much as old data. Here every roll-up only touches the
+ * tier that overflowed:
+ * - a raw segment is rolled up into the 5 minute tier once the raw ring is full.
+ * - the oldest block of a full tier is rolled up into the next tier.
+ * Aggregates of the same bucket are combined, so a bucket split across two
+ * segments or blocks still ends up as one aggregate.
+ *
+ * During a roll-up the newest block of every tier is kept in RAM and written
+ * once at the end, followed by the channel's index record. A power loss before
+ * the index is written loses the roll-up but leaves the tiers readable. A block
+ * slot that was reused without its index being updated fails the sequence number
+ * check and is skipped.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/logging/log.h>
+#include "app/temperature-tiers.h"
+#include "app/nvs.h"
+
+LOG_MODULE_REGISTER(temp_tiers, LOG_LEVEL_DBG);
+
+#define TIER_FORMAT_AGGREGATES 0x01
+
+struct temperature_tier_block_header_t
+{
+    uint8_t format;
+    uint8_t tier;
+    uint8_t length;  /* number of aggregates in the block */
+    uint8_t reserved;
+    uint32_t block;  /* sequence number of the block */
+};
+
+struct temperature_tier_block_t
+{
+    struct temperature_tier_block_header_t header;
+    struct temperature_aggregate_t aggregates[TEMPERATURE_TIER_BLOCK_SIZE];
+};
+
+struct temperature_tier_writer_t
+{
+    struct temperature_tier_block_t open;  /* newest block of the tier */
+    struct temperature_tier_block_t spill; /* oldest block of the tier while it is rolled up */
+    bool dirty;                            /* open has not been written yet */
+};
+
+struct temperature_tiers_data_t
+{
+    struct temperature_tier_index_t index[CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT][TEMPERATURE_TIER_COUNT];
+    struct temperature_tier_writer_t writers[TEMPERATURE_TIER_COUNT]; /* only valid during a roll-up */
+    struct temperature_tier_index_t staged[TEMPERATURE_TIER_COUNT];   /* index of the channel being rolled up. only valid during a roll-up */
+    struct k_mutex lock;                                              /* protects index and writers */
+};
+
+BUILD_ASSERT(CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT <= NVS_KEY_TEMPERATURE_TIER_INDEX_LAST - NVS_KEY_TEMPERATURE_TIER_INDEX + 1,
+             "Not enough NVS keys are reserved for the tier indexes.");
+
+static struct temperature_tiers_data_t tr_data = {
+    .lock = Z_MUTEX_INITIALIZER(tr_data.lock),
+};
+
+static const sys_minutes_t tier_periods[TEMPERATURE_TIER_COUNT] = {5, 60, 24 * 60};
+
+static uint16_t tier_block_key(size_t channel, enum temperature_tier_e tier, uint32_t block)
+{
+    uint16_t ring = (uint16_t)(channel * TEMPERATURE_TIER_COUNT + tier);
+    return NVS_KEY_TEMPERATURE_TIER_BASE + ring * CONFIG_TEMPERATURE_LOGGER_TIER_BLOCK_COUNT + block % CONFIG_TEMPERATURE_LOGGER_TIER_BLOCK_COUNT;
+}
+
+/**
+ * @brief Returns the bucket length of a tier in minutes.
+ */
+sys_minutes_t get_temperature_tier_period(enum temperature_tier_e tier)
+{
+    return tier < TEMPERATURE_TIER_COUNT ? tier_periods[tier] : 0;
+}
+
+/**
+ * @brief Returns the mean of an aggregate, rounded to the nearest 1/16 degree.
+ */
+temperature_t get_temperature_aggregate_mean(const struct temperature_aggregate_t *a)
+{
+    if (a == NULL || a->count == 0)
+    {
+        return 0;
+    }
+    return (temperature_t)divide_and_round(a->sum, a->count);
+}
+
+/**
+ * @brief Writes the tier indexes of one channel to NVS and makes them the live ones. The caller MUST hold tr_data.lock.
+ * * tr_data.index is only updated once the write succeeded, so it never refers to blocks NVS does not know of.
+ * * @param index The indexes of all tiers of the channel. May point to tr_data.index[channel].
+ */
+static enum error_e store_tier_index_without_locking(size_t channel, const struct temperature_tier_index_t *index)
+{
+    size_t size = sizeof(tr_data.index[channel]);
+    ssize_t bytes_written = write_nvs(NVS_KEY_TEMPERATURE_TIER_INDEX + channel, index, size);
+    if ((size_t)bytes_written != size && bytes_written != 0)
+    {
+        LOG_ERR("Failed to write tier index of channel %d to NVS. Error %d.", (int)channel, (int)bytes_written);
+        return E_ERROR;
+    }
+    memmove(tr_data.index[channel], index, size);
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Loads the tier indexes of all channels from NVS.
+ * Initialize NVS before calling this function.
+ * * If a channel has no tier index yet, an empty one is created.
+ * * @retval E_SUCCESS All indexes loaded or created.
+ * @retval E_ERROR Read failed due to NVS error or an invalid index. That channel starts with empty tiers.
+ */
+enum error_e init_temperature_tiers(void)
+{
+    struct nvs_fs *fs = get_nvs_fs();
+    enum error_e err = E_SUCCESS;
+
+    k_mutex_lock(&tr_data.lock, K_FOREVER);
+    for (size_t channel = 0; channel < CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT; channel++)
+    {
+        size_t size = sizeof(tr_data.index[channel]);
+        ssize_t bytes_read = nvs_read(fs, NVS_KEY_TEMPERATURE_TIER_INDEX + channel, tr_data.index[channel], size);
+        if (bytes_read == -ENOENT)
+        {
+            memset(tr_data.index[channel], 0, size);
+            if (store_tier_index_without_locking(channel, tr_data.index[channel]) != E_SUCCESS)
+            {
+                err = E_ERROR;
+            }
+            continue;
+        }
+        bool valid = (size_t)bytes_read == size;
+        for (size_t tier = 0; valid && tier < TEMPERATURE_TIER_COUNT; tier++)
+        {
+            valid = tr_data.index[channel][tier].block_count <= CONFIG_TEMPERATURE_LOGGER_TIER_BLOCK_COUNT;
+        }
+        if (!valid)
+        {
+            LOG_ERR("Tier index of channel %d in NVS is invalid. Read %d bytes.", (int)channel, (int)bytes_read);
+            memset(tr_data.index[channel], 0, size);
+            err = E_ERROR;
+        }
+    }
+    k_mutex_unlock(&tr_data.lock);
+    return err;
+}
+
+/**
+ * @brief Reads one block of a tier and checks it.
+ * * @retval E_SUCCESS Block loaded.
+ * @retval E_ERROR Read failed, or the slot holds another block.
+ */
+static enum error_e load_tier_block(size_t channel, enum temperature_tier_e tier, uint32_t block, struct temperature_tier_block_t *b)
+{
+    struct nvs_fs *fs = get_nvs_fs();
+    ssize_t bytes_read = nvs_read(fs, tier_block_key(channel, tier, block), b, sizeof(struct temperature_tier_block_t));
+    if (bytes_read < (ssize_t)sizeof(b->header) || b->header.format != TIER_FORMAT_AGGREGATES || b->header.tier != tier ||
+        b->header.block != block || b->header.length > TEMPERATURE_TIER_BLOCK_SIZE ||
+        (size_t)bytes_read != sizeof(b->header) + b->header.length * sizeof(struct temperature_aggregate_t))
+    {
+        LOG_ERR("Block %u of tier %d of channel %d is missing or corrupted. Read %d bytes.", block, tier, (int)channel, (int)bytes_read);
+        return E_ERROR;
+    }
+    return E_SUCCESS;
+}
+
+static enum error_e store_tier_block(size_t channel, struct temperature_tier_block_t *b)
+{
+    size_t size = sizeof(b->header) + b->header.length * sizeof(struct temperature_aggregate_t);
+    ssize_t bytes_written = write_nvs(tier_block_key(channel, b->header.tier, b->header.block), b, size);
+    if ((size_t)bytes_written != size && bytes_written != 0)
+    {
+        LOG_ERR("Failed to write block %u of tier %d of channel %d to NVS. Error %d.", b->header.block, b->header.tier, (int)channel, (int)bytes_written);
+        return E_ERROR;
+    }
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Loads the newest block of every tier of a channel into the writers. The caller MUST hold tr_data.lock.
+ * * The roll-up works on a staged copy of the index. close_tier_writers() makes it the live one.
+ * A newest block that cannot be read is started over empty.
+ */
+static void open_tier_writers(size_t channel)
+{
+    memcpy(tr_data.staged, tr_data.index[channel], sizeof(tr_data.staged));
+    for (size_t tier = 0; tier < TEMPERATURE_TIER_COUNT; tier++)
+    {
+        struct temperature_tier_writer_t *w = &tr_data.writers[tier];
+        struct temperature_tier_index_t *index = &tr_data.staged[tier];
+        uint32_t newest = index->oldest_block + (index->block_count > 0 ? index->block_count - 1 : 0);
+        w->dirty = false;
+        if (index->block_count > 0 && load_tier_block(channel, tier, newest, &w->open) == E_SUCCESS)
+        {
+            continue;
+        }
+        w->open.header = (struct temperature_tier_block_header_t){
+            .format = TIER_FORMAT_AGGREGATES,
+            .tier = tier,
+            .block = newest,
+        };
+    }
+}
+
+static enum error_e append_tier_aggregate(size_t channel, enum temperature_tier_e tier, struct temperature_aggregate_t aggregate);
+
+/**
+ * @brief Drops the oldest block of a tier, rolling it up into the next tier first.
+ * The caller MUST hold tr_data.lock.
+ */
+static enum error_e roll_up_oldest_tier_block(size_t channel, enum temperature_tier_e tier)
+{
+    struct temperature_tier_writer_t *w = &tr_data.writers[tier];
+    struct temperature_tier_index_t *index = &tr_data.staged[tier];
+    enum error_e err = E_SUCCESS;
+
+    // the last tier has nowhere to go. its oldest block is simply dropped
+    if (tier + 1 < TEMPERATURE_TIER_COUNT && load_tier_block(channel, tier, index->oldest_block, &w->spill) == E_SUCCESS)
+    {
+        for (size_t i = 0; i < w->spill.header.length && err == E_SUCCESS; i++)
+        {
+            err = append_tier_aggregate(channel, tier + 1, w->spill.aggregates[i]);
+        }
+    }
+    index->oldest_block++;
+    index->block_count--;
+    return err;
+}
+
+/**
+ * @brief Adds an aggregate to a tier. The caller MUST hold tr_data.lock and have opened the writers.
+ * * The aggregate is moved to the tier's bucket and combined with the newest aggregate
+ * if they share a bucket. A full tier is rolled up first.
+ */
+static enum error_e append_tier_aggregate(size_t channel, enum temperature_tier_e tier, struct temperature_aggregate_t aggregate)
+{
+    struct temperature_tier_writer_t *w = &tr_data.writers[tier];
+    struct temperature_tier_index_t *index = &tr_data.staged[tier];
+    struct temperature_tier_block_t *b = &w->open;
+    enum error_e err;
+
+    aggregate.start -= aggregate.start % tier_periods[tier];
+    if (b->header.length > 0 && b->aggregates[b->header.length - 1].start == aggregate.start)
+    {
+        struct temperature_aggregate_t *last = &b->aggregates[b->header.length - 1];
+        last->sum += aggregate.sum;
+        last->count += aggregate.count;
+        last->min = MIN(last->min, aggregate.min);
+        last->max = MAX(last->max, aggregate.max);
+        w->dirty = true;
+        return E_SUCCESS;
+    }
+
+    if (index->block_count == 0)
+    {
+        b->header.block = index->oldest_block;
+        b->header.length = 0;
+        index->block_count = 1;
+    }
+    else if (b->header.length == TEMPERATURE_TIER_BLOCK_SIZE)
+    {
+        err = store_tier_block(channel, b);
+        if (err != E_SUCCESS)
+        {
+            return err;
+        }
+        w->dirty = false;
+        if (index->block_count == CONFIG_TEMPERATURE_LOGGER_TIER_BLOCK_COUNT)
+        {
+            err = roll_up_oldest_tier_block(channel, tier);
+            if (err != E_SUCCESS)
+            {
+                return err;
+            }
+        }
+        b->header.block = index->oldest_block + index->block_count;
+        b->header.length = 0;
+        index->block_count++;
+    }
+    b->aggregates[b->header.length++] = aggregate;
+    w->dirty = true;
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Writes the open blocks and the staged index of a channel. The caller MUST hold tr_data.lock.
+ * * If a write fails, the live index is left as it was before the roll-up.
+ */
+static enum error_e close_tier_writers(size_t channel)
+{
+    for (size_t tier = 0; tier < TEMPERATURE_TIER_COUNT; tier++)
+    {
+        struct temperature_tier_writer_t *w = &tr_data.writers[tier];
+        if (w->dirty)
+        {
+            enum error_e err = store_tier_block(channel, &w->open);
+            if (err != E_SUCCESS)
+            {
+                return err;
+            }
+            w->dirty = false;
+        }
+    }
+    return store_tier_index_without_locking(channel, tr_data.staged);
+}
+
+/**
+ * @brief Rolls the rest of a segment up into the 5 minute tier of a channel.
+ * * Full tiers are rolled up into the next tier along the way. The segment itself is not
+ * dropped. Call drop_oldest_temperature_segment() afterwards.
+ * * @param channel The channel the segment belongs to.
+ * @param reader Pointer to an opened segment reader. It is read to the end.
+ * @retval E_SUCCESS Segment rolled up and tiers written.
+ * @retval E_RANGE The channel does not exist.
+ * @retval E_ERROR NVS write failed, or the segment was corrupted. Samples read before the corruption are kept.
+ * @retval E_NULL_PTR If 'reader' is NULL.
+ */
+enum error_e roll_up_temperature_segment(size_t channel, struct temperature_segment_reader_t *reader)
+{
+    if (reader == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        return E_RANGE;
+    }
+
+    enum error_e err = E_SUCCESS;
+    enum error_e read_err;
+    struct temperature_sample_t sample;
+    k_mutex_lock(&tr_data.lock, K_FOREVER);
+    open_tier_writers(channel);
+    while (err == E_SUCCESS && (read_err = read_temperature_segment(reader, &sample)) == E_SUCCESS)
+    {
+        struct temperature_aggregate_t aggregate = {
+            .start = sample.uptime,
+            .sum = sample.temperature,
+            .count = 1,
+            .min = sample.temperature,
+            .max = sample.temperature,
+        };
+        err = append_tier_aggregate(channel, TEMPERATURE_TIER_5_MINUTES, aggregate);
+    }
+    if (err == E_SUCCESS)
+    {
+        err = close_tier_writers(channel);
+    }
+    if (err == E_SUCCESS && read_err == E_ERROR)
+    {
+        err = E_ERROR;
+    }
+    k_mutex_unlock(&tr_data.lock);
+    return err;
+}
+
+/**
+ * @brief Opens one tier of a channel for streaming.
+ * * The tier may be rolled up while it is being read. Blocks that were overwritten in the
+ * meantime are skipped.
+ * * @param reader Pointer to the reader to initialize.
+ * @param channel The channel.
+ * @param tier The tier.
+ * @retval E_SUCCESS Tier opened.
+ * @retval E_RANGE The channel or the tier does not exist.
+ * @retval E_NULL_PTR If 'reader' is NULL.
+ */
+enum error_e open_temperature_tier(struct temperature_tier_reader_t *reader, size_t channel, enum temperature_tier_e tier)
+{
+    if (reader == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT || tier >= TEMPERATURE_TIER_COUNT)
+    {
+        return E_RANGE;
+    }
+
+    reader->channel = channel;
+    reader->tier = tier;
+    k_mutex_lock(&tr_data.lock, K_FOREVER);
+    reader->index = tr_data.index[channel][tier];
+    k_mutex_unlock(&tr_data.lock);
+    reader->block = reader->index.oldest_block;
+    reader->length = 0;
+    reader->position = 0;
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Returns the next aggregate of the tier, oldest first.
+ * * @param reader Pointer to an opened reader.
+ * @param aggregate Pointer to the struct that receives the aggregate.
+ * @retval E_SUCCESS Aggregate returned.
+ * @retval E_END_OF_ITER All aggregates have been read.
+ * @retval E_NULL_PTR If 'reader' or 'aggregate' is NULL.
+ */
+enum error_e read_temperature_tier(struct temperature_tier_reader_t *reader, struct temperature_aggregate_t *aggregate)
+{
+    if (reader == NULL || aggregate == NULL)
+    {
+        LOG_ERR(GENERIC_NULL_PTR_ERROR_MESSAGE);
+        return E_NULL_PTR;
+    }
+
+    static struct temperature_tier_block_t block;
+    while (reader->position == reader->length)
+    {
+        if (reader->block == reader->index.oldest_block + reader->index.block_count)
+        {
+            return E_END_OF_ITER;
+        }
+        k_mutex_lock(&tr_data.lock, K_FOREVER);
+        if (load_tier_block(reader->channel, reader->tier, reader->block, &block) == E_SUCCESS)
+        {
+            memcpy(reader->buffer, block.aggregates, block.header.length * sizeof(struct temperature_aggregate_t));
+            reader->length = block.header.length;
+        }
+        else
+        {
+            reader->length = 0;
+        }
+        k_mutex_unlock(&tr_data.lock);
+        reader->position = 0;
+        reader->block++;
+    }
+    *aggregate = reader->buffer[reader->position++];
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Empties all tiers of a channel. The records are left in place and get reused.
+ * * @param channel The channel.
+ * @retval E_SUCCESS Index successfully updated.
+ * @retval E_RANGE The channel does not exist.
+ * @retval E_ERROR Write failed due to NVS error.
+ */
+enum error_e clear_temperature_tiers(size_t channel)
+{
+    if (channel >= CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT)
+    {
+        return E_RANGE;
+    }
+
+    struct temperature_tier_index_t cleared[TEMPERATURE_TIER_COUNT];
+    k_mutex_lock(&tr_data.lock, K_FOREVER);
+    for (size_t tier = 0; tier < TEMPERATURE_TIER_COUNT; tier++)
+    {
+        const struct temperature_tier_index_t *index = &tr_data.index[channel][tier];
+        // keep the sequence numbers going so stale records never match
+        cleared[tier] = (struct temperature_tier_index_t){.oldest_block = index->oldest_block + index->block_count};
+    }
+    enum error_e err = store_tier_index_without_locking(channel, cleared);
+    k_mutex_unlock(&tr_data.lock);
+    return err;
+}
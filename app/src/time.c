@@ -1,7 +1,205 @@
+/*
+ * Time Module
+ * -----------------------------------------------------------------------------
+ * Keeps the time samples are stamped with, in minutes since TIME_EPOCH_UNIX_SECONDS
+ * (see app/time.h).
+ *
+ * The time is the uptime plus an offset. The offset only ever grows:
+ * - At boot, the temperature logger moves it past the newest sample in the history
+ *   with advance_time_in_minutes(), so samples taken before the clock is synced
+ *   still sort after the ones from the previous boot.
+ * - With CONFIG_TEMPERATURE_LOGGER_SNTP, the clock is synced with
+ *   CONFIG_TEMPERATURE_LOGGER_SNTP_SERVER once the station has an address, and again
+ *   every CONFIG_TEMPERATURE_LOGGER_SNTP_INTERVAL seconds. If the clock ran ahead of
+ *   the server, it is not moved back. It keeps running from where it is.
+ *
+ * The sync task waits on Wi-Fi state changes with a triggered work item, so it costs
+ * nothing while the station is down. With CONFIG_TEMPERATURE_LOGGER_LOW_POWER, the
+ * station is acquired for the sync when it is due.
+ */
+
 #include <stdint.h>
 #include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
 #include "app/time.h"
 
+#ifdef CONFIG_TEMPERATURE_LOGGER_SNTP
+#include <zephyr/net/sntp.h>
+#include "app/wifi.h"
+#include "app/power-manager.h"
+#include "app/workqueue.h"
+
+#define TIME_SYNC_TIMEOUT_MS 3000
+#define TIME_SYNC_RETRY_SECONDS 60
+#define TIME_SYNC_CONNECT_TIMEOUT K_SECONDS(15)
+#endif
+
+LOG_MODULE_REGISTER(app_time, LOG_LEVEL_DBG);
+
+struct time_data_t
+{
+    atomic_t offset; /* minutes from the uptime to the time */
+    atomic_t synced; /* set once SNTP has set the clock */
+#ifdef CONFIG_TEMPERATURE_LOGGER_SNTP
+    int64_t next_sync;                /* k_uptime_get() when the clock is due to be synced. only used by the sync task */
+    struct k_poll_signal wifi_signal; /* raised on every Wi-Fi state change */
+    struct k_poll_event wifi_event;
+    struct k_work_poll sync_task;     /* runs on app_workqueue */
+#endif
+};
+
+static struct time_data_t ti_data;
+
 sys_minutes_t get_uptime_in_minutes() {
     return (sys_minutes_t)(k_uptime_get() / 1000 / 60);
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Returns the current time in minutes since TIME_EPOCH_UNIX_SECONDS. Never goes backwards.
+ */
+sys_minutes_t get_time_in_minutes(void)
+{
+    return get_uptime_in_minutes() + (sys_minutes_t)atomic_get(&ti_data.offset);
+}
+
+/**
+ * @brief Moves the clock forward so that it reads at least 'minimum'. Does nothing if it already does.
+ * * @return How many minutes the clock was moved forward. 0 if it was not moved.
+ */
+sys_minutes_t advance_time_in_minutes(sys_minutes_t minimum)
+{
+    atomic_val_t offset;
+    sys_minutes_t uptime;
+    do
+    {
+        offset = atomic_get(&ti_data.offset);
+        uptime = get_uptime_in_minutes();
+        if (uptime + (sys_minutes_t)offset >= minimum)
+        {
+            return 0;
+        }
+    } while (!atomic_cas(&ti_data.offset, offset, (atomic_val_t)(minimum - uptime)));
+    return minimum - uptime - (sys_minutes_t)offset;
+}
+
+/**
+ * @brief Sets the clock from a Unix time.
+ * * The clock only moves forward. If it is already ahead, it is left alone.
+ * * @param seconds Seconds since 1970-01-01 00:00 UTC.
+ * @retval E_SUCCESS Clock set.
+ * @retval E_INVAL The time lies before TIME_EPOCH_UNIX_SECONDS or too far after it.
+ */
+enum error_e set_time_in_unix_seconds(int64_t seconds)
+{
+    int64_t minutes = (seconds - TIME_EPOCH_UNIX_SECONDS) / 60;
+    if (seconds < TIME_EPOCH_UNIX_SECONDS || minutes > UINT32_MAX / 2)
+    {
+        LOG_ERR("Time %lld is out of range.", (long long)seconds);
+        return E_INVAL;
+    }
+    sys_minutes_t before = get_time_in_minutes();
+    advance_time_in_minutes((sys_minutes_t)minutes);
+    if (before > (sys_minutes_t)minutes)
+    {
+        LOG_WRN("Clock is %u minutes ahead of the time server. Keeping it.", before - (sys_minutes_t)minutes);
+    }
+    atomic_set(&ti_data.synced, 1);
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Returns whether the clock has been set from a time server since boot.
+ */
+bool time_is_synced(void)
+{
+    return atomic_get(&ti_data.synced) != 0;
+}
+
+#ifdef CONFIG_TEMPERATURE_LOGGER_SNTP
+/**
+ * @brief Queries the time server once. The station MUST be connected.
+ */
+static enum error_e sync_time(void)
+{
+    struct sntp_time time;
+    int ret = sntp_simple(CONFIG_TEMPERATURE_LOGGER_SNTP_SERVER, TIME_SYNC_TIMEOUT_MS, &time);
+    if (ret < 0)
+    {
+        LOG_WRN("Failed to get the time from %s. Error %d.", CONFIG_TEMPERATURE_LOGGER_SNTP_SERVER, ret);
+        return E_ERROR;
+    }
+    enum error_e err = set_time_in_unix_seconds((int64_t)time.seconds);
+    if (err == E_SUCCESS)
+    {
+        LOG_INF("Clock synced. Unix time is %llu.", (unsigned long long)time.seconds);
+    }
+    return err;
+}
+
+/**
+ * @brief The sync task. Executed by the triggered work item on app_workqueue.
+ * * Runs whenever the Wi-Fi state changes or the next sync is due. Syncs if the sync is due and the
+ * station is connected (or, with CONFIG_TEMPERATURE_LOGGER_LOW_POWER, can be acquired), then waits again.
+ * * @param work Pointer to the k_work structure (unused but required).
+ */
+static void perform_time_sync_task(struct k_work *work)
+{
+    // reset before reading the state, so a change that happens in between wakes us up again
+    k_poll_signal_reset(&ti_data.wifi_signal);
+    ti_data.wifi_event.state = K_POLL_STATE_NOT_READY;
+
+    struct wifi_state_t wifi_state;
+    get_wifi_state(&wifi_state);
+    bool connected = wifi_state.station_state == STATION_STATE_CONNECTED;
+    if (k_uptime_get() >= ti_data.next_sync)
+    {
+        bool acquired = false;
+        if (!connected && IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_LOW_POWER))
+        {
+            acquired = acquire_wifi_station(TIME_SYNC_CONNECT_TIMEOUT) == E_SUCCESS;
+            connected = acquired;
+        }
+        if (connected)
+        {
+            int64_t delay = sync_time() == E_SUCCESS ? CONFIG_TEMPERATURE_LOGGER_SNTP_INTERVAL : TIME_SYNC_RETRY_SECONDS;
+            ti_data.next_sync = k_uptime_get() + delay * 1000;
+        }
+        else if (IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_LOW_POWER))
+        {
+            ti_data.next_sync = k_uptime_get() + TIME_SYNC_RETRY_SECONDS * 1000;
+        }
+        if (acquired)
+        {
+            release_wifi_station();
+        }
+    }
+
+    // without low power, a sync that is due waits for the station to come up
+    k_timeout_t timeout = K_FOREVER;
+    if (connected || IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_LOW_POWER) || k_uptime_get() < ti_data.next_sync)
+    {
+        timeout = K_MSEC(MAX(ti_data.next_sync - k_uptime_get(), 0));
+    }
+    k_work_poll_submit_to_queue(&app_workqueue, &ti_data.sync_task, &ti_data.wifi_event, 1, timeout);
+}
+#endif
+
+/**
+ * @brief Starts syncing the clock with the time server. Does nothing without CONFIG_TEMPERATURE_LOGGER_SNTP.
+ * Initialize Wi-Fi, start app_workqueue and load the history of the temperature logger before calling this
+ * function, so the clock has been moved past the newest sample before the time server can set it.
+ */
+void init_time(void)
+{
+#ifdef CONFIG_TEMPERATURE_LOGGER_SNTP
+    k_poll_signal_init(&ti_data.wifi_signal);
+    k_poll_event_init(&ti_data.wifi_event, K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &ti_data.wifi_signal);
+    k_work_poll_init(&ti_data.sync_task, perform_time_sync_task);
+    if (subscribe_wifi_state(&ti_data.wifi_signal) != E_SUCCESS)
+    {
+        LOG_ERR("Failed to subscribe to Wi-Fi state changes. The clock will not be synced.");
+        return;
+    }
+    k_work_poll_submit_to_queue(&app_workqueue, &ti_data.sync_task, &ti_data.wifi_event, 1, K_NO_WAIT);
+#endif
+}
@@ -0,0 +1,398 @@
+/*
+ * Uplink Module
+ * -----------------------------------------------------------------------------
+ * Pushes the logged samples of every channel to a collector over UDP.
+ *
+ * Sending every sample on its own would keep the radio awake all the time.
+ * Instead, the uplink wakes up every CONFIG_TEMPERATURE_LOGGER_UPLINK_INTERVAL
+ * seconds and, if the station is connected, sends everything that arrived since
+ * the last burst in one go. Each datagram carries up to
+ * CONFIG_TEMPERATURE_LOGGER_UPLINK_BATCH_SIZE samples packed with the sample
+ * codec, the same encoding the history uses in NVS (see app/uplink.h).
+ *
+ * The uplink keeps no copy of the samples. It reads them back from the history
+ * segments and the RAM list through a history cursor (see app/history-cursor.h),
+ * starting at a per channel cursor. The cursors are
+ * stored in NVS after every burst, so whatever is still in the history when the
+ * connection comes back (or after a reboot) is sent then.
+ *
+ * With CONFIG_TEMPERATURE_LOGGER_LOW_POWER, the station is not expected to be
+ * up. A burst follows the first sampling round after the interval, acquires the
+ * station from the power manager only if there is something to send and releases
+ * it right after.
+ *
+ * Backpressure: a burst stops at the first datagram the stack can't take and the
+ * cursor stays on it. The rest goes out with the next burst.
+ *
+ * Limits:
+ * - Samples that are rolled up or compacted before they could be sent are lost
+ *   to the uplink. The cursor skips to the oldest live segment, which may send a
+ *   few samples again.
+ * - Samples of the RAM list that were not journaled are lost on reboot. A cursor into
+ *   the RAM list is reset to its start at boot, unless the journal brought it back. The
+ *   journal flushes the list into the segment it would have become, so the cursor keeps
+ *   its offset into it (see get_recovered_temperature_journal()).
+ * - UDP is not acknowledged. A sample counts as sent once the stack accepted it.
+ * - With CONFIG_TEMPERATURE_LOGGER_COMPRESSION, the newest sample of the RAM list may
+ *   still be replaced, so it is only sent once the next sample made it final.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/logging/log.h>
+#include "app/uplink.h"
+#include "app/nvs.h"
+#include "app/wifi.h"
+#include "app/power-manager.h"
+#include "app/workqueue.h"
+#include "app/temperature-logger.h"
+#include "app/temperature-history.h"
+#include "app/history-cursor.h"
+#include "app/sample-codec.h"
+#include "app/metrics.h"
+
+LOG_MODULE_REGISTER(uplink, LOG_LEVEL_DBG);
+
+#define UPLINK_CONNECT_TIMEOUT K_SECONDS(15)
+#define UPLINK_FRAME_MAX_SIZE (sizeof(struct uplink_frame_header_t) + SAMPLE_CODEC_MAX_ENCODED_SIZE(CONFIG_TEMPERATURE_LOGGER_UPLINK_BATCH_SIZE))
+
+BUILD_ASSERT(CONFIG_TEMPERATURE_LOGGER_UPLINK_BATCH_SIZE <= SAMPLE_CODEC_BLOCK_SIZE * 2,
+             "Uplink batches are limited to two codec blocks to stay within one datagram.");
+
+struct uplink_data_t
+{
+    struct uplink_cursor_t cursors[CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT];
+    struct uplink_cursor_t stored_cursors[CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT]; /* what NVS holds */
+    struct history_cursor_t history_cursor; /* reads the batches. reopened whenever it is not where the cursor of its channel is */
+    bool history_cursor_valid;
+    struct temperature_sample_t samples[CONFIG_TEMPERATURE_LOGGER_UPLINK_BATCH_SIZE];
+    uint8_t frame[UPLINK_FRAME_MAX_SIZE];
+    atomic_t next_burst;                 /* uptime in seconds when the next burst is due */
+    struct k_work_delayable uplink_task; /* runs on app_workqueue */
+};
+
+static void perform_uplink_task(struct k_work *work);
+
+// only the uplink task touches this after init
+static struct uplink_data_t u_data = {
+    .uplink_task = Z_WORK_DELAYABLE_INITIALIZER(perform_uplink_task),
+};
+
+/**
+ * @brief Writes the cursors to NVS if they moved since the last write.
+ */
+static enum error_e store_uplink_cursors(void)
+{
+    if (memcmp(u_data.cursors, u_data.stored_cursors, sizeof(u_data.cursors)) == 0)
+    {
+        return E_SUCCESS;
+    }
+    ssize_t bytes_written = write_nvs(NVS_KEY_UPLINK_CURSORS, u_data.cursors, sizeof(u_data.cursors));
+    if (bytes_written != sizeof(u_data.cursors) && bytes_written != 0)
+    {
+        LOG_ERR("Failed to write uplink cursors to NVS. Error %d.", (int)bytes_written);
+        return E_ERROR;
+    }
+    memcpy(u_data.stored_cursors, u_data.cursors, sizeof(u_data.cursors));
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Collects the next batch of unsent samples of a channel into u_data.samples.
+ * * Fully sent segments are skipped, but the cursor of the channel only moves once the batch has been sent.
+ * * @param channel The channel.
+ * @param count Pointer that receives the number of samples collected. 0 if everything has been sent.
+ * @param position Pointer that receives the position of the first sample of the batch.
+ * @retval E_SUCCESS Batch collected.
+ * @retval E_ERROR A history segment could not be read.
+ */
+static enum error_e collect_uplink_batch(size_t channel, size_t *count, struct uplink_cursor_t *position)
+{
+    struct uplink_cursor_t *cursor = &u_data.cursors[channel];
+    struct history_cursor_t *history_cursor = &u_data.history_cursor;
+    if (!u_data.history_cursor_valid || history_cursor->channel != channel ||
+        history_cursor->segment != cursor->segment || history_cursor->offset != cursor->offset)
+    {
+        open_history_cursor_at(history_cursor, channel, cursor->segment, cursor->offset, true);
+    }
+    u_data.history_cursor_valid = false;
+    enum error_e err = read_history_cursor(history_cursor, u_data.samples, ARRAY_SIZE(u_data.samples), count);
+    if (err != E_SUCCESS)
+    {
+        return err;
+    }
+    position->segment = history_cursor->segment;
+    position->offset = history_cursor->offset - *count;
+    if (*count == 0)
+    {
+        // nothing left. skip the sent segments for good
+        *cursor = *position;
+    }
+    u_data.history_cursor_valid = true;
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Packs a batch into u_data.frame.
+ * * @param size Pointer that receives the size of the frame.
+ * @retval E_SUCCESS Frame built.
+ * @retval E_ERROR The samples could not be packed.
+ */
+static enum error_e build_uplink_frame(size_t channel, size_t count, const struct uplink_cursor_t *position, size_t *size)
+{
+    struct uplink_frame_header_t header = {
+        .version = UPLINK_FRAME_VERSION,
+        .channel = (uint8_t)channel,
+        .count = (uint16_t)count,
+        .segment = position->segment,
+        .offset = (uint16_t)position->offset,
+    };
+    memcpy(u_data.frame, &header, sizeof(header));
+
+    struct sample_encoder_t encoder;
+    init_sample_encoder(&encoder, &u_data.frame[sizeof(header)], sizeof(u_data.frame) - sizeof(header));
+    for (size_t i = 0; i < count; i++)
+    {
+        if (encode_sample(&encoder, u_data.samples[i]) != E_SUCCESS)
+        {
+            LOG_ERR("Failed to pack uplink batch of channel %d.", (int)channel);
+            return E_ERROR;
+        }
+    }
+    *size = sizeof(header) + encoder.size;
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Sends every unsent sample of a channel, one batch per datagram.
+ * * @retval E_SUCCESS Everything has been sent.
+ * @retval E_BUSY The stack is out of buffers. The cursor stays on the first unsent batch.
+ * @retval E_IO Sending failed.
+ * @retval E_ERROR The history could not be read or packed.
+ */
+static enum error_e send_uplink_channel(int sock, size_t channel)
+{
+    while (true)
+    {
+        size_t count;
+        size_t size;
+        struct uplink_cursor_t position;
+        enum error_e err = collect_uplink_batch(channel, &count, &position);
+        if (err != E_SUCCESS || count == 0)
+        {
+            return err;
+        }
+        err = build_uplink_frame(channel, count, &position, &size);
+        if (err != E_SUCCESS)
+        {
+            return err;
+        }
+        if (zsock_send(sock, u_data.frame, size, 0) < 0)
+        {
+            if (errno == EAGAIN || errno == ENOMEM || errno == ENOBUFS)
+            {
+                return E_BUSY;
+            }
+            LOG_WRN("Failed to send uplink batch of channel %d. Error %d.", (int)channel, errno);
+            return E_IO;
+        }
+        record_metrics_milestone(METRICS_MILESTONE_FIRST_UPLINK);
+        u_data.cursors[channel].segment = position.segment;
+        u_data.cursors[channel].offset = position.offset + count;
+    }
+}
+
+/**
+ * @brief Opens a UDP socket connected to the collector.
+ * * @retval A socket. Negative if it could not be opened.
+ */
+static int open_uplink_socket(void)
+{
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_TEMPERATURE_LOGGER_UPLINK_PORT),
+    };
+    if (zsock_inet_pton(AF_INET, CONFIG_TEMPERATURE_LOGGER_UPLINK_HOST, &address.sin_addr) != 1)
+    {
+        LOG_ERR("Uplink collector address %s is invalid.", CONFIG_TEMPERATURE_LOGGER_UPLINK_HOST);
+        return -1;
+    }
+    int sock = zsock_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0)
+    {
+        LOG_ERR("Failed to create uplink socket. Error %d.", errno);
+        return -1;
+    }
+    if (zsock_connect(sock, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        LOG_ERR("Failed to connect uplink socket. Error %d.", errno);
+        zsock_close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/**
+ * @brief Sends everything that is pending on every channel. The station MUST be connected.
+ */
+static void send_uplink_burst(void)
+{
+    int sock = open_uplink_socket();
+    if (sock < 0)
+    {
+        return;
+    }
+    for (size_t channel = 0; channel < CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT; channel++)
+    {
+        enum error_e err = send_uplink_channel(sock, channel);
+        if (err == E_BUSY)
+        {
+            LOG_DBG("Uplink is backed up. Sending the rest with the next burst.");
+            break;
+        }
+        if (err != E_SUCCESS)
+        {
+            LOG_WRN("Uplink of channel %d failed. Error %d.", (int)channel, err);
+        }
+    }
+    zsock_close(sock);
+    store_uplink_cursors();
+}
+
+/**
+ * @brief Checks whether any channel has samples that have not been sent yet.
+ * * Moves the cursors past segments that have been sent completely.
+ */
+static bool uplink_has_pending_samples(void)
+{
+    for (size_t channel = 0; channel < CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT; channel++)
+    {
+        size_t count;
+        struct uplink_cursor_t position;
+        if (collect_uplink_batch(channel, &count, &position) == E_SUCCESS && count > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Sends one burst of everything that arrived since the last one.
+ * * With CONFIG_TEMPERATURE_LOGGER_LOW_POWER, the station is brought up for the burst if there is
+ * anything to send, and released afterwards. Otherwise, the burst only runs while the station is connected.
+ */
+static void perform_uplink_task(struct k_work *work)
+{
+    atomic_set(&u_data.next_burst, (atomic_val_t)(k_uptime_get() / 1000 + CONFIG_TEMPERATURE_LOGGER_UPLINK_INTERVAL));
+    if (IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_LOW_POWER))
+    {
+        // the next burst is started by notify_uplink_sampling_round(), so the SoC wakes up once for both
+        if (!uplink_has_pending_samples() || acquire_wifi_station(UPLINK_CONNECT_TIMEOUT) != E_SUCCESS)
+        {
+            return;
+        }
+    }
+    else
+    {
+        k_work_reschedule_for_queue(&app_workqueue, &u_data.uplink_task, K_SECONDS(CONFIG_TEMPERATURE_LOGGER_UPLINK_INTERVAL));
+        struct wifi_state_t wifi_state;
+        get_wifi_state(&wifi_state);
+        if (wifi_state.station_state != STATION_STATE_CONNECTED)
+        {
+            return;
+        }
+    }
+
+    send_uplink_burst();
+    if (IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_LOW_POWER))
+    {
+        release_wifi_station();
+    }
+}
+
+/**
+ * @brief Starts the uplink burst once it is due. Call this after every sampling round.
+ * * With CONFIG_TEMPERATURE_LOGGER_LOW_POWER, bursts are not timed on their own but follow
+ * a sampling round, so the SoC does not have to wake up twice. Does nothing otherwise.
+ */
+void notify_uplink_sampling_round(void)
+{
+    if (!IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_UPLINK) || !IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_LOW_POWER))
+    {
+        return;
+    }
+    if ((atomic_val_t)(k_uptime_get() / 1000) >= atomic_get(&u_data.next_burst))
+    {
+        // app_workqueue is FIFO, so this runs after the samples of the round have been stored
+        k_work_reschedule_for_queue(&app_workqueue, &u_data.uplink_task, K_NO_WAIT);
+    }
+}
+
+/**
+ * @brief Loads the uplink cursors from NVS and schedules the first burst.
+ * * Does nothing unless CONFIG_TEMPERATURE_LOGGER_UPLINK is enabled.
+ * Load the history of the temperature logger and start app_workqueue before calling this function.
+ * * @retval E_SUCCESS Uplink started, or disabled.
+ * @retval E_ERROR The cursors could not be read. Everything in the history will be sent again.
+ */
+enum error_e init_uplink(void)
+{
+    if (!IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_UPLINK))
+    {
+        return E_SUCCESS;
+    }
+
+    enum error_e err = E_SUCCESS;
+    struct nvs_fs *fs = get_nvs_fs();
+    ssize_t bytes_read = nvs_read(fs, NVS_KEY_UPLINK_CURSORS, u_data.cursors, sizeof(u_data.cursors));
+    if (bytes_read != sizeof(u_data.cursors))
+    {
+        if (bytes_read != -ENOENT)
+        {
+            LOG_ERR("Uplink cursors in NVS are invalid. Read %d bytes.", (int)bytes_read);
+            err = E_ERROR;
+        }
+    }
+    else
+    {
+        memcpy(u_data.stored_cursors, u_data.cursors, sizeof(u_data.cursors));
+    }
+
+    for (size_t channel = 0; channel < CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT; channel++)
+    {
+        struct temperature_history_index_t index;
+        get_temperature_history_index(channel, &index);
+        uint32_t recovered_segment;
+        size_t recovered = get_recovered_temperature_journal(channel, &recovered_segment);
+        if (bytes_read != sizeof(u_data.cursors))
+        {
+            // nothing has been sent yet. start with the oldest sample
+            u_data.cursors[channel].segment = index.oldest_segment;
+            u_data.cursors[channel].offset = 0;
+        }
+        else if (recovered > 0 && u_data.cursors[channel].segment == recovered_segment)
+        {
+            // the journal brought back the RAM list the cursor pointed into. the samples before the offset were sent.
+            // if the cursor was past the journal, the first read moves it on to the next segment
+            LOG_INF("Uplink of channel %d resumes at sample %u of the %d recovered ones.", (int)channel,
+                    u_data.cursors[channel].offset, (int)recovered);
+        }
+        else if (u_data.cursors[channel].segment == index.oldest_segment + index.segment_count)
+        {
+            // the RAM list the cursor pointed into was not journaled and did not survive the reboot
+            u_data.cursors[channel].offset = 0;
+        }
+        // a cursor that fell out of the history is moved back into it by the first read
+    }
+
+    atomic_set(&u_data.next_burst, (atomic_val_t)(k_uptime_get() / 1000 + CONFIG_TEMPERATURE_LOGGER_UPLINK_INTERVAL));
+    if (!IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_LOW_POWER))
+    {
+        k_work_reschedule_for_queue(&app_workqueue, &u_data.uplink_task, K_SECONDS(CONFIG_TEMPERATURE_LOGGER_UPLINK_INTERVAL));
+    }
+    return err;
+}
@@ -4,6 +4,9 @@
 #include <zephyr/net/dhcpv4_server.h>
 #include <zephyr/logging/log.h>
 #include "app/wifi.h"
+#include "app/config-settings.h"
+#include "app/workqueue.h"
+#include "app/metrics.h"
 
 LOG_MODULE_REGISTER(app_wifi, LOG_LEVEL_DBG);
 
@@ -13,6 +16,9 @@ LOG_MODULE_REGISTER(app_wifi, LOG_LEVEL_DBG);
 #define WIFI_AP_NETMASK "255.255.255.0"
 #define MACSTR "%02X:%02X:%02X:%02X:%02X:%02X"
 #define WIFI_STATION_TEST_TIMEOUT K_SECONDS(30)
+#define WIFI_STATE_SUBSCRIBERS_MAX 4
+#define PACK_WIFI_STATE(station, ap, logins, power_saving) \
+    ((atomic_val_t)(station) | (atomic_val_t)(ap) << 8 | (atomic_val_t)(logins) << 16 | (atomic_val_t)((power_saving) ? 1 : 0) << 24)
 #define WIFI_EVENTS_HANDLED (NET_EVENT_WIFI_CONNECT_RESULT |    \
                              NET_EVENT_WIFI_DISCONNECT_RESULT | \
                              NET_EVENT_WIFI_AP_ENABLE_RESULT |  \
@@ -27,23 +33,34 @@ struct wifi_data_t
     char station_ssid[WIFI_SSID_MAX_LENGTH + 1];
     char station_password[WIFI_PASSWORD_MAX_LENGTH + 1];
     bool dhcpv_server_enabled;
-    struct k_mutex mutex;                // Protects access to this struct
-    struct k_condvar connection_condvar; // signals station is connected or disconnected
+    struct k_mutex mutex;                // Protects access to this struct. Serializes state changes
+    atomic_t published_state;            // wifi_state packed with PACK_WIFI_STATE(). Read without the mutex
+    struct k_poll_signal *subscribers[WIFI_STATE_SUBSCRIBERS_MAX];
+    struct k_spinlock subscribers_lock;  // Protects subscribers
     struct wifi_connect_req_params ap_config;
     struct net_mgmt_event_callback wifi_event_cb;
     struct net_mgmt_event_callback ip_event_cb;
+    struct wifi_fast_connect_t fast_connect; /* copy of the cache in NVS */
+    bool fast_connect_attempt;               /* the running connect targets the cached AP */
+    struct k_work full_connect_task;         /* runs on the system workqueue */
+    struct k_work save_fast_connect_task;    /* runs on app_workqueue */
+    int64_t connect_started;                 /* uptime in ms of the last connect request, for metrics */
+    int64_t connect_accepted;                /* uptime in ms the AP accepted the station, for metrics */
 };
 
+static void perform_full_connect_task(struct k_work *work);
+static void perform_save_fast_connect_task(struct k_work *work);
+
 static struct wifi_data_t w_data = {
     .wifi_state = {
         .station_state = STATION_STATE_DISCONNECTED,
         .ap_state = AP_STATE_DISABLED,
         .logins_state = LOGINS_STATE_NOT_SET,
-        .power_saving_mode_enabled = false, // TODO: figure out how power saving mode works
+        .power_saving_mode_enabled = false,
     },
     .dhcpv_server_enabled = false,
     .mutex = Z_MUTEX_INITIALIZER(w_data.mutex),
-    .connection_condvar = Z_CONDVAR_INITIALIZER(w_data.connection_condvar),
+    .published_state = ATOMIC_INIT(PACK_WIFI_STATE(STATION_STATE_DISCONNECTED, AP_STATE_DISABLED, LOGINS_STATE_NOT_SET, false)),
     .ap_config = {
         .ssid = (const uint8_t *)WIFI_AP_SSID,
         .ssid_length = strlen(WIFI_AP_SSID),
@@ -52,7 +69,42 @@ static struct wifi_data_t w_data = {
         .channel = WIFI_CHANNEL_ANY,
         .band = WIFI_FREQ_BAND_2_4_GHZ,
         .security = WIFI_SECURITY_TYPE_PSK,
-    }};
+    },
+    .full_connect_task = Z_WORK_INITIALIZER(perform_full_connect_task),
+    .save_fast_connect_task = Z_WORK_INITIALIZER(perform_save_fast_connect_task),
+};
+
+static void unpack_wifi_state(atomic_val_t word, struct wifi_state_t *w)
+{
+    w->station_state = (enum wifi_station_state_e)(word & 0xFF);
+    w->ap_state = (enum wifi_ap_state_e)((word >> 8) & 0xFF);
+    w->logins_state = (enum logins_state_e)((word >> 16) & 0xFF);
+    w->power_saving_mode_enabled = ((word >> 24) & 1) != 0;
+}
+
+/**
+ * @brief Publishes w_data.wifi_state to lock-free readers and subscribers, then releases w_data.mutex.
+ * * Every change of the state is made under w_data.mutex, so unlocking through this function is
+ * enough to never miss one. Subscribers are only signalled if the state actually changed.
+ */
+static void publish_and_unlock_wifi_data(void)
+{
+    struct wifi_state_t *w = &w_data.wifi_state;
+    atomic_val_t word = PACK_WIFI_STATE(w->station_state, w->ap_state, w->logins_state, w->power_saving_mode_enabled);
+    if (atomic_set(&w_data.published_state, word) != word)
+    {
+        k_spinlock_key_t key = k_spin_lock(&w_data.subscribers_lock);
+        for (size_t i = 0; i < WIFI_STATE_SUBSCRIBERS_MAX; i++)
+        {
+            if (w_data.subscribers[i] != NULL)
+            {
+                k_poll_signal_raise(w_data.subscribers[i], (int)word);
+            }
+        }
+        k_spin_unlock(&w_data.subscribers_lock, key);
+    }
+    k_mutex_unlock(&w_data.mutex);
+}
 
 static enum error_e enable_dhcpv4_server_if_disabled(void)
 {
@@ -97,40 +149,187 @@ static enum error_e enable_dhcpv4_server_if_disabled(void)
     return E_SUCCESS;
 }
 
+static bool fast_connect_is_valid_without_locking(void)
+{
+    return w_data.fast_connect.channel != 0 &&
+           strncmp(w_data.fast_connect.wifi_ssid, w_data.station_ssid, sizeof(w_data.station_ssid)) == 0;
+}
+
+/**
+ * @brief Asks the driver to connect the station with the current logins.
+ * * The fast path targets the BSSID, channel and security of the last successful connect,
+ * so the driver only probes one channel instead of scanning all of them.
+ * The caller MUST hold w_data.mutex.
+ * * @param fast Try the cached AP. Ignored if nothing is cached for the current SSID.
+ * @retval The result of net_mgmt().
+ */
+static int request_station_connect_without_locking(bool fast)
+{
+    bool password_needed = w_data.station_password[0] != '\0';
+    struct wifi_connect_req_params station_config =
+        {
+            .ssid = (const uint8_t *)w_data.station_ssid,
+            .ssid_length = strlen(w_data.station_ssid),
+            .psk = (const uint8_t *)w_data.station_password,
+            .psk_length = strlen(w_data.station_password),
+            .security = password_needed ? WIFI_SECURITY_TYPE_PSK : WIFI_SECURITY_TYPE_NONE,
+            .channel = WIFI_CHANNEL_ANY,
+            .band = WIFI_FREQ_BAND_2_4_GHZ,
+        };
+    w_data.fast_connect_attempt = fast && fast_connect_is_valid_without_locking();
+    if (w_data.fast_connect_attempt)
+    {
+        station_config.channel = w_data.fast_connect.channel;
+        station_config.security = w_data.fast_connect.security;
+        memcpy(station_config.bssid, w_data.fast_connect.bssid, sizeof(station_config.bssid));
+        LOG_DBG("Fast connecting to " MACSTR " on channel %d.", w_data.fast_connect.bssid[0], w_data.fast_connect.bssid[1],
+                w_data.fast_connect.bssid[2], w_data.fast_connect.bssid[3], w_data.fast_connect.bssid[4],
+                w_data.fast_connect.bssid[5], w_data.fast_connect.channel);
+    }
+
+    return net_mgmt(
+        NET_REQUEST_WIFI_CONNECT,
+        net_if_get_wifi_sta(),
+        &station_config,
+        sizeof(struct wifi_connect_req_params));
+}
+
+/**
+ * @brief Records the time since 'since' (uptime in ms) as a Wi-Fi phase.
+ * The connect phases take seconds, longer than the cycle counter of end_metrics_phase() covers.
+ */
+static void record_wifi_phase(enum metrics_phase_e phase, int64_t since)
+{
+    int64_t elapsed = k_uptime_get() - since;
+    record_metrics_phase(phase, (uint32_t)CLAMP(elapsed, 0, UINT32_MAX / 1000) * 1000);
+}
+
+/**
+ * @brief Falls back to a full scan if the connect that just failed was a fast connect.
+ * * The cached AP is forgotten until the next successful connect.
+ * The caller MUST hold w_data.mutex.
+ * * @retval true A full connect has been scheduled. The station is still connecting.
+ * @retval false The failed connect was already a full one.
+ */
+static bool retry_with_full_scan_without_locking(void)
+{
+    if (!w_data.fast_connect_attempt)
+    {
+        return false;
+    }
+    LOG_INF("Fast connect to %s failed. Falling back to a full scan.", w_data.station_ssid);
+    w_data.fast_connect_attempt = false;
+    w_data.fast_connect.channel = 0;
+    w_data.wifi_state.station_state = STATION_STATE_CONNECTING;
+    k_work_submit(&w_data.full_connect_task);
+    return true;
+}
+
+static void perform_full_connect_task(struct k_work *work)
+{
+    k_mutex_lock(&w_data.mutex, K_FOREVER);
+    if (w_data.wifi_state.station_state == STATION_STATE_CONNECTING)
+    {
+        int ret = request_station_connect_without_locking(false);
+        if (ret != 0)
+        {
+            LOG_WRN("Failed to request station to connect (err=%d).", ret);
+            w_data.wifi_state.station_state = STATION_STATE_DISCONNECTED;
+        }
+    }
+    publish_and_unlock_wifi_data();
+}
+
+/**
+ * @brief Caches the AP the station is connected to, so the next connect can skip the scan.
+ * * Runs on app_workqueue because it may write to flash. NVS is only written when the AP changed.
+ */
+static void perform_save_fast_connect_task(struct k_work *work)
+{
+    struct wifi_iface_status status = {0};
+    int ret = net_mgmt(NET_REQUEST_WIFI_IFACE_STATUS, net_if_get_wifi_sta(), &status, sizeof(struct wifi_iface_status));
+    if (ret != 0 || status.state != WIFI_STATE_COMPLETED)
+    {
+        return;
+    }
+
+    struct wifi_fast_connect_t fast_connect = {
+        .channel = status.channel,
+        .security = status.security,
+    };
+    memcpy(fast_connect.bssid, status.bssid, sizeof(fast_connect.bssid));
+    k_mutex_lock(&w_data.mutex, K_FOREVER);
+    strncpy(fast_connect.wifi_ssid, w_data.station_ssid, sizeof(fast_connect.wifi_ssid));
+    bool changed = memcmp(&fast_connect, &w_data.fast_connect, sizeof(struct wifi_fast_connect_t)) != 0;
+    publish_and_unlock_wifi_data();
+    if (!changed)
+    {
+        return;
+    }
+
+    // the cache only takes the AP once it is stored, so the next connect tries to store it again
+    if (store_wifi_fast_connect(&fast_connect) != E_SUCCESS)
+    {
+        LOG_WRN("Failed to cache the AP of %s.", fast_connect.wifi_ssid);
+        return;
+    }
+    k_mutex_lock(&w_data.mutex, K_FOREVER);
+    memcpy(&w_data.fast_connect, &fast_connect, sizeof(struct wifi_fast_connect_t));
+    publish_and_unlock_wifi_data();
+}
+
 static void wifi_event_handler(struct net_mgmt_event_callback *cb, uint64_t mgmt_event, struct net_if *iface)
 {
     switch (mgmt_event)
     {
     case NET_EVENT_WIFI_CONNECT_RESULT:
     {
+        const struct wifi_status *status = (const struct wifi_status *)cb->info;
         k_mutex_lock(&w_data.mutex, K_FOREVER);
+        if (status != NULL && status->status != 0)
+        {
+            if (!retry_with_full_scan_without_locking())
+            {
+                LOG_WRN("Failed to connect to %s (status=%d).", w_data.station_ssid, status->status);
+                w_data.wifi_state.station_state = STATION_STATE_DISCONNECTED;
+                w_data.wifi_state.logins_state = LOGINS_STATE_SET_AND_INVALID;
+            }
+            publish_and_unlock_wifi_data();
+            break;
+        }
         LOG_INF("Connected to %s.", w_data.station_ssid);
+        record_wifi_phase(METRICS_PHASE_WIFI_CONNECT, w_data.connect_started);
+        w_data.connect_accepted = k_uptime_get();
+        w_data.fast_connect_attempt = false;
+        k_work_submit_to_queue(&app_workqueue, &w_data.save_fast_connect_task);
         if (w_data.wifi_state.station_state == STATION_STATE_CONNECTING_AND_WITH_IP)
         {
             w_data.wifi_state.station_state = STATION_STATE_CONNECTED;
+            record_metrics_milestone(METRICS_MILESTONE_WIFI_CONNECTED);
             w_data.wifi_state.logins_state = LOGINS_STATE_SET_AND_VALID;
-            LOG_DBG("Broadcasting stable station state.");
-            k_condvar_broadcast(&w_data.connection_condvar);
         }
         else
         {
             w_data.wifi_state.station_state = STATION_STATE_CONNECTED_WITHOUT_IP;
         }
-        k_mutex_unlock(&w_data.mutex);
+        publish_and_unlock_wifi_data();
         break;
     }
     case NET_EVENT_WIFI_DISCONNECT_RESULT:
     {
         k_mutex_lock(&w_data.mutex, K_FOREVER);
         LOG_INF("Disconnected from %s.", w_data.station_ssid);
+        if (STATION_STATE_IS_CONNECTING(w_data.wifi_state.station_state) && retry_with_full_scan_without_locking())
+        {
+            publish_and_unlock_wifi_data();
+            break;
+        }
         if (STATION_STATE_IS_CONNECTING(w_data.wifi_state.station_state))
         {
             w_data.wifi_state.logins_state = LOGINS_STATE_SET_AND_INVALID;
         }
         w_data.wifi_state.station_state = STATION_STATE_DISCONNECTED;
-        LOG_DBG("Broadcasting stable station state.");
-        k_condvar_broadcast(&w_data.connection_condvar);
-        k_mutex_unlock(&w_data.mutex);
+        publish_and_unlock_wifi_data();
         break;
     }
     case NET_EVENT_WIFI_AP_ENABLE_RESULT:
@@ -138,7 +337,7 @@ static void wifi_event_handler(struct net_mgmt_event_callback *cb, uint64_t mgmt
         k_mutex_lock(&w_data.mutex, K_FOREVER);
         LOG_INF("AP Mode is enabled. Waiting for station to connect");
         w_data.wifi_state.ap_state = AP_STATE_ENABLED;
-        k_mutex_unlock(&w_data.mutex);
+        publish_and_unlock_wifi_data();
         break;
     }
     case NET_EVENT_WIFI_AP_DISABLE_RESULT:
@@ -146,7 +345,7 @@ static void wifi_event_handler(struct net_mgmt_event_callback *cb, uint64_t mgmt
         k_mutex_lock(&w_data.mutex, K_FOREVER);
         LOG_INF("AP Mode is disabled.");
         w_data.wifi_state.ap_state = AP_STATE_DISABLED;
-        k_mutex_unlock(&w_data.mutex);
+        publish_and_unlock_wifi_data();
         break;
     }
     case NET_EVENT_WIFI_AP_STA_CONNECTED:
@@ -177,21 +376,23 @@ static void ip_event_handler(struct net_mgmt_event_callback *cb, uint64_t mgmt_e
         LOG_INF("Got an IP address.");
         if (w_data.wifi_state.station_state == STATION_STATE_CONNECTED_WITHOUT_IP)
         {
+            record_wifi_phase(METRICS_PHASE_WIFI_DHCP, w_data.connect_accepted);
             w_data.wifi_state.station_state = STATION_STATE_CONNECTED;
+            record_metrics_milestone(METRICS_MILESTONE_WIFI_CONNECTED);
             w_data.wifi_state.logins_state = LOGINS_STATE_SET_AND_VALID;
-            LOG_DBG("Broadcasting stable station state.");
-            k_condvar_broadcast(&w_data.connection_condvar);
         }
         else
         {
             w_data.wifi_state.station_state = STATION_STATE_CONNECTING_AND_WITH_IP;
         }
-        k_mutex_unlock(&w_data.mutex);
+        publish_and_unlock_wifi_data();
     }
 }
 
 void init_wifi(void)
 {
+    // a missing cache only means the first connect scans every channel
+    load_wifi_fast_connect(&w_data.fast_connect);
     net_mgmt_init_event_callback(
         &w_data.wifi_event_cb,
         wifi_event_handler,
@@ -219,7 +420,7 @@ enum error_e set_wifi_logins(char *ssid, char *password)
     strncpy(w_data.station_password, password, sizeof(w_data.station_password));
     w_data.wifi_state.logins_state = LOGINS_STATE_SET_AND_NOT_TESTED;
 unlock:
-    k_mutex_unlock(&w_data.mutex);
+    publish_and_unlock_wifi_data();
     return err;
 }
 
@@ -248,23 +449,13 @@ enum error_e enable_wifi_station(void)
         err = E_PERM;
         goto unlock;
     }
-    bool password_needed = w_data.station_password[0] != '\0';
-    struct wifi_connect_req_params station_config =
-        {
-            .ssid = (const uint8_t *)w_data.station_ssid,
-            .ssid_length = strlen(w_data.station_ssid),
-            .psk = (const uint8_t *)w_data.station_password,
-            .psk_length = strlen(w_data.station_password),
-            .security = password_needed ? WIFI_SECURITY_TYPE_PSK : WIFI_SECURITY_TYPE_NONE,
-            .channel = WIFI_CHANNEL_ANY,
-            .band = WIFI_FREQ_BAND_2_4_GHZ,
-        };
-
-    int ret = net_mgmt(
-        NET_REQUEST_WIFI_CONNECT,
-        net_if_get_wifi_sta(),
-        &station_config,
-        sizeof(struct wifi_connect_req_params));
+    w_data.connect_started = k_uptime_get();
+    int ret = request_station_connect_without_locking(true);
+    if (ret != 0 && w_data.fast_connect_attempt)
+    {
+        LOG_DBG("Driver refused the fast connect. Falling back to a full scan.");
+        ret = request_station_connect_without_locking(false);
+    }
     if (ret != 0)
     {
         LOG_WRN("Failed to request station to connect (err=%d).", ret);
@@ -277,10 +468,42 @@ enum error_e enable_wifi_station(void)
         w_data.wifi_state.station_state = STATION_STATE_CONNECTING;
     }
 unlock:
-    k_mutex_unlock(&w_data.mutex);
+    publish_and_unlock_wifi_data();
     return err;
 }
 
+/**
+ * @brief Sets the station logins from the config settings and starts connecting in the background.
+ * * Does not wait for the connection. With a cached AP (struct wifi_fast_connect_t), the connect skips
+ * the scan. With CONFIG_TEMPERATURE_LOGGER_LOW_POWER, only the logins are set, since the power
+ * manager brings the station up when it is needed.
+ * Initialize the config settings and Wi-Fi before calling this function.
+ * * @retval E_SUCCESS Connecting, or the logins are set with CONFIG_TEMPERATURE_LOGGER_LOW_POWER.
+ * @retval E_WIFI_LOGINS_NOT_SET The config settings hold no logins.
+ * @retval E_ERROR The connect could not be started.
+ */
+enum error_e start_wifi_station_from_config_settings(void)
+{
+    struct config_settings_t c;
+    load_config_settings(&c);
+    if ((uint8_t)c.wifi_ssid[0] == RESET_WIFI_SSID_VALUE || (uint8_t)c.wifi_password[0] == RESET_WIFI_PASSWORD_VALUE)
+    {
+        LOG_INF("No Wi-Fi logins are configured. The station stays down.");
+        return E_WIFI_LOGINS_NOT_SET;
+    }
+    enum error_e err = set_wifi_logins(c.wifi_ssid, c.wifi_password);
+    if (err != E_SUCCESS)
+    {
+        return E_ERROR;
+    }
+    if (IS_ENABLED(CONFIG_TEMPERATURE_LOGGER_LOW_POWER))
+    {
+        return E_SUCCESS;
+    }
+    err = enable_wifi_station();
+    return err == E_SUCCESS || err == E_IN_PROGRESS || err == E_ALREADY_DONE ? E_SUCCESS : E_ERROR;
+}
+
 enum error_e disable_wifi_station(void)
 {
     k_mutex_lock(&w_data.mutex, K_FOREVER);
@@ -319,7 +542,7 @@ enum error_e disable_wifi_station(void)
         w_data.wifi_state.station_state = STATION_STATE_DISCONNECTING;
     }
 unlock:
-    k_mutex_unlock(&w_data.mutex);
+    publish_and_unlock_wifi_data();
     return err;
 }
 
@@ -370,7 +593,7 @@ enum error_e enable_wifi_ap(void)
     }
 
 unlock:
-    k_mutex_unlock(&w_data.mutex);
+    publish_and_unlock_wifi_data();
     return err;
 }
 
@@ -411,81 +634,184 @@ enum error_e disable_wifi_ap(void)
     }
 
 unlock:
-    k_mutex_unlock(&w_data.mutex);
+    publish_and_unlock_wifi_data();
     return err;
 }
 
-void get_wifi_state(struct wifi_state_t *w)
+/**
+ * @brief Turns the station's power saving mode on or off.
+ * * With power saving on, the radio sleeps between DTIM beacons of the AP while the station
+ * is connected. This adds latency to incoming packets but cuts the idle current of a connection.
+ * * @param enabled Whether power saving should be on.
+ * @retval E_SUCCESS The driver accepted the setting.
+ * @retval E_ALREADY_DONE The setting is already active.
+ * @retval E_ERROR The driver refused the setting.
+ */
+enum error_e set_wifi_power_saving(bool enabled)
 {
     k_mutex_lock(&w_data.mutex, K_FOREVER);
-    memcpy(w, &w_data.wifi_state, sizeof(struct wifi_state_t));
-    k_mutex_unlock(&w_data.mutex);
+    enum error_e err = E_SUCCESS;
+    if (w_data.wifi_state.power_saving_mode_enabled == enabled)
+    {
+        err = E_ALREADY_DONE;
+        goto unlock;
+    }
+    struct wifi_ps_params params = {
+        .type = WIFI_PS_PARAM_STATE,
+        .enabled = enabled ? WIFI_PS_ENABLED : WIFI_PS_DISABLED,
+    };
+    int ret = net_mgmt(
+        NET_REQUEST_WIFI_PS,
+        net_if_get_wifi_sta(),
+        &params,
+        sizeof(struct wifi_ps_params));
+    if (ret != 0)
+    {
+        LOG_WRN("Failed to set power saving mode (err=%d).", ret);
+        err = E_ERROR;
+        goto unlock;
+    }
+    w_data.wifi_state.power_saving_mode_enabled = enabled;
+unlock:
+    publish_and_unlock_wifi_data();
+    return err;
 }
 
-static enum error_e wait_for_station_steady_state_without_locking(k_timeout_t timeout)
+/**
+ * @brief Copies the current Wi-Fi state. Never blocks.
+ * * The state is read from a single atomic word, so the copy is always consistent even
+ * while a connect or disconnect is in progress.
+ */
+void get_wifi_state(struct wifi_state_t *w)
 {
-    enum wifi_station_state_e current = w_data.wifi_state.station_state;
+    unpack_wifi_state(atomic_get(&w_data.published_state), w);
+}
 
-    if (current == STATION_STATE_CONNECTED || current == STATION_STATE_DISCONNECTED)
+/**
+ * @brief Subscribes a poll signal to Wi-Fi state changes.
+ * * The signal is raised after every change with the packed state as its result. Poll it with
+ * k_poll(), then reset it with k_poll_signal_reset() and read the state with get_wifi_state().
+ * Changes that happen before the reset are merged into one.
+ * * @param signal An initialized poll signal that stays valid until it is unsubscribed.
+ * @retval E_SUCCESS Subscribed.
+ * @retval E_NOSPC All subscriber slots are taken.
+ * @retval E_NULL_PTR If 'signal' is NULL.
+ */
+enum error_e subscribe_wifi_state(struct k_poll_signal *signal)
+{
+    if (signal == NULL)
     {
-        return E_SUCCESS;
+        return E_NULL_PTR;
+    }
+    enum error_e err = E_NOSPC;
+    k_spinlock_key_t key = k_spin_lock(&w_data.subscribers_lock);
+    for (size_t i = 0; i < WIFI_STATE_SUBSCRIBERS_MAX; i++)
+    {
+        if (w_data.subscribers[i] == NULL)
+        {
+            w_data.subscribers[i] = signal;
+            err = E_SUCCESS;
+            break;
+        }
     }
+    k_spin_unlock(&w_data.subscribers_lock, key);
+    return err;
+}
 
-    LOG_DBG("Station is transient. Waiting on condvar for timeout.");
-    int result = k_condvar_wait(&w_data.connection_condvar, &w_data.mutex, timeout);
-    if (result == -EAGAIN)
+/**
+ * @brief Removes a signal added with subscribe_wifi_state(). Unknown signals are ignored.
+ */
+void unsubscribe_wifi_state(struct k_poll_signal *signal)
+{
+    k_spinlock_key_t key = k_spin_lock(&w_data.subscribers_lock);
+    for (size_t i = 0; i < WIFI_STATE_SUBSCRIBERS_MAX; i++)
     {
-        LOG_WRN("Station did not reach steady state within the timeout.");
-        return E_TIMEOUT;
+        if (w_data.subscribers[i] == signal)
+        {
+            w_data.subscribers[i] = NULL;
+        }
     }
+    k_spin_unlock(&w_data.subscribers_lock, key);
+}
 
-    return E_SUCCESS;
+static bool station_state_is_steady(enum wifi_station_state_e state)
+{
+    return state == STATION_STATE_CONNECTED || state == STATION_STATE_DISCONNECTED;
 }
 
+/**
+ * @brief Waits until the station is connected or disconnected.
+ * * Does not hold w_data.mutex while waiting, so every other call stays responsive.
+ * * @param timeout The longest time to wait.
+ * @retval E_SUCCESS The station is connected or disconnected.
+ * @retval E_TIMEOUT The station is still connecting or disconnecting.
+ * @retval E_NOSPC All subscriber slots are taken.
+ */
 enum error_e wait_for_station_steady_state(k_timeout_t timeout)
 {
-    k_mutex_lock(&w_data.mutex, K_FOREVER);
-    enum error_e err = wait_for_station_steady_state_without_locking(timeout);
-    k_mutex_unlock(&w_data.mutex);
+    struct k_poll_signal signal;
+    k_poll_signal_init(&signal);
+    enum error_e err = subscribe_wifi_state(&signal);
+    if (err != E_SUCCESS)
+    {
+        return err;
+    }
+
+    struct k_poll_event event = K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &signal);
+    k_timepoint_t deadline = sys_timepoint_calc(timeout);
+    struct wifi_state_t state;
+    get_wifi_state(&state);
+    while (!station_state_is_steady(state.station_state))
+    {
+        LOG_DBG("Station is transient. Waiting for a state change.");
+        if (k_poll(&event, 1, sys_timepoint_timeout(deadline)) != 0)
+        {
+            LOG_WRN("Station did not reach steady state within the timeout.");
+            err = E_TIMEOUT;
+            break;
+        }
+        k_poll_signal_reset(&signal);
+        event.state = K_POLL_STATE_NOT_READY;
+        get_wifi_state(&state);
+    }
+    unsubscribe_wifi_state(&signal);
     return err;
 }
 
 enum error_e test_wifi_logins(enum logins_state_e *state)
 {
-    k_mutex_lock(&w_data.mutex, K_FOREVER);
-    enum error_e err = E_SUCCESS;
-
-    if (w_data.wifi_state.logins_state == LOGINS_STATE_NOT_SET)
+    struct wifi_state_t current;
+    get_wifi_state(&current);
+    if (current.logins_state == LOGINS_STATE_NOT_SET)
     {
         LOG_WRN("Attempted to test wifi without setting logins.");
         *state = LOGINS_STATE_NOT_SET;
-        goto unlock;
+        return E_SUCCESS;
     }
 
     LOG_DBG("Starting test for wifi logins.");
-    err = wait_for_station_steady_state_without_locking(WIFI_STATION_TEST_TIMEOUT);
-    if (err == E_TIMEOUT)
+    enum error_e err = wait_for_station_steady_state(WIFI_STATION_TEST_TIMEOUT);
+    if (err != E_SUCCESS)
     {
-        goto unlock;
+        return err;
     }
 
     // state is either disconnected or connected now
-    // if already connected or logins not set
-    // then login state is already known
-    if (w_data.wifi_state.station_state == STATION_STATE_DISCONNECTED)
+    // if already connected, the login state is already known
+    get_wifi_state(&current);
+    if (current.station_state == STATION_STATE_DISCONNECTED)
     {
         enable_wifi_station();
-        err = wait_for_station_steady_state_without_locking(WIFI_STATION_TEST_TIMEOUT);
-        if (err == E_TIMEOUT)
+        err = wait_for_station_steady_state(WIFI_STATION_TEST_TIMEOUT);
+        if (err != E_SUCCESS)
         {
-            goto unlock;
+            return err;
         }
+        get_wifi_state(&current);
     }
-    *state = w_data.wifi_state.logins_state;
+    *state = current.logins_state;
     LOG_INF("Test complete. Login state determined: %d.", *state);
 
     disable_wifi_station();
-unlock:
-    k_mutex_unlock(&w_data.mutex);
-    return err;
-}
\ No newline at end of file
+    return E_SUCCESS;
+}
@@ -1,20 +1,128 @@
+/*
+ * Workqueues
+ * -----------------------------------------------------------------------------
+ * The app's work runs on two dedicated queues instead of the system workqueue:
+ * - sampling_workqueue runs the sampling rounds of the temperature logger. It has
+ *   a high priority and a small stack, so a round starts on time even while flash
+ *   is written. Its work only talks to the sensors and pushes onto the sample queues.
+ * - app_workqueue runs everything that may block for a long time: compaction and
+ *   the other flash writes, the uplink and the clock sync. It has a large stack and
+ *   a priority below the networking threads (the net_mgmt event thread runs at
+ *   priority 7 by default), so long flash operations never hold up net_mgmt events,
+ *   and the system workqueue, which is cooperative, is left to the kernel, the
+ *   drivers and the short Wi-Fi and power manager work.
+ *
+ * Size the stacks from the high water marks that the "workqueue stacks" shell command
+ * prints, or log_workqueue_stack_usage() logs at the end of the boot.
+ */
+
 #include <zephyr/kernel.h>
 #include <zephyr/kernel/thread_stack.h>
+#include <zephyr/logging/log.h>
+#include "app/workqueue.h"
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
 
-#define APP_WORKQUEUE_STACK_SIZE 512
-#define APP_WORKQUEUE_PRIORITY 5
+// the logs are formatted on the caller's stack (CONFIG_LOG_MODE_IMMEDIATE), which is most of what the sampling round needs
+#define SAMPLING_WORKQUEUE_STACK_SIZE 1536
+#define SAMPLING_WORKQUEUE_PRIORITY 2
+#define APP_WORKQUEUE_STACK_SIZE 4096
+#define APP_WORKQUEUE_PRIORITY 10
 
+LOG_MODULE_REGISTER(workqueue, LOG_LEVEL_DBG);
+
+K_THREAD_STACK_DEFINE(sampling_workqueue_stack, SAMPLING_WORKQUEUE_STACK_SIZE);
 K_THREAD_STACK_DEFINE(app_workqueue_stack, APP_WORKQUEUE_STACK_SIZE);
 
+struct k_work_q sampling_workqueue;
 struct k_work_q app_workqueue;
 
+struct workqueue_stack_usage_t
+{
+    const char *name;
+    size_t size;
+    size_t used;
+};
+
+/* the app's queues and the system workqueue, so all of them can be sized from one report */
+#define WORKQUEUE_COUNT 3
+
+/**
+ * @brief Starts both queues. Call this before initializing any module that submits work.
+ */
 void init_app_workqueue()
 {
+    const struct k_work_queue_config sampling_config = {.name = "sampling_wq"};
+    k_work_queue_init(&sampling_workqueue);
+    k_work_queue_start(
+        &sampling_workqueue,
+        sampling_workqueue_stack,
+        K_THREAD_STACK_SIZEOF(sampling_workqueue_stack),
+        SAMPLING_WORKQUEUE_PRIORITY,
+        &sampling_config);
+
+    const struct k_work_queue_config app_config = {.name = "app_wq"};
     k_work_queue_init(&app_workqueue);
     k_work_queue_start(
         &app_workqueue,
         app_workqueue_stack,
         K_THREAD_STACK_SIZEOF(app_workqueue_stack),
         APP_WORKQUEUE_PRIORITY,
-        NULL);
-}
\ No newline at end of file
+        &app_config);
+}
+
+/**
+ * @brief Fills in the peak stack usage of every queue.
+ * * The stacks are painted when the threads start (CONFIG_INIT_STACKS), so 'used' is the
+ * high water mark since boot. Without CONFIG_INIT_STACKS and CONFIG_THREAD_STACK_INFO it reads as 0.
+ */
+static void get_workqueue_stack_usage(struct workqueue_stack_usage_t usage[WORKQUEUE_COUNT])
+{
+    usage[0] = (struct workqueue_stack_usage_t){.name = "sampling_wq", .size = K_THREAD_STACK_SIZEOF(sampling_workqueue_stack)};
+    usage[1] = (struct workqueue_stack_usage_t){.name = "app_wq", .size = K_THREAD_STACK_SIZEOF(app_workqueue_stack)};
+    usage[2] = (struct workqueue_stack_usage_t){.name = "sysworkq", .size = CONFIG_SYSTEM_WORKQUEUE_STACK_SIZE};
+#if defined(CONFIG_INIT_STACKS) && defined(CONFIG_THREAD_STACK_INFO)
+    struct k_work_q *queues[WORKQUEUE_COUNT] = {&sampling_workqueue, &app_workqueue, &k_sys_work_q};
+    for (size_t i = 0; i < WORKQUEUE_COUNT; i++)
+    {
+        size_t unused = 0;
+        if (k_thread_stack_space_get(k_work_queue_thread_get(queues[i]), &unused) == 0)
+        {
+            usage[i].used = usage[i].size - unused;
+        }
+    }
+#endif
+}
+
+/**
+ * @brief Logs the peak stack usage of every queue.
+ */
+void log_workqueue_stack_usage(void)
+{
+    struct workqueue_stack_usage_t usage[WORKQUEUE_COUNT];
+    get_workqueue_stack_usage(usage);
+    for (size_t i = 0; i < WORKQUEUE_COUNT; i++)
+    {
+        LOG_INF("%s: %u of %u stack bytes used.", usage[i].name, (unsigned int)usage[i].used, (unsigned int)usage[i].size);
+    }
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_workqueue_stacks(const struct shell *sh, size_t argc, char **argv)
+{
+    struct workqueue_stack_usage_t usage[WORKQUEUE_COUNT];
+    get_workqueue_stack_usage(usage);
+    for (size_t i = 0; i < WORKQUEUE_COUNT; i++)
+    {
+        shell_print(sh, "%s used=%u size=%u", usage[i].name, (unsigned int)usage[i].used, (unsigned int)usage[i].size);
+    }
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(workqueue_commands,
+                               SHELL_CMD(stacks, NULL, "Print the peak stack usage of every workqueue in bytes.", cmd_workqueue_stacks),
+                               SHELL_SUBCMD_SET_END);
+SHELL_CMD_REGISTER(workqueue, &workqueue_commands, "Workqueue statistics", NULL);
+#endif
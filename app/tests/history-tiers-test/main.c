@@ -0,0 +1,212 @@
+#include <zephyr/kernel.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/logging/log.h>
+#include "app/nvs.h"
+#include "app/temperature-logger.h"
+#include "app/temperature-history.h"
+#include "app/temperature-tiers.h"
+#include "app/history-cursor.h"
+
+LOG_MODULE_REGISTER(main, LOG_LEVEL_DBG);
+
+#define TEST_SEGMENT 2000
+
+static struct temperature_list_t list;
+static struct temperature_list_t recovered;
+static struct temperature_segment_reader_t reader;
+static struct temperature_tier_reader_t tier_reader;
+static struct history_cursor_t cursor;
+
+// Stores 'count' samples taken once a minute from uptime 0 with temperature 'uptime' and rolls them up.
+enum error_e roll_up_samples(size_t count)
+{
+    list.length = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        set_temperature_list_sample(&list, i, (struct temperature_sample_t){.uptime = i, .temperature = i});
+    }
+    list.length = count;
+    enum error_e err = store_temperature_segment(0, TEST_SEGMENT, &list);
+    if (err == E_SUCCESS)
+    {
+        err = open_temperature_segment(&reader, 0, TEST_SEGMENT);
+    }
+    if (err == E_SUCCESS)
+    {
+        err = roll_up_temperature_segment(0, &reader);
+    }
+    return err;
+}
+
+// --- TEST CASES ---
+
+void run_test_cases(void)
+{
+    struct temperature_aggregate_t aggregate;
+    bool ok;
+
+    // TEST CASE 1: One hour of samples ends up in twelve 5 minute aggregates
+    LOG_INF("\n\n=============== STARTING TEST CASE 1: 5 Minute Tier ===============");
+    clear_temperature_tiers(0);
+    ok = roll_up_samples(60) == E_SUCCESS && open_temperature_tier(&tier_reader, 0, TEMPERATURE_TIER_5_MINUTES) == E_SUCCESS;
+    for (size_t i = 0; ok && i < 12; i++)
+    {
+        sys_minutes_t start = i * 5;
+        ok = read_temperature_tier(&tier_reader, &aggregate) == E_SUCCESS &&
+             aggregate.start == start && aggregate.count == 5 &&
+             aggregate.min == start && aggregate.max == start + 4 &&
+             get_temperature_aggregate_mean(&aggregate) == start + 2;
+    }
+    if (ok && read_temperature_tier(&tier_reader, &aggregate) == E_END_OF_ITER)
+    {
+        LOG_INF("TEST 1 SUCCESS: Aggregates are correct.");
+    }
+    else
+    {
+        LOG_ERR("TEST 1 FAILED: Aggregates are wrong.");
+    }
+
+    // TEST CASE 2: A full tier rolls up into the next one without losing samples
+    LOG_INF("\n\n=============== STARTING TEST CASE 2: Tier Overflow ===============");
+    clear_temperature_tiers(0);
+    ok = roll_up_samples(CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE) == E_SUCCESS;
+    uint32_t count = 0;
+    sys_minutes_t previous_start = 0;
+    for (int tier = TEMPERATURE_TIER_COUNT - 1; ok && tier >= 0; tier--)
+    {
+        ok = open_temperature_tier(&tier_reader, 0, tier) == E_SUCCESS;
+        while (ok && read_temperature_tier(&tier_reader, &aggregate) == E_SUCCESS)
+        {
+            // coarser tiers hold older data, so going from coarse to fine must be in order
+            ok = aggregate.start >= previous_start;
+            previous_start = aggregate.start;
+            count += aggregate.count;
+        }
+    }
+    if (ok && count == CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE)
+    {
+        LOG_INF("TEST 2 SUCCESS: %u samples kept across the tiers.", count);
+    }
+    else
+    {
+        LOG_ERR("TEST 2 FAILED: %u of %d samples kept.", count, CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE);
+    }
+
+    // TEST CASE 3: The mean is rounded to the nearest step
+    LOG_INF("\n\n=============== STARTING TEST CASE 3: Mean ===============");
+    struct temperature_aggregate_t a = {.sum = 7, .count = 2};
+    struct temperature_aggregate_t b = {.sum = -7, .count = 2};
+    struct temperature_aggregate_t c = {.sum = 0, .count = 0};
+    if (get_temperature_aggregate_mean(&a) == 4 && get_temperature_aggregate_mean(&b) == -4 && get_temperature_aggregate_mean(&c) == 0)
+    {
+        LOG_INF("TEST 3 SUCCESS: Mean is rounded.");
+    }
+    else
+    {
+        LOG_ERR("TEST 3 FAILED: Mean is not rounded.");
+    }
+    clear_temperature_tiers(0);
+
+    // TEST CASE 4: The journal gives back the unflushed samples until the list is appended
+    LOG_INF("\n\n=============== STARTING TEST CASE 4: Journal ===============");
+    list.length = 0;
+    for (size_t i = 0; i < 100; i++)
+    {
+        set_temperature_list_sample(&list, i, (struct temperature_sample_t){.uptime = i * 2, .temperature = i % 7});
+    }
+    list.length = 70;
+    ok = store_temperature_journal(0, &list, 0) == E_SUCCESS;
+    list.length = 100;
+    ok = ok && store_temperature_journal(0, &list, 70) == E_SUCCESS;
+    recovered.length = 0;
+    ok = ok && load_temperature_journal(0, &recovered) == E_SUCCESS && recovered.length == list.length;
+    for (size_t i = 0; ok && i < list.length; i++)
+    {
+        ok = recovered.uptime[i] == list.uptime[i] && recovered.temperature[i] == list.temperature[i];
+    }
+    if (ok && append_temperature_segment(0, &list) == E_SUCCESS)
+    {
+        recovered.length = 0;
+        ok = load_temperature_journal(0, &recovered) == E_SUCCESS && recovered.length == 0;
+    }
+    if (ok)
+    {
+        LOG_INF("TEST 4 SUCCESS: Journal recovered %d samples and is stale after the append.", (int)list.length);
+    }
+    else
+    {
+        LOG_ERR("TEST 4 FAILED: Recovered %d of %d samples.", (int)recovered.length, (int)list.length);
+    }
+
+    // TEST CASE 5: A corrupted index slot falls back to the previous commit
+    LOG_INF("\n\n=============== STARTING TEST CASE 5: Index Fallback ===============");
+    struct temperature_history_index_t before, after;
+    get_temperature_history_index(0, &before);
+    ok = drop_oldest_temperature_segment(0) == E_SUCCESS;
+    // one of the slots holds the drop, the other one the commit before it
+    nvs_write(get_nvs_fs(), NVS_KEY_TEMPERATURE_HISTORY_INDEX, "torn", 4);
+    ok = ok && init_temperature_history() == E_SUCCESS;
+    get_temperature_history_index(0, &after);
+    if (ok && (after.oldest_segment == before.oldest_segment || after.oldest_segment == before.oldest_segment + 1))
+    {
+        LOG_INF("TEST 5 SUCCESS: Index loaded from the other slot.");
+    }
+    else
+    {
+        LOG_ERR("TEST 5 FAILED: Index was not recovered.");
+    }
+
+    // TEST CASE 6: A cursor pages through the segments in time order, from its start time on
+    LOG_INF("\n\n=============== STARTING TEST CASE 6: History Cursor ===============");
+    ok = true;
+    for (size_t segment = 0; ok && segment < 2; segment++)
+    {
+        list.length = 0;
+        for (size_t i = 0; i < 100; i++)
+        {
+            set_temperature_list_sample(&list, i, (struct temperature_sample_t){.uptime = 10000 + segment * 100 + i, .temperature = i});
+        }
+        list.length = 100;
+        ok = append_temperature_segment(0, &list) == E_SUCCESS;
+    }
+    struct temperature_sample_t samples[7];
+    size_t read;
+    size_t total = 0;
+    sys_minutes_t expected_uptime = 10030;
+    ok = ok && open_history_cursor(&cursor, 0, expected_uptime, false) == E_SUCCESS;
+    while (ok && read_history_cursor(&cursor, samples, ARRAY_SIZE(samples), &read) == E_SUCCESS && read > 0)
+    {
+        for (size_t i = 0; ok && i < read; i++)
+        {
+            ok = samples[i].uptime == expected_uptime++;
+        }
+        total += read;
+    }
+    // resume in the middle of the newest segment, like the uplink after a reboot
+    get_temperature_history_index(0, &after);
+    ok = ok && open_history_cursor_at(&cursor, 0, after.oldest_segment + after.segment_count - 1, 50, false) == E_SUCCESS &&
+         read_history_cursor(&cursor, samples, ARRAY_SIZE(samples), &read) == E_SUCCESS && read == ARRAY_SIZE(samples) &&
+         samples[0].uptime == 10150 && cursor.offset - read == 50;
+    if (ok && total == 170)
+    {
+        LOG_INF("TEST 6 SUCCESS: Cursor read %d samples in order.", (int)total);
+    }
+    else
+    {
+        LOG_ERR("TEST 6 FAILED: Cursor read %d of 170 samples, up to uptime %u.", (int)total, expected_uptime);
+    }
+}
+
+int main(void)
+{
+    LOG_INF("Starting history tiers tests...");
+
+    init_nvs();
+    init_temperature_history();
+    init_temperature_tiers();
+    run_test_cases();
+
+    LOG_INF("All tests finished.");
+
+    return 0;
+}
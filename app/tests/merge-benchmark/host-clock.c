@@ -0,0 +1,14 @@
+/*
+ * Built into the native_sim runner, not the embedded image, so it can use
+ * the host's libc.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+uint64_t get_benchmark_host_time_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
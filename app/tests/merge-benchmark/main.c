@@ -0,0 +1,282 @@
+/*
+ * Merge Benchmark
+ * -----------------------------------------------------------------------------
+ * Times merge_temperature_lists(), merge_iterate(), interpolate() and
+ * interpolate_uniform() on lists of CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE
+ * samples, for several shapes of data. The decimated merge is also timed on
+ * the general decimation_sweep(), which merge_temperature_lists() only uses
+ * for merges in place, so the two can be compared.
+ *
+ * Every result is printed as one JSON object on a line that starts with
+ * "BENCH ". The last line is "BENCH DONE". `west benchmark merge-benchmark`
+ * builds this app for native_sim once per buffer size, runs it and collects
+ * the results.
+ *
+ * On native_sim the kernel clock is simulated and does not move while code
+ * runs, so durations come from the host's monotonic clock (host-clock.c). On
+ * hardware the cycle counter is used.
+ *
+ * Every case runs in a fresh thread. The stack is painted when the thread is
+ * created, so the high water mark of that thread is the peak stack of the case.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include "app/temperature-logger.h"
+#include "app/uplink.h"
+
+#define BENCHMARK_STACK_SIZE 4096
+#define BENCHMARK_PRIORITY 5
+#define BENCHMARK_MIN_SAMPLES 65536 /* every case is repeated until it has processed at least this many samples */
+
+enum benchmark_shape_e
+{
+    SHAPE_CONSTANT,    /* the same reading over and over */
+    SHAPE_NOISE,       /* a constant reading with +-1 LSB of jitter */
+    SHAPE_RAMP,        /* one LSB more every sample */
+    SHAPE_STEPS,       /* a square wave of 10 degrees */
+    SHAPE_GAPS,        /* a ramp sampled at random periods of 1 to 16 minutes */
+    SHAPE_INTERLEAVED, /* a ramp, with both lists covering the same time range */
+    SHAPE_COUNT,
+};
+
+static const char *const shape_names[SHAPE_COUNT] = {
+    [SHAPE_CONSTANT] = "constant",
+    [SHAPE_NOISE] = "noise",
+    [SHAPE_RAMP] = "ramp",
+    [SHAPE_STEPS] = "steps",
+    [SHAPE_GAPS] = "gaps",
+    [SHAPE_INTERLEAVED] = "interleaved",
+};
+
+struct benchmark_case_t
+{
+    const char *name;
+    // runs the case once and returns the number of samples it processed
+    size_t (*run)(void);
+    bool half_lists; /* fill the sources half way, so they fit into dest without decimation */
+};
+
+struct benchmark_result_t
+{
+    uint64_t elapsed_ns;
+    size_t samples;
+    size_t repeats;
+};
+
+// src2 holds the older samples, like the older segment in a compaction
+static struct temperature_list_t src1;
+static struct temperature_list_t src2;
+static struct temperature_list_t dest;
+static sys_minutes_t uniform_uptimes[CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE];
+static temperature_t uniform_temperatures[CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE];
+static volatile int32_t sink; /* keeps results of the benchmarks observable */
+
+static struct k_thread benchmark_thread;
+K_THREAD_STACK_DEFINE(benchmark_stack, BENCHMARK_STACK_SIZE);
+
+#if CONFIG_ARCH_POSIX
+uint64_t get_benchmark_host_time_ns(void);
+
+static uint64_t start_timer(void)
+{
+    return get_benchmark_host_time_ns();
+}
+
+static uint64_t stop_timer(uint64_t start)
+{
+    return get_benchmark_host_time_ns() - start;
+}
+#else
+static uint64_t start_timer(void)
+{
+    return k_cycle_get_32();
+}
+
+// a run is far shorter than one wrap of the cycle counter
+static uint64_t stop_timer(uint64_t start)
+{
+    return k_cyc_to_ns_floor64((uint32_t)(k_cycle_get_32() - (uint32_t)start));
+}
+#endif
+
+// the uplink is not linked in
+void notify_uplink_sampling_round(void)
+{
+}
+
+static uint32_t next_random(uint32_t *state)
+{
+    // xorshift32. the data only has to look irregular and be the same on every run
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/**
+ * @brief Fills a list with 'length' samples of a shape, starting at 'uptime'.
+ * * @return The uptime after the last sample.
+ */
+static sys_minutes_t fill_list(struct temperature_list_t *list, enum benchmark_shape_e shape, sys_minutes_t uptime, size_t length, uint32_t seed)
+{
+    const temperature_t base = 20 * 16;
+    uint32_t state = seed;
+    reset_temperature_list(list);
+    for (size_t i = 0; i < length; i++)
+    {
+        temperature_t temperature = base;
+        sys_minutes_t period = shape == SHAPE_INTERLEAVED ? 2 : 5;
+        switch (shape)
+        {
+        case SHAPE_NOISE:
+            temperature = base + (temperature_t)(next_random(&state) % 3) - 1;
+            break;
+        case SHAPE_RAMP:
+        case SHAPE_INTERLEAVED:
+            temperature = base + (temperature_t)i;
+            break;
+        case SHAPE_STEPS:
+            temperature = (i / 16) % 2 == 0 ? base : base + 10 * 16;
+            break;
+        case SHAPE_GAPS:
+            temperature = base + (temperature_t)i;
+            period = 1 + next_random(&state) % 16;
+            break;
+        default:
+            break;
+        }
+        append_temperature_sample(list, (struct temperature_sample_t){.uptime = uptime, .temperature = temperature});
+        uptime += period;
+    }
+    return uptime;
+}
+
+/**
+ * @brief Fills both sources with 'length' samples each.
+ * * Normally src1 follows src2 in time. SHAPE_INTERLEAVED offsets them by one minute instead, so every
+ * step of a merge switches between the two lists.
+ */
+static void fill_sources(enum benchmark_shape_e shape, size_t length)
+{
+    sys_minutes_t end = fill_list(&src2, shape, 1000, length, 0x12345678);
+    fill_list(&src1, shape, shape == SHAPE_INTERLEAVED ? 1001 : end, length, 0x9abcdef0);
+}
+
+static size_t run_merge(void)
+{
+    merge_temperature_lists(&src1, &src2, &dest);
+    sink = dest.temperature[dest.length - 1];
+    return src1.length + src2.length;
+}
+
+static size_t run_generic_decimation(void)
+{
+    struct temperature_source_t source1 = {.list = &src1};
+    struct temperature_source_t source2 = {.list = &src2};
+    decimation_sweep(&source1, &source2, &dest, false, false);
+    update_temperature_list_summary(&dest);
+    sink = dest.temperature[dest.length - 1];
+    return src1.length + src2.length;
+}
+
+static size_t run_merge_iterate(void)
+{
+    struct merge_iterator_t iterator;
+    struct temperature_sample_t sample;
+    int32_t sum = 0;
+    size_t count = 0;
+    init_merge_iterator(&iterator, &src1, &src2);
+    while (merge_iterate(&iterator, &sample) == E_SUCCESS)
+    {
+        sum += sample.temperature;
+        count++;
+    }
+    sink = sum;
+    return count;
+}
+
+static size_t run_interpolate(void)
+{
+    int32_t sum = 0;
+    for (size_t i = 0; i + 1 < src1.length; i++)
+    {
+        struct temperature_sample_t earlier = get_temperature_list_sample(&src1, i);
+        struct temperature_sample_t later = get_temperature_list_sample(&src1, i + 1);
+        struct temperature_sample_t result = {.uptime = earlier.uptime + (later.uptime - earlier.uptime) / 2};
+        interpolate(&earlier, &later, &result);
+        sum += result.temperature;
+    }
+    sink = sum;
+    return MAX(src1.length, 1) - 1;
+}
+
+static size_t run_interpolate_uniform(void)
+{
+    struct temperature_sample_t first = get_temperature_list_sample(&src1, 0);
+    struct temperature_sample_t last = get_temperature_list_sample(&src1, src1.length - 1);
+    size_t count = CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE;
+    sys_minutes_t period = (last.uptime - first.uptime) / count;
+    interpolate_uniform(&first, &last, first.uptime, period, count, uniform_uptimes, uniform_temperatures);
+    sink = uniform_temperatures[count - 1];
+    return count;
+}
+
+static const struct benchmark_case_t benchmark_cases[] = {
+    {.name = "merge_temperature_lists", .run = run_merge, .half_lists = true},
+    {.name = "merge_temperature_lists_decimated", .run = run_merge},
+    {.name = "merge_temperature_lists_decimated_generic", .run = run_generic_decimation},
+    {.name = "merge_iterate", .run = run_merge_iterate},
+    {.name = "interpolate", .run = run_interpolate},
+    {.name = "interpolate_uniform", .run = run_interpolate_uniform},
+};
+
+static void run_benchmark_case(void *p1, void *p2, void *p3)
+{
+    const struct benchmark_case_t *c = p1;
+    struct benchmark_result_t *result = p2;
+    // a warm up run, so the first run does not pay for cold caches
+    c->run();
+    result->samples = 0;
+    result->repeats = 0;
+    uint64_t start = start_timer();
+    while (result->samples < BENCHMARK_MIN_SAMPLES)
+    {
+        result->samples += MAX(c->run(), 1);
+        result->repeats++;
+    }
+    result->elapsed_ns = stop_timer(start);
+}
+
+static void report_benchmark_case(const struct benchmark_case_t *c, enum benchmark_shape_e shape)
+{
+    struct benchmark_result_t result;
+    k_thread_create(&benchmark_thread, benchmark_stack, K_THREAD_STACK_SIZEOF(benchmark_stack),
+                    run_benchmark_case, (void *)c, &result, NULL, BENCHMARK_PRIORITY, 0, K_NO_WAIT);
+    k_thread_join(&benchmark_thread, K_FOREVER);
+
+    size_t unused = 0;
+    k_thread_stack_space_get(&benchmark_thread, &unused);
+    // hundredths of a nanosecond, printed with two decimals. printk has no floats
+    uint64_t centi_ns = result.elapsed_ns * 100 / result.samples;
+    printk("BENCH {\"benchmark\":\"%s\",\"shape\":\"%s\",\"buffer_size\":%d,\"samples\":%u,\"repeats\":%u,"
+           "\"ns_per_sample\":%u.%02u,\"stack_bytes\":%u}\n",
+           c->name, shape_names[shape], CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE, (unsigned int)result.samples,
+           (unsigned int)result.repeats, (unsigned int)(centi_ns / 100), (unsigned int)(centi_ns % 100),
+           (unsigned int)(K_THREAD_STACK_SIZEOF(benchmark_stack) - unused));
+}
+
+int main(void)
+{
+    for (enum benchmark_shape_e shape = 0; shape < SHAPE_COUNT; shape++)
+    {
+        for (size_t i = 0; i < ARRAY_SIZE(benchmark_cases); i++)
+        {
+            const struct benchmark_case_t *c = &benchmark_cases[i];
+            fill_sources(shape, c->half_lists ? MAX(CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE / 2, 1) : CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE);
+            report_benchmark_case(c, shape);
+        }
+    }
+    printk("BENCH DONE\n");
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include "app/config-settings.h"
 #include "app/wifi.h"
 #include "app/temperature-logger.h"
+#include "app/temperature-history.h"
 
 LOG_MODULE_REGISTER(main, LOG_LEVEL_DBG);
 
@@ -20,16 +21,17 @@ void print_list(const char *name, const struct temperature_list_t *list)
     LOG_INF("--- List: %s (Length: %zu) ---", name, list->length);
     for (size_t i = 0; i < list->length; i++)
     {
-        float temp = temp_to_float(list->data[i].temperature);
+        float temp = temp_to_float(list->temperature[i]);
         LOG_INF("[%02zu] Uptime: %u min, Temp: %.2f (Raw: %d)",
-                i, list->data[i].uptime, (double)temp, list->data[i].temperature);
+                i, list->uptime[i], (double)temp, list->temperature[i]);
     }
 }
 
 // Utility function to reset list (without locking the mutex)
 void reset_list_data(struct temperature_list_t *t)
 {
-    memset(t->data, 0, sizeof(t->data));
+    memset(t->uptime, 0, sizeof(t->uptime));
+    memset(t->temperature, 0, sizeof(t->temperature));
     t->length = 0;
 }
 
@@ -55,17 +57,17 @@ void run_test_cases(struct temperature_list_t *src1, struct temperature_list_t *
 
     // src1: 10 min, 10.0°C (160 raw) -> 20 min, 30.0°C (480 raw)
 
-    src1->data[0] = (struct temperature_sample_t){.uptime = 10, .temperature = 160};
+    set_temperature_list_sample(src1, 0, (struct temperature_sample_t){.uptime = 10, .temperature = 160});
 
-    src1->data[1] = (struct temperature_sample_t){.uptime = 20, .temperature = 480};
+    set_temperature_list_sample(src1, 1, (struct temperature_sample_t){.uptime = 20, .temperature = 480});
 
     src1->length = 2;
 
     // src2: 30 min, 50.0°C (800 raw) -> 40 min, 70.0°C (1120 raw)
 
-    src2->data[0] = (struct temperature_sample_t){.uptime = 30, .temperature = 800};
+    set_temperature_list_sample(src2, 0, (struct temperature_sample_t){.uptime = 30, .temperature = 800});
 
-    src2->data[1] = (struct temperature_sample_t){.uptime = 40, .temperature = 1120};
+    set_temperature_list_sample(src2, 1, (struct temperature_sample_t){.uptime = 40, .temperature = 1120});
 
     src2->length = 2;
 
@@ -113,17 +115,17 @@ void run_test_cases(struct temperature_list_t *src1, struct temperature_list_t *
 
     // src1 (Slow change): 10 min, 10.0°C (160) -> 50 min, 50.0°C (800)
 
-    src1->data[0] = (struct temperature_sample_t){.uptime = 10, .temperature = 160};
+    set_temperature_list_sample(src1, 0, (struct temperature_sample_t){.uptime = 10, .temperature = 160});
 
-    src1->data[1] = (struct temperature_sample_t){.uptime = 50, .temperature = 800};
+    set_temperature_list_sample(src1, 1, (struct temperature_sample_t){.uptime = 50, .temperature = 800});
 
     src1->length = 2;
 
     // src2 (Fast change): 20 min, 20.0°C (320) -> 30 min, 40.0°C (640)
 
-    src2->data[0] = (struct temperature_sample_t){.uptime = 20, .temperature = 320};
+    set_temperature_list_sample(src2, 0, (struct temperature_sample_t){.uptime = 20, .temperature = 320});
 
-    src2->data[1] = (struct temperature_sample_t){.uptime = 30, .temperature = 640};
+    set_temperature_list_sample(src2, 1, (struct temperature_sample_t){.uptime = 30, .temperature = 640});
 
     src2->length = 2;
 
@@ -191,7 +193,7 @@ void run_test_cases(struct temperature_list_t *src1, struct temperature_list_t *
 
     reset_list_data(src2);
 
-    src2->data[0] = (struct temperature_sample_t){.uptime = 1, .temperature = 100};
+    set_temperature_list_sample(src2, 0, (struct temperature_sample_t){.uptime = 1, .temperature = 100});
 
     src2->length = 1;
 
@@ -222,15 +224,15 @@ void run_test_cases(struct temperature_list_t *src1, struct temperature_list_t *
     reset_list_data(dest);
 
     // src1 (Length 3): T=10 @ 10min -> T=30 @ 30min
-    src1->data[0] = (struct temperature_sample_t){.uptime = 10, .temperature = 160}; // 10.0°C
-    src1->data[1] = (struct temperature_sample_t){.uptime = 20, .temperature = 320}; // 20.0°C
-    src1->data[2] = (struct temperature_sample_t){.uptime = 30, .temperature = 480}; // 30.0°C
+    set_temperature_list_sample(src1, 0, (struct temperature_sample_t){.uptime = 10, .temperature = 160}); // 10.0°C
+    set_temperature_list_sample(src1, 1, (struct temperature_sample_t){.uptime = 20, .temperature = 320}); // 20.0°C
+    set_temperature_list_sample(src1, 2, (struct temperature_sample_t){.uptime = 30, .temperature = 480}); // 30.0°C
     src1->length = 3;
 
     // src2 (Length 3): T=40 @ 40min -> T=60 @ 60min
-    src2->data[0] = (struct temperature_sample_t){.uptime = 40, .temperature = 640}; // 40.0°C
-    src2->data[1] = (struct temperature_sample_t){.uptime = 50, .temperature = 800}; // 50.0°C
-    src2->data[2] = (struct temperature_sample_t){.uptime = 60, .temperature = 960}; // 60.0°C
+    set_temperature_list_sample(src2, 0, (struct temperature_sample_t){.uptime = 40, .temperature = 640}); // 40.0°C
+    set_temperature_list_sample(src2, 1, (struct temperature_sample_t){.uptime = 50, .temperature = 800}); // 50.0°C
+    set_temperature_list_sample(src2, 2, (struct temperature_sample_t){.uptime = 60, .temperature = 960}); // 60.0°C
     src2->length = 3;
 
     // Total Length = 6. Capacity = 6. Should use merge_without_decimation (pure chronological merge).
@@ -271,14 +273,14 @@ void run_test_cases(struct temperature_list_t *src1, struct temperature_list_t *
     // Populate src1 (10 min to 35 min)
     for (size_t i = 0; i < 6; i++)
     {
-        src1->data[i] = (struct temperature_sample_t){.uptime = 10 + (i * 5), .temperature = 160 + (i * 3)};
+        set_temperature_list_sample(src1, i, (struct temperature_sample_t){.uptime = 10 + (i * 5), .temperature = 160 + (i * 3)});
     }
     src1->length = 6;
 
     // Populate src2 (40 min to 65 min)
     for (size_t i = 0; i < 6; i++)
     {
-        src2->data[i] = (struct temperature_sample_t){.uptime = 40 + (i * 5), .temperature = 178 + (i * 3)};
+        set_temperature_list_sample(src2, i, (struct temperature_sample_t){.uptime = 40 + (i * 5), .temperature = 178 + (i * 3)});
     }
     src2->length = 6;
 
@@ -302,6 +304,234 @@ void run_test_cases(struct temperature_list_t *src1, struct temperature_list_t *
     {
         LOG_ERR("TEST 5 FAILED: Expected success and length 6, got err=%d, len=%zu", err, dest->length);
     }
+
+    // =======================================================================
+    // TEST CASE 6: In-Place Merge (dest == src2)
+    // Goal: Test that merging into one of the sources gives the same result
+    //       as merging into a separate list. This is how the logger compacts
+    //       its history segments.
+    // =======================================================================
+    LOG_INF("\n\n=============== STARTING TEST CASE 6: In-Place Merge ===============");
+
+    // dest still holds the result of test case 5
+    err = merge_temperature_lists(src1, src2, src2);
+
+    if (err == E_SUCCESS && src2->length == dest->length && memcmp(src2->uptime, dest->uptime, sizeof(sys_minutes_t) * dest->length) == 0 && memcmp(src2->temperature, dest->temperature, sizeof(temperature_t) * dest->length) == 0)
+    {
+        LOG_INF("TEST 6 SUCCESS: In-place decimation matches test case 5.");
+    }
+    else
+    {
+        LOG_ERR("TEST 6 FAILED: Expected the result of test case 5, got err=%d, len=%zu", err, src2->length);
+        print_list("Result", src2);
+    }
+
+    // src1 (Length 3) followed by src2 (Length 3), merged into src1
+    reset_list_data(src1);
+    reset_list_data(src2);
+    for (size_t i = 0; i < 3; i++)
+    {
+        set_temperature_list_sample(src1, i, (struct temperature_sample_t){.uptime = 10 + (i * 10), .temperature = 160 * (i + 1)});
+        set_temperature_list_sample(src2, i, (struct temperature_sample_t){.uptime = 15 + (i * 10), .temperature = 80 + 160 * (i + 1)});
+    }
+    src1->length = 3;
+    src2->length = 3;
+
+    // Expected Uptime Points: 10, 15, 20, 25, 30, 35
+    err = merge_temperature_lists(src1, src2, src1);
+
+    bool in_order = err == E_SUCCESS && src1->length == 6;
+    for (size_t i = 0; in_order && i < src1->length; i++)
+    {
+        in_order = src1->uptime[i] == 10 + (i * 5);
+    }
+    if (in_order)
+    {
+        LOG_INF("TEST 6 SUCCESS: In-place merge without decimation kept all 6 samples in order.");
+        print_list("Result", src1);
+    }
+    else
+    {
+        LOG_ERR("TEST 6 FAILED: Expected 6 samples 5 minutes apart, got err=%d, len=%zu", err, src1->length);
+        print_list("Result", src1);
+    }
+
+    // =======================================================================
+    // TEST CASE 7: Integer Interpolation
+    // Goal: Test that rounding is exact (nearest, halves away from zero) and
+    //       that interpolate_uniform() matches interpolate() sample by sample.
+    // =======================================================================
+    LOG_INF("\n\n=============== STARTING TEST CASE 7: Integer Interpolation ===============");
+
+    // 0 min, 0 raw -> 4 min, 1 raw: 0.25 rounds down, 0.5 rounds up, 0.75 rounds up
+    // 0 min, 0 raw -> 4 min, -1 raw: same, mirrored
+    struct temperature_sample_t t1 = {.uptime = 0, .temperature = 0};
+    struct temperature_sample_t t2 = {.uptime = 4, .temperature = 1};
+    struct temperature_sample_t t3 = {.uptime = 4, .temperature = -1};
+    temperature_t expected[5] = {0, 0, 1, 1, 1};
+    sys_minutes_t uptimes[5];
+    temperature_t temperatures[5];
+    bool exact = interpolate_uniform(&t1, &t2, 0, 1, 5, uptimes, temperatures) == E_SUCCESS;
+    for (size_t i = 0; exact && i < 5; i++)
+    {
+        struct temperature_sample_t single = {.uptime = i};
+        interpolate(&t1, &t2, &single);
+        exact = single.temperature == expected[i] && temperatures[i] == expected[i] && uptimes[i] == i;
+    }
+    exact = exact && interpolate_uniform(&t1, &t3, 0, 1, 5, uptimes, temperatures) == E_SUCCESS;
+    for (size_t i = 0; exact && i < 5; i++)
+    {
+        exact = temperatures[i] == -expected[i];
+    }
+    if (exact)
+    {
+        LOG_INF("TEST 7 SUCCESS: Interpolation rounding is exact.");
+    }
+    else
+    {
+        LOG_ERR("TEST 7 FAILED: Interpolation rounding is not exact.");
+    }
+
+    // =======================================================================
+    // TEST CASE 8: Streaming Merge From NVS
+    // Goal: Merging two segments straight out of NVS gives the same result
+    //       as loading them into lists and merging those.
+    // =======================================================================
+    LOG_INF("\n\n=============== STARTING TEST CASE 8: Streaming Merge ===============");
+
+    // segments 1000 and 1001 are ordinary ring slots. they are not added to the index
+    static struct temperature_segment_reader_t reader1, reader2;
+    static struct temperature_list_t expected_list;
+    bool streamed = true;
+    for (size_t total = 4; streamed && total <= 2 * CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE; total += CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE - 2)
+    {
+        reset_list_data(src1);
+        reset_list_data(src2);
+        src1->length = total / 2;
+        src2->length = total - total / 2;
+        for (size_t i = 0; i < src1->length; i++)
+        {
+            set_temperature_list_sample(src1, i, (struct temperature_sample_t){.uptime = 10 + (i * 3), .temperature = 160 + (i * 7)});
+        }
+        for (size_t i = 0; i < src2->length; i++)
+        {
+            set_temperature_list_sample(src2, i, (struct temperature_sample_t){.uptime = 12 + (i * 4), .temperature = 150 - (i * 5)});
+        }
+        merge_temperature_lists(src1, src2, &expected_list);
+
+        struct temperature_source_t source1 = {.reader = &reader1};
+        struct temperature_source_t source2 = {.reader = &reader2};
+        streamed = store_temperature_segment(0, 1000, src1) == E_SUCCESS &&
+                   store_temperature_segment(0, 1001, src2) == E_SUCCESS &&
+                   open_temperature_segment(&reader1, 0, 1000) == E_SUCCESS &&
+                   open_temperature_segment(&reader2, 0, 1001) == E_SUCCESS &&
+                   merge_temperature_sources(&source1, &source2, dest) == E_SUCCESS &&
+                   dest->length == expected_list.length &&
+                   memcmp(dest->uptime, expected_list.uptime, sizeof(sys_minutes_t) * dest->length) == 0 &&
+                   memcmp(dest->temperature, expected_list.temperature, sizeof(temperature_t) * dest->length) == 0;
+    }
+    if (streamed)
+    {
+        LOG_INF("TEST 8 SUCCESS: Streaming merge matches the list merge.");
+    }
+    else
+    {
+        LOG_ERR("TEST 8 FAILED: Streaming merge does not match the list merge.");
+        print_list("Result", dest);
+    }
+
+    // =======================================================================
+    // TEST CASE 9: Range Queries
+    // Goal: The summarized range queries over a list and over a stored segment
+    //       give the same stats as scanning every sample.
+    // =======================================================================
+    LOG_INF("\n\n=============== STARTING TEST CASE 9: Range Queries ===============");
+
+    bool queried = store_temperature_segment(0, 1002, dest) == E_SUCCESS;
+    sys_minutes_t last_uptime = dest->uptime[dest->length - 1];
+    for (sys_minutes_t start = 0; queried && start <= last_uptime + 1; start++)
+    {
+        for (sys_minutes_t end = start; queried && end <= last_uptime + 1; end += 3)
+        {
+            struct temperature_stats_t expected, from_list, from_segment;
+            init_temperature_stats(&expected);
+            init_temperature_stats(&from_list);
+            init_temperature_stats(&from_segment);
+            for (size_t i = 0; i < dest->length; i++)
+            {
+                if (dest->uptime[i] >= start && dest->uptime[i] <= end)
+                {
+                    add_temperature_stats_sample(&expected, dest->temperature[i]);
+                }
+            }
+            queried = query_temperature_list(dest, start, end, &from_list) == E_SUCCESS &&
+                      query_temperature_segment(0, 1002, start, end, &from_segment) == E_SUCCESS &&
+                      memcmp(&from_list, &expected, sizeof(expected)) == 0 &&
+                      memcmp(&from_segment, &expected, sizeof(expected)) == 0;
+        }
+    }
+    if (queried)
+    {
+        LOG_INF("TEST 9 SUCCESS: Range queries match a full scan.");
+    }
+    else
+    {
+        LOG_ERR("TEST 9 FAILED: Range queries do not match a full scan.");
+    }
+
+    // =======================================================================
+    // TEST CASE 10: Specialized Decimation
+    // Goal: A decimated merge into a separate list (the specialized sweep) gives
+    //       the same result as the general sweep, for ties, falling ramps, gaps
+    //       longer than UINT16_MAX minutes and interleaved sources.
+    // =======================================================================
+    LOG_INF("\n\n=============== STARTING TEST CASE 10: Specialized Decimation ===============");
+
+    static struct temperature_list_t expected_decimation;
+    bool specialized = true;
+    uint32_t state = 0x2545f491;
+    for (size_t round = 0; specialized && round < 32; round++)
+    {
+        reset_list_data(src1);
+        reset_list_data(src2);
+        src1->length = CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE;
+        src2->length = 1 + round % CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE;
+        struct temperature_list_t *lists[2] = {src2, src1};
+        // odd rounds interleave the lists. even rounds put src1 after src2
+        sys_minutes_t uptime = 100;
+        for (size_t l = 0; l < 2; l++)
+        {
+            uptime = round % 2 == 1 ? 100 : uptime;
+            temperature_t temperature = 320;
+            for (size_t i = 0; i < lists[l]->length; i++)
+            {
+                // xorshift32
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                uptime += (state % 8 == 0) ? 0 : (state % 97 == 0 ? 70000 : 1 + state % 16);
+                temperature += (temperature_t)((int32_t)(state >> 8) % 65) - 32;
+                set_temperature_list_sample(lists[l], i, (struct temperature_sample_t){.uptime = uptime, .temperature = temperature});
+            }
+        }
+        struct temperature_source_t source1 = {.list = src1};
+        struct temperature_source_t source2 = {.list = src2};
+        specialized = decimation_sweep(&source1, &source2, &expected_decimation, false, false) == E_SUCCESS &&
+                      merge_with_decimation(src1, src2, dest) == E_SUCCESS &&
+                      dest->length == expected_decimation.length &&
+                      memcmp(dest->uptime, expected_decimation.uptime, sizeof(sys_minutes_t) * dest->length) == 0 &&
+                      memcmp(dest->temperature, expected_decimation.temperature, sizeof(temperature_t) * dest->length) == 0;
+    }
+    if (specialized)
+    {
+        LOG_INF("TEST 10 SUCCESS: The specialized decimation matches the general one.");
+    }
+    else
+    {
+        LOG_ERR("TEST 10 FAILED: The specialized decimation does not match the general one.");
+        print_list("Expected", &expected_decimation);
+        print_list("Result", dest);
+    }
 }
 
 int main(void)
@@ -314,6 +544,10 @@ int main(void)
 
     LOG_INF("Starting temperature list merge tests...");
 
+    // test cases 8 and 9 read and write history segments
+    init_nvs();
+    init_temperature_history();
+
     run_test_cases(&src1, &src2, &dest);
 
     LOG_INF("All tests finished.");
@@ -0,0 +1,321 @@
+/*
+ * NVS Benchmark
+ * -----------------------------------------------------------------------------
+ * Replays the flash write pattern of the logger against storage_partition for
+ * several sector counts and reports, per sector count:
+ * - p50, p99 and max latency of nvs_write()
+ * - the number and length of garbage collection stalls
+ * - the projected flash lifetime
+ *
+ * One flush of one channel is replayed as the logger does it: the journal
+ * writes while the RAM list fills, every block of the segment (packed with the
+ * sample codec, so the records have their real size), the history index, and
+ * once the segment ring is full, the index rewrite of the dropped segment and
+ * one tier block with its index. Index writes alternate between both slots.
+ *
+ * NVS runs garbage collection inside the nvs_write() that moves to a new
+ * sector. A write that changed the sector of fs.ate_wra is counted as a stall.
+ * Every such move also erases one sector, which gives the wear per flush. The
+ * lifetime is projected from that for the fastest and the slowest sampling
+ * period, assuming BENCHMARK_FLASH_ENDURANCE erase cycles per sector.
+ *
+ * WARNING: This erases storage_partition, including the logins and the history.
+ *
+ * Results are printed as one JSON object per line, starting with "BENCH ".
+ */
+
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/logging/log.h>
+#include "app/nvs.h"
+#include "app/sample-codec.h"
+#include "app/temperature-history.h"
+#include "app/temperature-tiers.h"
+
+LOG_MODULE_REGISTER(main, LOG_LEVEL_DBG);
+
+#define NVS_PARTITION storage_partition
+#define NVS_PARTITION_DEVICE FIXED_PARTITION_DEVICE(NVS_PARTITION)
+#define NVS_PARTITION_OFFSET FIXED_PARTITION_OFFSET(NVS_PARTITION)
+#define NVS_PARTITION_SIZE FIXED_PARTITION_SIZE(NVS_PARTITION)
+
+#define BENCHMARK_FLUSHES 100
+#define BENCHMARK_JOURNAL_WRITES (CONFIG_TEMPERATURE_LOGGER_JOURNAL_INTERVAL > 0 ? CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE / MAX(CONFIG_TEMPERATURE_LOGGER_JOURNAL_INTERVAL, 1) + TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT : 0)
+#define BENCHMARK_WRITES_PER_FLUSH (TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT + BENCHMARK_JOURNAL_WRITES + 4)
+#define BENCHMARK_MAX_WRITES (BENCHMARK_FLUSHES * BENCHMARK_WRITES_PER_FLUSH)
+#define BENCHMARK_FLASH_ENDURANCE 100000ULL /* erase cycles per sector of typical SPI NOR flash */
+#define NVS_ADDR_SECT_SHIFT 16              /* the sector is the upper half of an NVS address. see nvs_priv.h */
+#define JOURNAL_HEADER_SIZE 8               /* struct temperature_journal_header_t in temperature-history.c */
+
+/* the same size as the A/B index record in temperature-history.c */
+struct benchmark_index_record_t
+{
+    struct temperature_history_index_t index;
+    uint32_t sequence;
+    uint32_t crc;
+};
+
+static const uint16_t sector_counts[] = {2, 3, 4, 6, 8, 12, 16};
+
+struct benchmark_data_t
+{
+    struct nvs_fs fs;
+    uint32_t latencies_us[BENCHMARK_MAX_WRITES];
+    size_t write_count;
+    uint32_t gc_count;
+    uint32_t gc_max_us;
+    uint64_t gc_total_us;
+    uint64_t bytes_written;
+    uint8_t record[TEMPERATURE_HISTORY_BLOCK_RECORD_MAX_SIZE];
+    uint32_t index_sequence[CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT];
+    uint32_t random_state;
+};
+
+static struct benchmark_data_t b_data = {.random_state = 0x2545f491};
+
+static uint32_t next_random(void)
+{
+    // xorshift32
+    b_data.random_state ^= b_data.random_state << 13;
+    b_data.random_state ^= b_data.random_state >> 17;
+    b_data.random_state ^= b_data.random_state << 5;
+    return b_data.random_state;
+}
+
+/**
+ * @brief Writes one record and records how long it took and whether it ran garbage collection.
+ */
+static enum error_e timed_write(uint16_t id, const void *data, size_t size)
+{
+    uint32_t sector = b_data.fs.ate_wra >> NVS_ADDR_SECT_SHIFT;
+    uint32_t start = k_cycle_get_32();
+    ssize_t bytes_written = nvs_write(&b_data.fs, id, data, size);
+    uint32_t latency = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    if (bytes_written < 0)
+    {
+        LOG_ERR("Failed to write record %u. Error %d.", id, (int)bytes_written);
+        return E_ERROR;
+    }
+    if (b_data.write_count < BENCHMARK_MAX_WRITES)
+    {
+        b_data.latencies_us[b_data.write_count++] = latency;
+    }
+    if ((b_data.fs.ate_wra >> NVS_ADDR_SECT_SHIFT) != sector)
+    {
+        b_data.gc_count++;
+        b_data.gc_total_us += latency;
+        b_data.gc_max_us = MAX(b_data.gc_max_us, latency);
+    }
+    b_data.bytes_written += bytes_written;
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Packs 'count' samples behind a header of 'offset' bytes, like store_temperature_segment()
+ * and store_temperature_journal() do.
+ * * The readings wander by a few LSB, like a room does over 5 hours.
+ * * @return The size of the record.
+ */
+static size_t build_block_record(sys_minutes_t uptime, size_t offset, size_t count)
+{
+    memset(b_data.record, 0, offset);
+    memcpy(b_data.record, &uptime, sizeof(uptime));
+
+    struct sample_encoder_t encoder;
+    init_sample_encoder(&encoder, &b_data.record[offset], sizeof(b_data.record) - offset);
+    temperature_t temperature = 20 * 16;
+    for (size_t i = 0; i < count; i++)
+    {
+        temperature += (temperature_t)(next_random() % 3) - 1;
+        encode_sample(&encoder, (struct temperature_sample_t){.uptime = uptime + i * 5, .temperature = temperature});
+    }
+    return offset + encoder.size;
+}
+
+/**
+ * @brief Writes one copy of the history index to the slot its sequence number selects.
+ */
+static enum error_e write_index(size_t channel, const struct temperature_history_index_t *index)
+{
+    struct benchmark_index_record_t record = {.index = *index, .sequence = ++b_data.index_sequence[channel], .crc = next_random()};
+    uint16_t key = (record.sequence & 1) ? NVS_KEY_TEMPERATURE_HISTORY_INDEX_B : NVS_KEY_TEMPERATURE_HISTORY_INDEX;
+    return timed_write(key + channel, &record, sizeof(record));
+}
+
+/**
+ * @brief Writes the journal records of one channel while its RAM list fills up, one batch of
+ * CONFIG_TEMPERATURE_LOGGER_JOURNAL_INTERVAL samples at a time.
+ */
+static enum error_e replay_journal(size_t channel, sys_minutes_t uptime)
+{
+    enum error_e err = E_SUCCESS;
+    size_t journaled = 0;
+    for (size_t length = CONFIG_TEMPERATURE_LOGGER_JOURNAL_INTERVAL;
+         CONFIG_TEMPERATURE_LOGGER_JOURNAL_INTERVAL > 0 && length <= CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE && err == E_SUCCESS;
+         length += CONFIG_TEMPERATURE_LOGGER_JOURNAL_INTERVAL)
+    {
+        for (size_t block = journaled / SAMPLE_CODEC_BLOCK_SIZE; block * SAMPLE_CODEC_BLOCK_SIZE < length && err == E_SUCCESS; block++)
+        {
+            size_t count = MIN(length - block * SAMPLE_CODEC_BLOCK_SIZE, SAMPLE_CODEC_BLOCK_SIZE);
+            size_t size = build_block_record(uptime + block * SAMPLE_CODEC_BLOCK_SIZE * 5, JOURNAL_HEADER_SIZE, count);
+            err = timed_write(NVS_KEY_TEMPERATURE_JOURNAL_BASE + channel * TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT + block, b_data.record, size);
+        }
+        journaled = length;
+    }
+    return err;
+}
+
+/**
+ * @brief Writes everything one flush writes. The channels take turns, like they fill up at the same rate.
+ */
+static enum error_e replay_flush(uint32_t flush)
+{
+    size_t channel = flush % CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT;
+    uint32_t segment = flush / CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT;
+    uint32_t ring = channel * CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT + segment % CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT;
+    enum error_e err = replay_journal(channel, segment * CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE * 5);
+    for (size_t block = 0; block < TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT && err == E_SUCCESS; block++)
+    {
+        size_t size = build_block_record(segment * CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE * 5 + block * SAMPLE_CODEC_BLOCK_SIZE * 5,
+                                         TEMPERATURE_HISTORY_BLOCK_HEADER_SIZE + TEMPERATURE_HISTORY_BLOCK_SUMMARY_SIZE, SAMPLE_CODEC_BLOCK_SIZE);
+        err = timed_write(NVS_KEY_TEMPERATURE_SEGMENT_BASE + ring * TEMPERATURE_HISTORY_BLOCKS_PER_SEGMENT + block, b_data.record, size);
+    }
+
+    struct temperature_history_index_t index = {.oldest_segment = 0, .segment_count = segment + 1, .generation = segment};
+    if (err == E_SUCCESS)
+    {
+        err = write_index(channel, &index);
+    }
+    if (err != E_SUCCESS || segment + 1 < CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT)
+    {
+        return err;
+    }
+
+    // the ring is full. the oldest segment is rolled up into a tier block and dropped
+    struct temperature_aggregate_t aggregates[TEMPERATURE_TIER_BLOCK_SIZE];
+    for (size_t i = 0; i < ARRAY_SIZE(aggregates); i++)
+    {
+        aggregates[i] = (struct temperature_aggregate_t){.start = segment * 1000 + i, .sum = next_random() % 10000, .count = 12};
+    }
+    struct temperature_tier_index_t tier_index = {.oldest_block = segment, .block_count = CONFIG_TEMPERATURE_LOGGER_TIER_BLOCK_COUNT};
+    index.oldest_segment = segment + 1 - CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT + 1;
+    index.segment_count = CONFIG_TEMPERATURE_LOGGER_SEGMENT_COUNT - 1;
+    uint32_t tier_ring = channel * TEMPERATURE_TIER_COUNT;
+    err = timed_write(NVS_KEY_TEMPERATURE_TIER_BASE + tier_ring * CONFIG_TEMPERATURE_LOGGER_TIER_BLOCK_COUNT + segment % CONFIG_TEMPERATURE_LOGGER_TIER_BLOCK_COUNT,
+                      aggregates, sizeof(aggregates));
+    if (err == E_SUCCESS)
+    {
+        err = timed_write(NVS_KEY_TEMPERATURE_TIER_INDEX + channel, &tier_index, sizeof(tier_index));
+    }
+    if (err == E_SUCCESS)
+    {
+        err = write_index(channel, &index);
+    }
+    return err;
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Projects the flash lifetime in days for one sampling period.
+ * * Every channel flushes once per CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE samples. The erases are spread over all sectors.
+ */
+static uint64_t get_lifetime_days(uint16_t sector_count, uint32_t sampling_period)
+{
+    if (b_data.gc_count == 0)
+    {
+        return UINT32_MAX;
+    }
+    uint64_t flush_seconds = (uint64_t)CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE * sampling_period / CONFIG_TEMPERATURE_LOGGER_CHANNEL_COUNT;
+    uint64_t replayed_seconds = flush_seconds * BENCHMARK_FLUSHES;
+    return BENCHMARK_FLASH_ENDURANCE * sector_count * replayed_seconds / b_data.gc_count / (24 * 60 * 60);
+}
+
+static enum error_e run_benchmark(const struct device *flash, size_t sector_size, uint16_t sector_count)
+{
+    int ret = flash_erase(flash, NVS_PARTITION_OFFSET, (size_t)sector_count * sector_size);
+    if (ret != 0)
+    {
+        LOG_ERR("Failed to erase %d sectors. Error %d.", sector_count, ret);
+        return E_ERROR;
+    }
+    memset(&b_data.fs, 0, sizeof(b_data.fs));
+    b_data.fs.flash_device = flash;
+    b_data.fs.offset = NVS_PARTITION_OFFSET;
+    b_data.fs.sector_size = sector_size;
+    b_data.fs.sector_count = sector_count;
+    ret = nvs_mount(&b_data.fs);
+    if (ret != 0)
+    {
+        LOG_ERR("Failed to mount NVS with %d sectors. Error %d.", sector_count, ret);
+        return E_ERROR;
+    }
+
+    b_data.write_count = 0;
+    b_data.gc_count = 0;
+    b_data.gc_max_us = 0;
+    b_data.gc_total_us = 0;
+    b_data.bytes_written = 0;
+    memset(b_data.index_sequence, 0, sizeof(b_data.index_sequence));
+    for (uint32_t flush = 0; flush < BENCHMARK_FLUSHES; flush++)
+    {
+        if (replay_flush(flush) != E_SUCCESS)
+        {
+            return E_ERROR;
+        }
+    }
+
+    qsort(b_data.latencies_us, b_data.write_count, sizeof(uint32_t), compare_latencies);
+    size_t count = b_data.write_count;
+    printk("BENCH {\"sector_count\":%u,\"sector_size\":%u,\"writes\":%u,\"bytes\":%u,"
+           "\"p50_us\":%u,\"p99_us\":%u,\"max_us\":%u,\"gc_count\":%u,\"gc_avg_us\":%u,\"gc_max_us\":%u,"
+           "\"free_bytes\":%d,\"lifetime_days_min_period\":%u,\"lifetime_days_max_period\":%u}\n",
+           sector_count, (unsigned int)sector_size, (unsigned int)count, (unsigned int)b_data.bytes_written,
+           b_data.latencies_us[count / 2], b_data.latencies_us[count * 99 / 100], b_data.latencies_us[count - 1],
+           b_data.gc_count, b_data.gc_count > 0 ? (unsigned int)(b_data.gc_total_us / b_data.gc_count) : 0, b_data.gc_max_us,
+           (int)nvs_calc_free_space(&b_data.fs),
+           (unsigned int)MIN(get_lifetime_days(sector_count, CONFIG_TEMPERATURE_LOGGER_MIN_SAMPLING_PERIOD), UINT32_MAX),
+           (unsigned int)MIN(get_lifetime_days(sector_count, CONFIG_TEMPERATURE_LOGGER_MAX_SAMPLING_PERIOD), UINT32_MAX));
+    return E_SUCCESS;
+}
+
+int main(void)
+{
+    LOG_INF("Hello, World!");
+    k_sleep(K_SECONDS(10));
+
+    const struct device *flash = NVS_PARTITION_DEVICE;
+    struct flash_pages_info info;
+    if (!device_is_ready(flash) || flash_get_page_info_by_offs(flash, NVS_PARTITION_OFFSET, &info) != 0)
+    {
+        LOG_ERR("Flash device was not ready.");
+        return 0;
+    }
+    LOG_INF("Benchmarking NVS in %d bytes of flash with %d byte sectors. %d flushes per run.",
+            (int)NVS_PARTITION_SIZE, (int)info.size, BENCHMARK_FLUSHES);
+
+    for (size_t i = 0; i < ARRAY_SIZE(sector_counts); i++)
+    {
+        if ((size_t)sector_counts[i] * info.size > NVS_PARTITION_SIZE)
+        {
+            LOG_INF("%d sectors do not fit in the partition. Skipping.", sector_counts[i]);
+            continue;
+        }
+        run_benchmark(flash, info.size, sector_counts[i]);
+    }
+    printk("BENCH DONE\n");
+
+    while (true)
+    {
+        k_sleep(K_FOREVER);
+    }
+}
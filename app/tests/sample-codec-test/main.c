@@ -0,0 +1,134 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "app/temperature-logger.h"
+#include "app/sample-codec.h"
+
+LOG_MODULE_REGISTER(main, LOG_LEVEL_DBG);
+
+#define SAMPLE_COUNT CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE
+
+static struct temperature_sample_t samples[SAMPLE_COUNT];
+static uint8_t buffer[SAMPLE_CODEC_MAX_ENCODED_SIZE(SAMPLE_COUNT)];
+
+// Encodes 'count' samples and decodes them back. Returns the encoded size or -1 on mismatch.
+int round_trip(size_t count)
+{
+    struct sample_encoder_t encoder;
+    init_sample_encoder(&encoder, buffer, sizeof(buffer));
+    for (size_t i = 0; i < count; i++)
+    {
+        if (encode_sample(&encoder, samples[i]) != E_SUCCESS)
+        {
+            return -1;
+        }
+    }
+
+    struct sample_decoder_t decoder;
+    struct temperature_sample_t sample;
+    size_t decoded = 0;
+    init_sample_decoder(&decoder, buffer, encoder.size);
+    while (decode_sample(&decoder, &sample) == E_SUCCESS)
+    {
+        if (decoded == count || sample.uptime != samples[decoded].uptime || sample.temperature != samples[decoded].temperature)
+        {
+            return -1;
+        }
+        decoded++;
+    }
+    return decoded == count ? (int)encoder.size : -1;
+}
+
+// --- TEST CASES ---
+
+void run_test_cases(void)
+{
+    int size;
+
+    // TEST CASE 1: Samples every 30 seconds with small temperature changes
+    LOG_INF("\n\n=============== STARTING TEST CASE 1: Typical History ===============");
+    for (size_t i = 0; i < SAMPLE_COUNT; i++)
+    {
+        samples[i] = (struct temperature_sample_t){.uptime = 100 + i / 2, .temperature = 350 + (i % 9) - 4};
+    }
+    size = round_trip(SAMPLE_COUNT);
+    if (size >= 0 && size < 1024)
+    {
+        LOG_INF("TEST 1 SUCCESS: %d samples packed into %d bytes (raw %d bytes).",
+                SAMPLE_COUNT, size, (int)(SAMPLE_COUNT * sizeof(struct temperature_sample_t)));
+    }
+    else
+    {
+        LOG_ERR("TEST 1 FAILED: Round trip failed or too large (%d).", size);
+    }
+
+    // TEST CASE 2: Gaps and jumps that need the long form
+    LOG_INF("\n\n=============== STARTING TEST CASE 2: Long Form ===============");
+    for (size_t i = 0; i < SAMPLE_COUNT; i++)
+    {
+        samples[i] = (struct temperature_sample_t){
+            .uptime = (i % 3 == 0) ? 1000 * i : 1000 * i + 7,
+            .temperature = (i % 2 == 0) ? INT16_MIN : INT16_MAX,
+        };
+    }
+    size = round_trip(SAMPLE_COUNT);
+    if (size >= 0)
+    {
+        LOG_INF("TEST 2 SUCCESS: Extreme values survive the round trip.");
+    }
+    else
+    {
+        LOG_ERR("TEST 2 FAILED: Extreme values were corrupted.");
+    }
+
+    // TEST CASE 3: Empty and single sample lists
+    LOG_INF("\n\n=============== STARTING TEST CASE 3: Edge Lengths ===============");
+    samples[0] = (struct temperature_sample_t){.uptime = UINT32_MAX, .temperature = -1};
+    if (round_trip(0) == 0 && round_trip(1) > 0)
+    {
+        LOG_INF("TEST 3 SUCCESS: Edge lengths handled.");
+    }
+    else
+    {
+        LOG_ERR("TEST 3 FAILED: Edge lengths not handled.");
+    }
+
+    // TEST CASE 4: Truncated data is rejected
+    LOG_INF("\n\n=============== STARTING TEST CASE 4: Truncated Data ===============");
+    for (size_t i = 0; i < 4; i++)
+    {
+        samples[i] = (struct temperature_sample_t){.uptime = 100000 * i, .temperature = 100 * i};
+    }
+    struct sample_encoder_t encoder;
+    struct sample_decoder_t decoder;
+    struct temperature_sample_t sample;
+    enum error_e err = E_SUCCESS;
+    init_sample_encoder(&encoder, buffer, sizeof(buffer));
+    for (size_t i = 0; i < 4; i++)
+    {
+        encode_sample(&encoder, samples[i]);
+    }
+    init_sample_decoder(&decoder, buffer, encoder.size - 1);
+    while (err == E_SUCCESS)
+    {
+        err = decode_sample(&decoder, &sample);
+    }
+    if (err == E_INVAL)
+    {
+        LOG_INF("TEST 4 SUCCESS: Truncated data rejected.");
+    }
+    else
+    {
+        LOG_ERR("TEST 4 FAILED: Truncated data returned %d.", err);
+    }
+}
+
+int main(void)
+{
+    LOG_INF("Starting sample codec tests...");
+
+    run_test_cases();
+
+    LOG_INF("All tests finished.");
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "app/temperature-logger.h"
+#include "app/sample-compressor.h"
+
+LOG_MODULE_REGISTER(main, LOG_LEVEL_DBG);
+
+#define SAMPLE_COUNT 4096
+
+static struct temperature_sample_t samples[SAMPLE_COUNT];
+static struct temperature_sample_t kept[SAMPLE_COUNT];
+
+static uint32_t next_random(uint32_t *state)
+{
+    // xorshift32
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// Compresses samples[0, count) into kept, the way the logger fills its RAM list. Returns the number kept.
+size_t compress(size_t count, uint16_t tolerance)
+{
+    struct sample_compressor_t compressor;
+    size_t length = 0;
+    reset_sample_compressor(&compressor, tolerance);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (compress_sample(&compressor, samples[i]) == SAMPLE_COMPRESSOR_REPLACE && length > 0)
+        {
+            kept[length - 1] = samples[i];
+        }
+        else
+        {
+            kept[length++] = samples[i];
+        }
+    }
+    return length;
+}
+
+// Returns the largest error of any sample when it is interpolated from the kept samples around it. -1 if one is not covered.
+int32_t get_reconstruction_error(size_t count, size_t length)
+{
+    int32_t largest = 0;
+    size_t k = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        // the first kept sample at or after this one
+        while (k < length && kept[k].uptime < samples[i].uptime)
+        {
+            k++;
+        }
+        if (k == length)
+        {
+            return -1;
+        }
+        struct temperature_sample_t result = {.uptime = samples[i].uptime, .temperature = kept[k].temperature};
+        if (k > 0 && kept[k].uptime != samples[i].uptime)
+        {
+            interpolate(&kept[k - 1], &kept[k], &result);
+        }
+        else
+        {
+            // samples that share a time are all kept, except the ones the line through them reconstructs
+            for (size_t j = k; j < length && kept[j].uptime == samples[i].uptime; j++)
+            {
+                if (abs(kept[j].temperature - samples[i].temperature) < abs(result.temperature - samples[i].temperature))
+                {
+                    result.temperature = kept[j].temperature;
+                }
+            }
+        }
+        largest = MAX(largest, abs((int32_t)result.temperature - (int32_t)samples[i].temperature));
+    }
+    return largest;
+}
+
+// --- TEST CASES ---
+
+void run_test_cases(void)
+{
+    uint32_t state = 0x1234567;
+    size_t length;
+    int32_t error;
+
+    // TEST CASE 1: A slow drift, sampled every minute, where one reading in 8 flickers by 1 LSB
+    LOG_INF("\n\n=============== STARTING TEST CASE 1: Jitter ===============");
+    for (size_t i = 0; i < SAMPLE_COUNT; i++)
+    {
+        uint32_t random = next_random(&state);
+        temperature_t flicker = random % 8 != 0 ? 0 : ((random >> 8) % 2 == 0 ? -1 : 1);
+        samples[i] = (struct temperature_sample_t){.uptime = 100 + i, .temperature = 350 + (temperature_t)(i / 45) + flicker};
+    }
+    length = compress(SAMPLE_COUNT, 1);
+    error = get_reconstruction_error(SAMPLE_COUNT, length);
+    if (error >= 0 && error <= 1 && length * 5 <= SAMPLE_COUNT)
+    {
+        LOG_INF("TEST 1 SUCCESS: Kept %d of %d samples. Largest error %d.", (int)length, SAMPLE_COUNT, (int)error);
+    }
+    else
+    {
+        LOG_ERR("TEST 1 FAILED: Kept %d of %d samples. Largest error %d.", (int)length, SAMPLE_COUNT, (int)error);
+    }
+
+    // TEST CASE 2: Flat stretches, ramps and steps are lossless with a tolerance of 0
+    LOG_INF("\n\n=============== STARTING TEST CASE 2: Lossless ===============");
+    for (size_t i = 0; i < SAMPLE_COUNT; i++)
+    {
+        temperature_t temperature = (i / 256) % 2 == 0 ? 320 : 480;
+        temperature += (i / 512) % 2 == 0 ? 0 : (temperature_t)(i % 256);
+        samples[i] = (struct temperature_sample_t){.uptime = 100 + 2 * i, .temperature = temperature};
+    }
+    length = compress(SAMPLE_COUNT, 0);
+    error = get_reconstruction_error(SAMPLE_COUNT, length);
+    if (error == 0 && length < 64)
+    {
+        LOG_INF("TEST 2 SUCCESS: Kept %d of %d samples without error.", (int)length, SAMPLE_COUNT);
+    }
+    else
+    {
+        LOG_ERR("TEST 2 FAILED: Kept %d of %d samples. Largest error %d.", (int)length, SAMPLE_COUNT, (int)error);
+    }
+
+    // TEST CASE 3: A random walk at random periods, with samples that share a minute
+    LOG_INF("\n\n=============== STARTING TEST CASE 3: Random Walk ===============");
+    bool within = true;
+    for (uint16_t tolerance = 0; within && tolerance <= 8; tolerance++)
+    {
+        sys_minutes_t uptime = 1000;
+        temperature_t temperature = 0;
+        for (size_t i = 0; i < SAMPLE_COUNT; i++)
+        {
+            uint32_t random = next_random(&state);
+            uptime += random % 4;
+            temperature += (temperature_t)((random >> 8) % 7) - 3;
+            samples[i] = (struct temperature_sample_t){.uptime = uptime, .temperature = temperature};
+        }
+        length = compress(SAMPLE_COUNT, tolerance);
+        error = get_reconstruction_error(SAMPLE_COUNT, length);
+        within = error >= 0 && error <= tolerance && kept[length - 1].uptime == samples[SAMPLE_COUNT - 1].uptime;
+    }
+    if (within)
+    {
+        LOG_INF("TEST 3 SUCCESS: Every sample is reconstructed within the tolerance.");
+    }
+    else
+    {
+        LOG_ERR("TEST 3 FAILED: A sample is reconstructed with error %d.", (int)error);
+    }
+}
+
+int main(void)
+{
+    LOG_INF("Starting sample compressor tests...");
+
+    run_test_cases();
+
+    LOG_INF("All tests finished.");
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+import json
+import os
+import subprocess
+import threading
+from textwrap import dedent
+from west.commands import WestCommand
+
+class BenchmarkCommand(WestCommand):
+
+    default_sizes = '2,8,32,128,576,1024'
+
+    def __init__(self):
+        super().__init__(
+            name='benchmark',
+            help='Builds and runs a benchmark app on native_sim',
+            description=dedent('''
+            Builds app/tests/<target> for native_sim once per buffer size
+            (CONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE), runs every build and
+            collects the "BENCH " lines the app prints.
+
+            The results are written as one JSON array, so two runs can be
+            diffed to catch regressions.'''))
+
+    def do_add_parser(self, parser_adder):
+        parser = parser_adder.add_parser(self.name,
+                                         help=self.help,
+                                         description=self.description)
+
+        parser.add_argument('target', help='benchmark to run, e.g. merge-benchmark')
+        parser.add_argument('-s', '--sizes', default=BenchmarkCommand.default_sizes,
+                            help=f'comma separated buffer sizes (default: {BenchmarkCommand.default_sizes})')
+        parser.add_argument('-o', '--output', help='file that receives the results (default: <workspace>/<target>-results.json)')
+        parser.add_argument('-t', '--timeout', type=int, default=600, help='seconds a single run may take')
+
+        return parser
+
+    def do_run(self, args, unknown_args):
+
+        target: str = args.target
+        if not target.endswith('-benchmark'):
+            self.die('Invalid target. Benchmarks are named *-benchmark.')
+
+        source_dir = os.path.join(self.manifest.topdir, 'temperature-logger/app/tests', target)
+        if not os.path.isdir(source_dir):
+            self.die(f'Benchmark not found: {source_dir}')
+
+        try:
+            sizes = [int(size) for size in args.sizes.split(',')]
+        except ValueError:
+            self.die(f'Invalid buffer sizes: {args.sizes}')
+
+        results = []
+        for size in sizes:
+            build_dir = os.path.join(self.manifest.topdir, f'build-{target}-{size}')
+            command = f'west build -b native_sim -d {build_dir} {source_dir} -- -DCONFIG_TEMPERATURE_LOGGER_BUFFER_SIZE={size}'
+            self.inf(f"Running command: {command}")
+            if subprocess.run(command, shell=True).returncode != 0:
+                self.die(f'Build for buffer size {size} failed.')
+            results.extend(self.run_benchmark(os.path.join(build_dir, 'zephyr', 'zephyr.exe'), args.timeout))
+
+        output = args.output or os.path.join(self.manifest.topdir, f'{target}-results.json')
+        with open(output, 'w') as f:
+            json.dump(results, f, indent=2)
+            f.write('\n')
+        self.inf(f'Wrote {len(results)} results to {output}')
+
+    def run_benchmark(self, executable, timeout):
+        # native_sim keeps running after main() returns, so stop it once the app says it is done
+        self.inf(f'Running {executable}')
+        results = []
+        process = subprocess.Popen([executable], stdout=subprocess.PIPE, text=True)
+        watchdog = threading.Timer(timeout, process.kill)
+        watchdog.start()
+        try:
+            for line in process.stdout:
+                line = line.strip()
+                if line == 'BENCH DONE':
+                    break
+                if line.startswith('BENCH '):
+                    results.append(json.loads(line[len('BENCH '):]))
+            else:
+                self.die(f'{executable} exited or timed out before it finished.')
+        finally:
+            watchdog.cancel()
+            process.kill()
+            process.wait()
+        return results